@@ -18,7 +18,12 @@
 #define THREADPOOL_HPP_INCLUDED
 
 #include <boost/threadpool/pool.hpp>
+#include <boost/threadpool/blocking_region.hpp>
 #include <boost/threadpool/task_adaptors.hpp>
+#include <boost/threadpool/task_handle.hpp>
+#include <boost/threadpool/pipeline.hpp>
+#include <boost/threadpool/strand.hpp>
+#include <boost/threadpool/task_graph.hpp>
 
 #endif // THREADPOOL_HPP_INCLUDED
 
@@ -0,0 +1,97 @@
+/*! \file
+* \brief Blocking regions: tasks announce blocking calls to their pool.
+*
+* A task which waits in a system call or on a lock keeps its worker from
+* the pool's other tasks. If it wraps the blocking call in a
+* blocking_region, the pool adds a compensating worker for the time the
+* task blocks, up to the limit set with fifo_pool::set_compensation, and
+* retires a worker when the region ends.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_BLOCKING_REGION_HPP_INCLUDED
+#define THREADPOOL_BLOCKING_REGION_HPP_INCLUDED
+
+#include <boost/noncopyable.hpp>
+
+
+namespace boost { namespace threadpool
+{
+
+  namespace detail
+  {
+    /*! \brief Functions of the pool a worker thread's blocking regions call.
+    *
+    * Installed by the worker for its lifetime, see current_blocking_hooks.
+    */
+    struct blocking_hooks
+    {
+      void (*begin)(void *);      //!< Called when the outermost region of the thread begins.
+      void (*end)(void *);        //!< Called when it ends.
+      void * argument;            //!< Passed to begin and end.
+      int depth;                  //!< Regions of the thread which did not end yet.
+    };
+
+    /*! Gets the hooks of the calling thread.
+    * \return 0 if the thread is not a worker of a pool.
+    */
+    inline blocking_hooks * & current_blocking_hooks()
+    {
+      static thread_local blocking_hooks * hooks = 0;
+      return hooks;
+    }
+  } // namespace detail
+
+
+
+  /*! \brief Marks a blocking operation of a task.
+  *
+  * Create a blocking_region around a system call or a lock which may block
+  * for long. Regions may be nested, only the outermost one counts. Outside
+  * the workers of a pool the region has no effect.
+  *
+  * \code
+  * {
+  *   blocking_region region;
+  *   read(fd, buffer, size);
+  * }
+  * \endcode
+  *
+  * \see fifo_pool::set_compensation
+  */
+  class blocking_region
+    : private noncopyable
+  {
+    detail::blocking_hooks * const m_hooks;
+
+  public:
+    blocking_region()
+      : m_hooks(detail::current_blocking_hooks())
+    {
+      if(m_hooks && m_hooks->depth++ == 0)
+      {
+        m_hooks->begin(m_hooks->argument);
+      }
+    }
+
+    ~blocking_region()
+    {
+      if(m_hooks && --m_hooks->depth == 0)
+      {
+        m_hooks->end(m_hooks->argument);
+      }
+    }
+  };
+
+
+} } // namespace boost::threadpool
+
+#endif // THREADPOOL_BLOCKING_REGION_HPP_INCLUDED
@@ -0,0 +1,365 @@
+/*! \file
+* \brief C++20 coroutine support.
+*
+* task<T> is a lazy coroutine: it starts when it is awaited, and when it
+* finishes it resumes the awaiting coroutine inline by symmetric transfer.
+* Together with co_await pool.schedule(), which continues a coroutine on a
+* worker, asynchronous code is written as straight-line coroutines instead
+* of chained callbacks. sync_wait runs a task from ordinary code and blocks
+* until it finished.
+*
+* This header requires a compiler with coroutine support.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_COROUTINE_HPP_INCLUDED
+#define THREADPOOL_COROUTINE_HPP_INCLUDED
+
+#if !defined(__cpp_impl_coroutine)
+#error "boost/threadpool/coroutine.hpp requires C++20 coroutines"
+#endif
+
+#include <boost/threadpool/pool.hpp>
+
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+
+namespace boost { namespace threadpool
+{
+
+  template <typename T = void>
+  class task;
+
+  namespace detail
+  {
+    /*! \brief Promise parts which do not depend on the result type.
+    */
+    class task_promise_base
+    {
+    public:
+      std::coroutine_handle<> continuation;   //!< Coroutine awaiting the task, resumed when it finishes.
+      std::exception_ptr exception;           //!< Exception which escaped the task's body.
+
+      struct final_awaiter
+      {
+        bool await_ready() const noexcept
+        {
+          return false;
+        }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> const handle) const noexcept
+        {
+          std::coroutine_handle<> const continuation = handle.promise().continuation;
+          return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept
+        {
+        }
+      };
+
+      std::suspend_always initial_suspend() const noexcept
+      {
+        return std::suspend_always();
+      }
+
+      final_awaiter final_suspend() const noexcept
+      {
+        return final_awaiter();
+      }
+
+      void unhandled_exception() noexcept
+      {
+        exception = std::current_exception();
+      }
+
+    protected:
+      void rethrow() const
+      {
+        if(exception)
+        {
+          std::rethrow_exception(exception);
+        }
+      }
+    };
+
+    template <typename T>
+    class task_promise
+      : public task_promise_base
+    {
+      std::optional<T> m_value;
+
+    public:
+      task<T> get_return_object() noexcept;
+
+      template <typename Value>
+      void return_value(Value && value)
+      {
+        m_value.emplace(std::forward<Value>(value));
+      }
+
+      T result()
+      {
+        rethrow();
+        return std::move(*m_value);
+      }
+    };
+
+    template <>
+    class task_promise<void>
+      : public task_promise_base
+    {
+    public:
+      task<void> get_return_object() noexcept;
+
+      void return_void() const noexcept
+      {
+      }
+
+      void result() const
+      {
+        rethrow();
+      }
+    };
+  } // namespace detail
+
+
+
+  /*! \brief Lazy coroutine which produces a T.
+  *
+  * The body runs when the task is awaited, on the awaiting thread, until it
+  * suspends, e.g. on co_await pool.schedule(). When the body finishes, the
+  * awaiting coroutine is resumed inline on the thread which finished it.
+  * Exceptions are rethrown to the awaiting coroutine. A task is awaited at
+  * most once and owns its coroutine frame.
+  *
+  * \param T The result type, void for none.
+  */
+  template <typename T>
+  class task
+  {
+  public:
+    typedef detail::task_promise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+  private:
+    handle_type m_handle;
+
+  public:
+    explicit task(handle_type const handle) noexcept
+      : m_handle(handle)
+    {
+    }
+
+    task(task && rhs) noexcept
+      : m_handle(std::exchange(rhs.m_handle, handle_type()))
+    {
+    }
+
+    task & operator=(task && rhs) noexcept
+    {
+      if(this != &rhs)
+      {
+        if(m_handle)
+        {
+          m_handle.destroy();
+        }
+        m_handle = std::exchange(rhs.m_handle, handle_type());
+      }
+      return *this;
+    }
+
+    task(task const &) = delete;
+    task & operator=(task const &) = delete;
+
+    ~task()
+    {
+      if(m_handle)
+      {
+        m_handle.destroy();
+      }
+    }
+
+    bool await_ready() const noexcept
+    {
+      return !m_handle || m_handle.done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> const awaiting) noexcept
+    {
+      m_handle.promise().continuation = awaiting;
+      return m_handle;
+    }
+
+    T await_resume()
+    {
+      return m_handle.promise().result();
+    }
+  };
+
+  namespace detail
+  {
+    template <typename T>
+    task<T> task_promise<T>::get_return_object() noexcept
+    {
+      return task<T>(std::coroutine_handle<task_promise<T> >::from_promise(*this));
+    }
+
+    inline task<void> task_promise<void>::get_return_object() noexcept
+    {
+      return task<void>(std::coroutine_handle<task_promise<void> >::from_promise(*this));
+    }
+
+
+
+    /*! \brief Signals a thread blocked in sync_wait.
+    */
+    struct sync_wait_state
+    {
+      std::mutex mutex;
+      std::condition_variable finished_event;
+      bool finished = false;
+      std::exception_ptr exception;
+    };
+
+    /*! \brief Eager coroutine which awaits a task on behalf of sync_wait.
+    *
+    * It signals the waiting thread at its final suspend point and is
+    * destroyed by sync_wait.
+    */
+    class sync_wait_task
+    {
+    public:
+      struct promise_type
+      {
+        sync_wait_state * state = 0;
+
+        struct final_awaiter
+        {
+          bool await_ready() const noexcept
+          {
+            return false;
+          }
+
+          void await_suspend(std::coroutine_handle<promise_type> const handle) const noexcept
+          {
+            sync_wait_state & state = *handle.promise().state;
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.finished = true;
+            state.finished_event.notify_one();
+          }
+
+          void await_resume() const noexcept
+          {
+          }
+        };
+
+        sync_wait_task get_return_object() noexcept
+        {
+          return sync_wait_task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() const noexcept
+        {
+          return std::suspend_always();
+        }
+
+        final_awaiter final_suspend() const noexcept
+        {
+          return final_awaiter();
+        }
+
+        void return_void() const noexcept
+        {
+        }
+
+        void unhandled_exception() noexcept
+        {
+          state->exception = std::current_exception();
+        }
+      };
+
+    private:
+      std::coroutine_handle<promise_type> m_handle;
+
+    public:
+      explicit sync_wait_task(std::coroutine_handle<promise_type> const handle) noexcept
+        : m_handle(handle)
+      {
+      }
+
+      sync_wait_task(sync_wait_task const &) = delete;
+      sync_wait_task & operator=(sync_wait_task const &) = delete;
+
+      ~sync_wait_task()
+      {
+        m_handle.destroy();
+      }
+
+      /*! Runs the coroutine and blocks until it finished.
+      */
+      void run(sync_wait_state & state)
+      {
+        m_handle.promise().state = &state;
+        m_handle.resume();
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.finished_event.wait(lock, [&state] { return state.finished; });
+        if(state.exception)
+        {
+          std::rethrow_exception(state.exception);
+        }
+      }
+    };
+
+    template <typename T>
+    sync_wait_task sync_wait_body(task<T> & awaited, std::optional<T> & result)
+    {
+      result.emplace(co_await awaited);
+    }
+
+    inline sync_wait_task sync_wait_body(task<void> & awaited)
+    {
+      co_await awaited;
+    }
+  } // namespace detail
+
+
+
+  /*! Runs a task and blocks the calling thread until it finished.
+  * Meant for the edges of a program, e.g. main. Must not be called on a pool
+  * worker whose pool the task needs, because the worker would wait for itself.
+  * \return The result of the task, exceptions of the task are rethrown.
+  */
+  template <typename T>
+  T sync_wait(task<T> awaited)
+  {
+    std::optional<T> result;
+    detail::sync_wait_state state;
+    detail::sync_wait_body(awaited, result).run(state);
+    return std::move(*result);
+  }
+
+  inline void sync_wait(task<void> awaited)
+  {
+    detail::sync_wait_state state;
+    detail::sync_wait_body(awaited).run(state);
+  }
+
+
+} } // namespace boost::threadpool
+
+#endif // THREADPOOL_COROUTINE_HPP_INCLUDED
@@ -0,0 +1,159 @@
+/*! \file
+* \brief Hardware performance counters.
+*
+* Reads cycle, instruction and last level cache miss counters of the
+* calling thread. The counters are available on Linux through
+* perf_event_open, other platforms report them as unavailable.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_DETAIL_HARDWARE_COUNTERS_HPP_INCLUDED
+#define THREADPOOL_DETAIL_HARDWARE_COUNTERS_HPP_INCLUDED
+
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#if defined(__linux__)
+#  include <cstring>
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+
+
+namespace boost { namespace threadpool { namespace detail
+{
+
+  /*! \brief Counter values at one point in time.
+  */
+  struct hardware_sample
+  {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t llc_misses;
+
+    hardware_sample()
+      : cycles(0)
+      , instructions(0)
+      , llc_misses(0)
+    {
+    }
+  };
+
+
+
+  /*! \brief Counter group of the thread which created it.
+  *
+  * The counters only count while the owning thread runs, so a difference
+  * of two samples is the cost of the code executed in between.
+  * An object must only be used by the thread which constructed it.
+  */
+  class hardware_counters
+    : private noncopyable
+  {
+#if defined(__linux__)
+    int m_fd[3];
+
+    static int open_counter(uint64_t const config, int const group_fd)
+    {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = config;
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.disabled = group_fd == -1 ? 1 : 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+    }
+
+  public:
+    hardware_counters()
+    {
+      m_fd[0] = open_counter(PERF_COUNT_HW_CPU_CYCLES, -1);
+      m_fd[1] = m_fd[0] != -1 ? open_counter(PERF_COUNT_HW_INSTRUCTIONS, m_fd[0]) : -1;
+      m_fd[2] = m_fd[1] != -1 ? open_counter(PERF_COUNT_HW_CACHE_MISSES, m_fd[0]) : -1;
+      if(m_fd[2] == -1)
+      {
+        close_all();
+        return;
+      }
+      ioctl(m_fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(m_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    ~hardware_counters()
+    {
+      close_all();
+    }
+
+    /*! Checks if the counters could be opened. Opening fails if the kernel forbids it (perf_event_paranoid) or lacks a PMU.
+    */
+    bool available() const
+    {
+      return m_fd[0] != -1;
+    }
+
+    /*! Reads all counters with one system call.
+    * \return false if the counters are unavailable.
+    */
+    bool read(hardware_sample & sample) const
+    {
+      if(!available())
+      {
+        return false;
+      }
+      uint64_t values[4];   // number of counters followed by their values
+      if(::read(m_fd[0], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values)))
+      {
+        return false;
+      }
+      sample.cycles = values[1];
+      sample.instructions = values[2];
+      sample.llc_misses = values[3];
+      return true;
+    }
+
+  private:
+    void close_all()
+    {
+      for(int i = 2; i >= 0; --i)
+      {
+        if(m_fd[i] != -1)
+        {
+          close(m_fd[i]);
+          m_fd[i] = -1;
+        }
+      }
+    }
+#else
+  public:
+    bool available() const
+    {
+      return false;
+    }
+
+    bool read(hardware_sample &) const
+    {
+      return false;
+    }
+#endif
+  };
+
+
+} } } // namespace boost::threadpool::detail
+
+#endif // THREADPOOL_DETAIL_HARDWARE_COUNTERS_HPP_INCLUDED
+
@@ -0,0 +1,264 @@
+/*! \file
+* \brief Lock contention profiling.
+*
+* The pool's internal mutexes are declared as profiled_mutex. In a build
+* with BOOST_THREADPOOL_LOCK_PROFILING defined, a profiled_mutex counts
+* acquisitions, contended acquisitions, wait time and hold time for each
+* call site. Otherwise it is the plain mutex and the call site arguments
+* compile away.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_DETAIL_LOCK_PROFILER_HPP_INCLUDED
+#define THREADPOOL_DETAIL_LOCK_PROFILER_HPP_INCLUDED
+
+
+#include <boost/threadpool/pool_stats.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <vector>
+
+
+
+namespace boost { namespace threadpool { namespace detail
+{
+
+  /*! \brief Places in the pool which acquire its mutexes.
+  */
+  enum lock_site
+  {
+    lock_site_schedule,     //!< pool_core::schedule and add_task.
+    lock_site_fetch_task,   //!< The worker loop and fetch_task.
+    lock_site_counters,     //!< Transitions of the worker counters.
+    lock_site_resize,       //!< resize, terminate and workers entering the pool.
+    lock_site_query,        //!< Counters, statistics and waiting functions.
+    lock_site_other,        //!< Everything else, including relocking after a condition wait without site.
+    lock_site_count
+  };
+
+  inline char const * lock_site_name(lock_site const site)
+  {
+    static char const * const names[lock_site_count] =
+    {
+      "schedule", "fetch_task", "counters", "resize", "query", "other"
+    };
+    return names[site];
+  }
+
+
+
+#if defined(BOOST_THREADPOOL_LOCK_PROFILING)
+
+  /*! \brief Mutex which records its contention per call site.
+  *
+  * The counters are updated while the mutex is held, so they need no
+  * further synchronisation. Recursive acquisitions are attributed to the
+  * outermost one.
+  *
+  * \param Mutex The underlying mutex type, either mutex or recursive_mutex.
+  */
+  template <typename Mutex>
+  class profiled_mutex
+    : private noncopyable
+  {
+    typedef chrono::steady_clock clock_type;
+
+    struct site_counters
+    {
+      uint64_t acquisitions;
+      uint64_t contended;
+      int64_t wait_ns;
+      int64_t hold_ns;
+    };
+
+    Mutex m_mutex;
+    site_counters m_sites[lock_site_count];
+    int m_depth;
+    lock_site m_owner_site;
+    clock_type::time_point m_acquired_at;
+
+  public:
+    /*! \brief Lock guard which tells the mutex where it is acquired.
+    */
+    class scoped_lock
+      : private noncopyable
+    {
+      profiled_mutex & m_mutex;
+      lock_site const m_site;
+      bool m_owns;
+
+    public:
+      explicit scoped_lock(profiled_mutex & m, lock_site const site = lock_site_other)
+        : m_mutex(m)
+        , m_site(site)
+        , m_owns(false)
+      {
+        lock();
+      }
+
+      ~scoped_lock()
+      {
+        if(m_owns)
+        {
+          m_mutex.unlock();
+        }
+      }
+
+      void lock()
+      {
+        m_mutex.lock(m_site);
+        m_owns = true;
+      }
+
+      void unlock()
+      {
+        m_owns = false;
+        m_mutex.unlock();
+      }
+
+      bool owns_lock() const
+      {
+        return m_owns;
+      }
+    };
+
+  public:
+    profiled_mutex()
+      : m_depth(0)
+      , m_owner_site(lock_site_other)
+    {
+      for(int i = 0; i < lock_site_count; ++i)
+      {
+        m_sites[i].acquisitions = 0;
+        m_sites[i].contended = 0;
+        m_sites[i].wait_ns = 0;
+        m_sites[i].hold_ns = 0;
+      }
+    }
+
+    void lock(lock_site const site)
+    {
+      bool contended = false;
+      int64_t wait_ns = 0;
+      if(!m_mutex.try_lock())
+      {
+        clock_type::time_point const wait_begin = clock_type::now();
+        m_mutex.lock();
+        wait_ns = chrono::duration_cast<chrono::nanoseconds>(clock_type::now() - wait_begin).count();
+        contended = true;
+      }
+
+      if(m_depth++ == 0)
+      {
+        site_counters & s = m_sites[site];
+        s.acquisitions++;
+        if(contended)
+        {
+          s.contended++;
+          s.wait_ns += wait_ns;
+        }
+        m_owner_site = site;
+        m_acquired_at = clock_type::now();
+      }
+    }
+
+    void lock()
+    {
+      lock(lock_site_other);
+    }
+
+    bool try_lock()
+    {
+      if(!m_mutex.try_lock())
+      {
+        return false;
+      }
+      if(m_depth++ == 0)
+      {
+        m_sites[lock_site_other].acquisitions++;
+        m_owner_site = lock_site_other;
+        m_acquired_at = clock_type::now();
+      }
+      return true;
+    }
+
+    void unlock()
+    {
+      if(--m_depth == 0)
+      {
+        m_sites[m_owner_site].hold_ns += chrono::duration_cast<chrono::nanoseconds>(clock_type::now() - m_acquired_at).count();
+      }
+      m_mutex.unlock();
+    }
+
+    /*! Appends the counters of all sites which acquired the mutex.
+    * \param name The mutex's name in the report.
+    * \param out Receives one entry per site.
+    */
+    void profile(char const * const name, std::vector<lock_stats> & out)
+    {
+      unique_lock<Mutex> lock(m_mutex);
+      for(int i = 0; i < lock_site_count; ++i)
+      {
+        site_counters const & s = m_sites[i];
+        if(s.acquisitions == 0)
+        {
+          continue;
+        }
+        lock_stats l;
+        l.mutex_name = name;
+        l.site_name = lock_site_name(static_cast<lock_site>(i));
+        l.acquisitions = s.acquisitions;
+        l.contended = s.contended;
+        l.wait_time = chrono::nanoseconds(s.wait_ns);
+        l.hold_time = chrono::nanoseconds(s.hold_ns);
+        out.push_back(l);
+      }
+    }
+  };
+
+#else // BOOST_THREADPOOL_LOCK_PROFILING
+
+  /*! \brief Mutex which ignores the call sites.
+  *
+  * Profiling is disabled, the type behaves exactly like Mutex.
+  */
+  template <typename Mutex>
+  class profiled_mutex
+    : public Mutex
+  {
+  public:
+    class scoped_lock
+      : public unique_lock<Mutex>
+    {
+    public:
+      explicit scoped_lock(profiled_mutex & m, lock_site const = lock_site_other)
+        : unique_lock<Mutex>(m)
+      {
+      }
+    };
+
+    void profile(char const * const, std::vector<lock_stats> &)
+    {
+    }
+  };
+
+#endif // BOOST_THREADPOOL_LOCK_PROFILING
+
+
+} } } // namespace boost::threadpool::detail
+
+#endif // THREADPOOL_DETAIL_LOCK_PROFILER_HPP_INCLUDED
+
@@ -22,7 +22,17 @@
 #ifndef THREADPOOL_POOL_CORE_HPP_INCLUDED
 #define THREADPOOL_POOL_CORE_HPP_INCLUDED
 #include <boost/threadpool/pool.hpp>
+#include <boost/threadpool/blocking_region.hpp>
 #include <boost/threadpool/detail/worker_thread.hpp>
+#include <boost/threadpool/detail/worker_context.hpp>
+#include <boost/threadpool/detail/trace.hpp>
+#include <boost/threadpool/detail/queued_task.hpp>
+#include <boost/threadpool/detail/hardware_counters.hpp>
+#include <boost/threadpool/detail/lock_profiler.hpp>
+#include <boost/threadpool/detail/shm_metrics.hpp>
+#include <boost/threadpool/detail/workload_record.hpp>
+#include <boost/threadpool/pool_stats.hpp>
+#include <boost/threadpool/task_handle.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/exceptions.hpp>
 #include <boost/thread/mutex.hpp>
@@ -32,9 +42,16 @@
 #include <boost/static_assert.hpp>
 #include <boost/type_traits.hpp>
 #include <boost/utility/result_of.hpp>
+#include <boost/chrono/thread_clock.hpp>
 //#include <boost/thread/reverse_lock.hpp>
 
 #include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <limits>
+#include <cstdio>
+#include <ostream>
 
 
 
@@ -69,9 +86,9 @@ namespace boost { namespace threadpool { namespace detail
 		, private noncopyable
 	{
 		typedef recursive_mutex	pool_mutex;
-		typedef recursive_mutex	worker_counting_mutex;
-		typedef mutex			event_mutex;
-		typedef recursive_mutex	task_queue_mutex;
+		typedef profiled_mutex<recursive_mutex>	worker_counting_mutex;
+		typedef profiled_mutex<mutex>			event_mutex;
+		typedef profiled_mutex<recursive_mutex>	task_queue_mutex;
 		typedef mutex			resize_mutex;
 	public: // Type definitions
 		typedef Task task_type;                                 //!< Indicates the task's type.
@@ -80,7 +97,9 @@ namespace boost { namespace threadpool { namespace detail
 
 		typedef shared_ptr<pool_type> ptr_type;					//!< Indicates the pool's ptr type
 
-		typedef QueuePolicy<task_type> queue_policy_type;     //!< Indicates the queue policy's type.
+		typedef queued_task<task_type> queued_task_type;		//!< Indicates the type of the queue entries.
+
+		typedef QueuePolicy<queued_task_type> queue_policy_type;     //!< Indicates the queue policy's type.
 		
 		typedef worker_thread<pool_type> worker_type;
 			
@@ -91,80 +110,1490 @@ namespace boost { namespace threadpool { namespace detail
 		BOOST_STATIC_ASSERT(is_void<typename result_of<task_type()>::type>::value);
 
 
-	private:  // Friends 
-		friend class worker_thread<pool_type>;
+	private:  // Friends 
+		friend class worker_thread<pool_type>;
+
+	private:
+		//! queues a worker takes tasks from
+		enum fetch_source
+		{
+			fetch_reserved = 1,		// tasks of the reserved class
+			fetch_shared = 2,		// the queue policy object
+			fetch_affine = 4,		// the worker's affinity queue, then those of busy workers
+			fetch_sharded = 8,		// the submission shards in round robin order
+			fetch_any = fetch_reserved | fetch_shared | fetch_affine | fetch_sharded
+		};
+
+		//! queue of the tasks routed to one worker by schedule_affine
+		struct affinity_queue
+		{
+			worker_context * owner;
+			shared_ptr<queue_policy_type> tasks;
+			bool running;		// the owner took a task and did not fetch again yet
+		};
+		typedef std::map<int, affinity_queue> affinity_queue_map;
+
+		//! submission queue filled by producers without the pool's locks, see set_submission_shards
+		struct submission_shard
+		{
+			mutex guard;
+			queue_policy_type tasks;
+			atomic<int> size;		// read without guard to pick the shorter of two shards
+			char padding[64];		// keeps neighbouring shards off each other's cache line
+
+			submission_shard()
+				: size(0)
+			{
+			}
+		};
+
+		//! task a worker runs after its current one, filled by schedule calls of the current task
+		struct run_next_slot
+		{
+			pool_core * owner;
+			int worker;				// id of the owning worker
+			mutex guard;			// taken by the owner's schedule calls and by the workers which steal the task
+			queued_task_type task;
+			bool occupied;
+			int64_t since;			// clock ticks when the task was put into the slot
+			int streak;				// tasks the worker took from the slot in a row
+		};
+
+		//! hooks of a worker's blocking regions
+		struct blocking_target
+			: detail::blocking_hooks
+		{
+			pool_core * pool;
+			worker_context * context;
+		};
+
+		//! shard selection state of a producer thread
+		struct producer_state
+		{
+			std::size_t home;		// the shard the thread used last
+			uint64_t random;
+		};
+
+	private:	
+		mutable worker_counting_mutex	worker_counting_mutex_;			//protects follow counters
+		mutable condition_variable_any worker_counting_event_;			//signals when follow counters changed
+
+		int target_worker_count_;			// target worker count
+		int fetching_workers_count_;			// count workers in fetching state
+		int processing_workers_count_;		// count workers in processing state
+		resize_mutex resize_mutex_;	//! make sure one resize call each time
+
+	private: 
+		mutable task_queue_mutex task_queue_mutex_;		//protects task_queue
+		queue_policy_type  task_queue_;			//task queue policy object
+		condition_variable task_queue_changed_event_;
+
+	private:
+
+		//!
+		mutable event_mutex worker_mutex_;
+		mutable condition_variable worker_state_changed_event_;
+		condition_variable_any worker_enter_event_;			
+		condition_variable_any worker_exit_on_request_event_;
+		condition_variable_any worker_exit_on_exception_event_;
+		condition_variable_any queue_space_event_;		// signals producers blocked on a full queue
+
+	private: // protected by worker_mutex_
+		int next_worker_id_;							// id of the next worker entering the pool
+		atomic<int> parked_workers_count_;				// count workers waiting on their wake_event, read without the lock by sharded submission
+		std::vector<worker_context*> waiting_workers_;	// parked workers which were not woken yet, the last parked at the back
+		std::deque<worker_context::clock_type::time_point> pending_notifies_;	// time of notifications which did not wake a worker yet
+		std::vector<worker_context*> workers_;			// contexts of the attached workers
+		worker_stats retired_stats_;					// counters of the workers which left the pool
+
+	private: // tracing mode, protected by worker_mutex_
+		bool tracing_;									// record events
+		int trace_generation_;							// incremented by each enable_tracing call
+		std::size_t trace_capacity_;					// events per buffer
+		uint64_t trace_origin_ticks_;					// trace_clock when tracing was enabled
+		int64_t trace_origin_ns_;						// steady clock when tracing was enabled
+		shared_ptr<trace_buffer> client_trace_;			// events of threads which are not workers, 0 while not tracing, read with atomic_load by producers which bypass the lock
+		std::vector<shared_ptr<trace_buffer> > trace_buffers_;	// buffers of the current tracing session
+
+	private: // per-tag accounting, protected by worker_mutex_
+		bool hardware_counters_;						// read hardware counters around tagged tasks
+		worker_context::tag_stats_map retired_tags_;	// per-tag counters of the workers which left the pool
+
+	private: // metrics export, protected by worker_mutex_
+		shared_ptr<shm_metrics_segment> metrics_;		// shared memory object, 0 if not exporting, read with atomic_load by producers which bypass the lock
+
+	private: // queue capacity, protected by worker_mutex_
+		int max_pending_tasks_;							// 0 for unlimited
+		std::size_t max_pending_bytes_;					// 0 for unlimited
+		overflow_policy overflow_policy_;				// applied when a task does not fit
+		int blocked_producers_;							// producers waiting on queue_space_event_
+		uint64_t scheduled_count_;						// tasks added to the queue
+		uint64_t rejected_count_;						// tasks turned away
+		uint64_t dropped_count_;						// queued tasks removed by overflow_drop_next
+		std::size_t pending_bytes_;						// bytes of the queued tasks, protected by task_queue_mutex_
+
+	private: // admission control, protected by worker_mutex_
+		int64_t mean_service_ns_;						// moving average of the task run time, 0 until a task finished
+		uint64_t shed_count_;							// tasks rejected because of their latency budget
+		uint64_t expired_count_;						// tasks dropped at dequeue, protected by task_queue_mutex_
+
+	private: // reserved workers, protected by worker_mutex_
+		task_tag reserved_tag_;							// class served by the reserved workers
+		int reserved_target_;							// number of workers to reserve
+		bool reserved_exclusive_;						// reserved workers take no other tasks
+		int reserved_active_;							// workers whose context is marked reserved
+		int parked_exclusive_;							// parked workers which only take reserved tasks
+		std::deque<queued_task_type> reserved_queue_;	// tasks of the reserved class, protected by task_queue_mutex_
+		atomic<bool> reserving_;						// a class has reserved workers, read without the lock by schedule
+
+	private: // affinity routing, protected by worker_mutex_
+		int affinity_limit_;							// tasks queued for a worker above which affine tasks go to the shared queue
+		uint64_t affine_count_;							// tasks routed to a worker's queue
+		affinity_queue_map affinity_queues_;			// by worker id, protected by task_queue_mutex_
+		int affine_pending_;							// tasks in affinity_queues_, protected by task_queue_mutex_
+		uint64_t stolen_count_;							// affine tasks run by another worker, protected by task_queue_mutex_
+
+	private: // sharded submission
+		scoped_array<submission_shard> shards_;			// set once, see set_submission_shards
+		std::size_t shard_count_;
+		std::size_t shard_cursor_;						// shard a worker drains next, protected by task_queue_mutex_
+		atomic<bool> sharded_submission_;				// schedule adds to the shards, updated with worker_mutex_ held
+		atomic<bool> submission_observed_;				// tracing or metrics export is active, updated with worker_mutex_ held
+		atomic<int> sharded_pending_;					// tasks in the shards
+		atomic<std::size_t> sharded_bytes_;				// bytes of the tasks in the shards
+		atomic<uint64_t> sharded_count_;				// tasks added to the shards
+
+	private: // run-next slots of the workers
+		int run_next_limit_;							// tasks a worker takes from its slot in a row, 0 disables the slots, protected by worker_mutex_
+		atomic<bool> run_next_active_;					// schedule fills the slots, updated with worker_mutex_ held
+		atomic<int> run_next_pending_;					// tasks in the slots
+		atomic<uint64_t> run_next_count_;				// tasks added to the slots
+		int64_t run_next_steal_ns_;						// time a task waits in a slot before parked workers take it, protected by worker_mutex_
+		atomic<int> run_next_watchers_;					// parked workers waiting for slot tasks to age, at most one, changed with worker_mutex_ held
+		atomic<bool> run_next_watch_requested_;			// a parked worker was woken to watch the slots, changed with worker_mutex_ held
+		std::vector<run_next_slot*> run_next_slots_;	// slots of the attached workers, protected by worker_mutex_
+
+	private: // compensating workers, protected by worker_mutex_
+		int max_compensating_;							// workers added for blocked ones at most, 0 disables compensation
+		int64_t stuck_after_ns_;						// run time after which a task counts as blocked, 0 disables the detection
+		atomic<int64_t> next_stuck_scan_;				// clock ticks of the next detection, read without the lock by sharded submission
+		int blocked_workers_;							// workers whose context is marked blocked
+		atomic<int> compensating_;						// workers added to the target worker count for blocked ones, read without the lock by sharded submission
+		uint64_t compensations_count_;					// workers added since the pool was created
+		int retiring_;									// workers leaving for the end of a blocking region, they stay as spare workers
+		int spare_workers_;								// workers kept parked for the next compensation, not counted as fetching
+		int reactivated_;								// spare workers told to fetch tasks again
+		condition_variable_any spare_worker_event_;		// signals spare workers when reactivated_ grows
+
+	private: // recording mode, protected by worker_mutex_
+		shared_ptr<workload_writer> recorder_;			// workload file, 0 if not recording
+	public:
+		/// Constructor.
+		pool_core()
+			: target_worker_count_(0)
+			, fetching_workers_count_(0)
+			, processing_workers_count_(0)			
+			, next_worker_id_(0)
+			, parked_workers_count_(0)
+			, tracing_(false)
+			, trace_generation_(0)
+			, trace_capacity_(0)
+			, trace_origin_ticks_(0)
+			, trace_origin_ns_(0)
+			, hardware_counters_(false)
+			, max_pending_tasks_(0)
+			, max_pending_bytes_(0)
+			, overflow_policy_(overflow_reject)
+			, blocked_producers_(0)
+			, scheduled_count_(0)
+			, rejected_count_(0)
+			, dropped_count_(0)
+			, pending_bytes_(0)
+			, mean_service_ns_(0)
+			, shed_count_(0)
+			, expired_count_(0)
+			, reserved_target_(0)
+			, reserved_exclusive_(true)
+			, reserved_active_(0)
+			, parked_exclusive_(0)
+			, reserving_(false)
+			, affinity_limit_(8)
+			, affine_count_(0)
+			, affine_pending_(0)
+			, stolen_count_(0)
+			, shard_count_(0)
+			, shard_cursor_(0)
+			, sharded_submission_(false)
+			, submission_observed_(false)
+			, sharded_pending_(0)
+			, sharded_bytes_(0)
+			, sharded_count_(0)
+			, run_next_limit_(0)
+			, run_next_active_(false)
+			, run_next_pending_(0)
+			, run_next_count_(0)
+			, run_next_steal_ns_(1000000)
+			, run_next_watchers_(0)
+			, run_next_watch_requested_(false)
+			, max_compensating_(0)
+			, stuck_after_ns_(0)
+			, next_stuck_scan_((std::numeric_limits<int64_t>::max)())
+			, blocked_workers_(0)
+			, compensating_(0)
+			, compensations_count_(0)
+			, retiring_(0)
+			, spare_workers_(0)
+			, reactivated_(0)
+		{
+			//pool_type volatile & self_ref = *this;
+			//m_size_policy.reset(new size_policy_type());
+			
+			task_queue_.clear();
+		}
+
+
+		/// Destructor.
+		~pool_core()
+		{
+			clear_pending_tasks();
+			//terminate();	//ã˵workeruserٱpool_coreshared_ptr
+		}
+		
+		//! \brief add a task to the queue and wake a worker
+		//! Blocks while the queue is full, see set_queue_limits.
+		//! \param tag the CPU time and hardware counters of the task are charged to this tag, unless it is empty
+		//! \param bytes estimated memory held by the task, charged to the queue's byte capacity
+		void schedule(task_type const & task, task_tag const & tag = task_tag(), std::size_t bytes = 0)
+		{
+			worker_context::clock_type::time_point const now = worker_context::clock_type::now();
+			queued_task_type entry(task, tag, worker_context::ticks(now), sizeof(queued_task_type) + bytes);
+			run_next_slot * const slot = current_run_next_slot();
+			if(slot != 0 && slot->owner == this && run_next_active_.load(memory_order_relaxed) && !maybe_reserved(entry))
+			{
+				bool filled;
+				{
+					mutex::scoped_lock lock(slot->guard);
+					filled = !slot->occupied;
+					slot->since = entry.enqueued;
+					if(filled)
+					{
+						slot->task = entry;
+						slot->occupied = true;
+						run_next_pending_.fetch_add(1);
+					}
+					else
+					{
+						// the newer task runs next, the older one is queued and counted there
+						std::swap(entry, slot->task);
+					}
+				}
+				if(filled)
+				{
+					// the slot's task is taken by this thread after its task or by a thief after the steal delay
+					observe_submission(run_next_pending_.load(memory_order_relaxed));
+					run_next_count_.fetch_add(1, memory_order_relaxed);
+					wake_run_next_watcher();
+					return;
+				}
+			}
+			schedule_queued(entry, now);
+		}
+
+		//! \brief add a task to the queues like schedule, but never to the calling worker's run-next slot
+		//! For a task which gives way to the others, like a yielding fiber or a strand after a batch:
+		//! from the slot it would run next on the same worker.
+		void reschedule(task_type const & task, task_tag const & tag = task_tag(), std::size_t bytes = 0)
+		{
+			worker_context::clock_type::time_point const now = worker_context::clock_type::now();
+			schedule_queued(queued_task_type(task, tag, worker_context::ticks(now), sizeof(queued_task_type) + bytes), now);
+		}
+
+		//! \brief add count copies of a task with one queue operation and wake as many workers
+		//! Blocks while the queue is full. The limits are checked once for the whole batch, which may exceed them.
+		void schedule_bulk(task_type const & task, std::size_t const count, task_tag const & tag = task_tag(), std::size_t bytes = 0)
+		{
+			if(count == 0)
+			{
+				return;
+			}
+			worker_context::clock_type::time_point const now = worker_context::clock_type::now();
+			queued_task_type const entry(task, tag, worker_context::ticks(now), sizeof(queued_task_type) + bytes);
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_schedule);
+			while(queue_full(entry.bytes))
+			{
+				wait_for_queue_space(lock);
+			}
+			task_added(now, add_task(entry, count), count);
+		}
+
+		//! \brief add a task which should run on the same worker as the other tasks with the same key
+		//! The key selects a worker, whose own queue keeps the task. The worker takes it before shared tasks,
+		//! other workers take it only while it is busy. If its queue holds the affinity limit, the task goes to
+		//! the shared queue. The worker of a key changes when the number of workers changes.
+		//! Blocks while the queue is full, like schedule.
+		void schedule_affine(task_type const & task, std::size_t const key, task_tag const & tag = task_tag(), std::size_t bytes = 0)
+		{
+			worker_context::clock_type::time_point const now = worker_context::clock_type::now();
+			queued_task_type const entry(task, tag, worker_context::ticks(now), sizeof(queued_task_type) + bytes);
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_schedule);
+			while(queue_full(entry.bytes))
+			{
+				wait_for_queue_space(lock);
+			}
+			worker_context * const target = affinity_target(key, entry.tag);
+			if(target == 0 || !add_affine_task(entry, *target))
+			{
+				enqueue(entry, now);
+				return;
+			}
+			affine_count_++;
+			// while the target is parked it is the only worker to take the task
+			task_added(now, false, 1, target->parked_since.load(memory_order_relaxed) != 0 ? target : 0);
+		}
+
+		//! \brief set the number of tasks queued for one worker above which affine tasks go to the shared queue
+		void set_affinity_limit(int const limit)
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			affinity_limit_ = limit;
+		}
+
+		//! \brief add a task and get a handle which can change its priority or remove it while it is queued
+		//! Only available with schedulers which issue tickets, like indexed_prio_scheduler.
+		//! Blocks while the queue is full, like schedule.
+		task_handle<pool_type> schedule_with_handle(task_type const & task, task_tag const & tag = task_tag(), std::size_t bytes = 0)
+		{
+			worker_context::clock_type::time_point const now = worker_context::clock_type::now();
+			queued_task_type const entry(task, tag, worker_context::ticks(now), sizeof(queued_task_type) + bytes);
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_schedule);
+			while(queue_full(entry.bytes))
+			{
+				wait_for_queue_space(lock);
+			}
+			typename task_handle<pool_type>::ticket_type ticket;
+			{
+				task_queue_mutex::scoped_lock queue_lock(task_queue_mutex_, lock_site_schedule);
+				ticket = task_queue_.push_ticket(entry);
+				pending_bytes_ += entry.bytes;
+				task_queue_changed_event_.notify_all();
+			}
+			task_added(now, false);
+			return task_handle<pool_type>(this->shared_from_this(), ticket);
+		}
+
+		//! \brief check if the task of a ticket is queued, see task_handle
+		template <typename Ticket>
+		bool task_pending(Ticket const & ticket) const
+		{
+			task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_query);
+			return task_queue_.contains(ticket);
+		}
+
+		//! \brief change the priority of a queued task, see task_handle
+		template <typename Ticket>
+		bool reprioritize_task(Ticket const & ticket, unsigned int const priority)
+		{
+			task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_other);
+			return task_queue_.reprioritize(ticket, priority);
+		}
+
+		//! \brief remove a queued task without executing it, see task_handle
+		template <typename Ticket>
+		bool remove_task(Ticket const & ticket)
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			queued_task_type removed;
+			{
+				task_queue_mutex::scoped_lock queue_lock(task_queue_mutex_, lock_site_other);
+				if(!task_queue_.remove(ticket, removed))
+				{
+					return false;
+				}
+				pending_bytes_ -= removed.bytes;
+				task_queue_changed_event_.notify_all();
+			}
+			if(blocked_producers_ > 0)
+			{
+				queue_space_event_.notify_all();
+			}
+			return true;
+		}
+
+		//! \brief add a task if the queue has room for it
+		//! Never blocks. If the queue is full the overflow policy either rejects the task or drops queued ones.
+		//! \return false if the task was rejected
+		bool try_schedule(task_type const & task, task_tag const & tag = task_tag(), std::size_t bytes = 0)
+		{
+			worker_context::clock_type::time_point const now = worker_context::clock_type::now();
+			queued_task_type const entry(task, tag, worker_context::ticks(now), sizeof(queued_task_type) + bytes);
+			if(schedule_sharded(entry, now))
+			{
+				return true;
+			}
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_schedule);
+			if(queue_full(entry.bytes) && !make_room(entry.bytes))
+			{
+				return false;
+			}
+			enqueue(entry, now);
+			return true;
+		}
+
+		//! \brief add a task, waiting at most timeout for room in the queue
+		//! When the timeout expires the overflow policy either rejects the task or drops queued ones.
+		//! \return false if the task was rejected
+		bool schedule_for(task_type const & task, chrono::nanoseconds const & timeout, task_tag const & tag = task_tag(), std::size_t bytes = 0)
+		{
+			worker_context::clock_type::time_point const now = worker_context::clock_type::now();
+			worker_context::clock_type::time_point const deadline = now + timeout;
+			queued_task_type const entry(task, tag, worker_context::ticks(now), sizeof(queued_task_type) + bytes);
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_schedule);
+			while(queue_full(entry.bytes))
+			{
+				if(!wait_for_queue_space(lock, &deadline))
+				{
+					if(queue_full(entry.bytes) && !make_room(entry.bytes))
+					{
+						return false;
+					}
+					break;
+				}
+			}
+			enqueue(entry, worker_context::clock_type::now());
+			return true;
+		}
+
+		//! \brief add a task only if it is predicted to start within its latency budget
+		//! The queue wait is predicted from the queue depth, the number of workers and the measured
+		//! service time. If the task is admitted but does not start within the budget, it is dropped
+		//! when a worker dequeues it. Never blocks, a full queue is handled like in try_schedule.
+		//! \return false if the task was shed or rejected
+		bool try_schedule_within(task_type const & task, chrono::nanoseconds const & budget, task_tag const & tag = task_tag(), std::size_t bytes = 0)
+		{
+			worker_context::clock_type::time_point const now = worker_context::clock_type::now();
+			queued_task_type entry(task, tag, worker_context::ticks(now), sizeof(queued_task_type) + bytes);
+			entry.deadline = entry.enqueued + budget.count();
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_schedule);
+			if(predicted_queue_wait_ns() > budget.count())
+			{
+				shed_count_++;
+				return false;
+			}
+			if(queue_full(entry.bytes) && !make_room(entry.bytes))
+			{
+				return false;
+			}
+			enqueue(entry, now);
+			return true;
+		}
+
+		//! \brief estimate how long a task scheduled now waits before it starts
+		chrono::nanoseconds predicted_queue_wait() const
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_query);
+			return chrono::nanoseconds(predicted_queue_wait_ns());
+		}
+
+		//! \brief limit the task queue
+		//! A task which does not fit blocks schedule and is subject to the overflow policy in try_schedule
+		//! and schedule_for. A task is always accepted by an empty queue.
+		//! \param max_tasks maximum number of queued tasks, 0 for unlimited
+		//! \param max_bytes maximum estimated bytes of the queued tasks, 0 for unlimited
+		//! \return false if the pool has submission shards, which bypass the limits, and a limit was given
+		bool set_queue_limits(int max_tasks, std::size_t max_bytes)
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			if(shard_count_ != 0 && (max_tasks != 0 || max_bytes != 0))
+			{
+				return false;
+			}
+			max_pending_tasks_ = max_tasks;
+			max_pending_bytes_ = max_bytes;
+			queue_space_event_.notify_all();
+			return true;
+		}
+
+		//! \brief choose what happens to a task which does not fit into the queue
+		void set_overflow_policy(overflow_policy policy)
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			overflow_policy_ = policy;
+		}
+
+		//! \brief dedicate workers to a latency-critical task class
+		//! Tasks tagged with tag are kept in a FIFO queue of their own. Any worker takes them before other
+		//! tasks, and count workers take only them, so they never wait behind long tasks of other classes.
+		//! \param exclusive if false the reserved workers also run other tasks while the class has none queued
+		//! \remarks Reserved workers are picked among the workers looking for a task. With exclusive reservation
+		//! at least one more worker than count is needed to run the other tasks.
+		void reserve_workers(task_tag const & tag, int count, bool exclusive = true)
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			reserved_tag_ = tag;
+			reserved_target_ = tag.empty() ? 0 : count;
+			reserved_exclusive_ = exclusive;
+			update_submission_path();
+			wake_all_workers();
+		}
+
+		//! \brief let a task's schedule calls hand the task to its own worker, which runs it next
+		//! A task scheduled by a task of the pool goes to the worker's run-next slot instead of a queue, so it
+		//! runs on the same core while the data it shares with its producer is still in cache, and no worker
+		//! is woken. If the slot is taken, the newer task takes it and the older one is queued. After limit
+		//! tasks from its slot in a row the worker queues the slot's task and takes one from the queues,
+		//! so a chain of tasks cannot monopolise it. A parked worker takes a slot's task which waited longer
+		//! than steal_after, so a follow-up does not wait for a long or waiting task of its producer. While
+		//! the slots are in use one parked worker checks them every steal_after. A worker queues its slot's
+		//! task right away when its task blocks in a blocking_region.
+		//! Only schedule uses the slots. While workers are reserved, tagged tasks go to the queues, see reserve_workers.
+		//! \param limit tasks a worker takes from its slot in a row, 0 disables the slots
+		//! \param steal_after time a task waits in a slot before other workers take it
+		void set_run_next_limit(int const limit, chrono::nanoseconds const & steal_after)
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			run_next_limit_ = limit;
+			run_next_steal_ns_ = steal_after.count();
+			update_submission_path();
+		}
+
+		//! \brief add workers while tasks block, so the blocked ones do not reduce the pool's parallelism
+		//! A task announces a blocking call with a blocking_region. For each worker in a region the pool adds
+		//! a worker, at most max_workers, and retires one when the region ends. While a parked worker can
+		//! take the blocked worker's share no worker is added. The retired worker stays parked as a spare
+		//! worker and is the first to be added again, so a region does not start a thread.
+		//! A worker which runs one task longer than stuck_after is treated like
+		//! a blocked one until the task returns. Stuck workers are detected when tasks are scheduled and when
+		//! workers finish tasks. resize and terminate end the compensation.
+		//! \param max_workers workers added at most, 0 disables compensation
+		//! \param stuck_after run time after which a task counts as blocked, 0 disables the detection
+		void set_compensation(int const max_workers, chrono::nanoseconds const & stuck_after)
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			max_compensating_ = max_workers;
+			stuck_after_ns_ = stuck_after.count();
+			next_stuck_scan_.store(stuck_after_ns_ == 0 ? (std::numeric_limits<int64_t>::max)() : 0, memory_order_relaxed);
+			if(spare_workers_ > max_workers)
+			{
+				// the reactivated workers exceed the target and leave
+				reactivate_spare_workers(spare_workers_ - (std::max)(0, max_workers));
+			}
+		}
+
+		//! \brief let producers add tasks to count submission queues instead of the shared queue
+		//! schedule and try_schedule then lock only one shard and take the pool's lock only to wake a parked
+		//! worker, run the stuck worker detection or add a worker owed for a blocked one, see set_compensation.
+		//! A producer keeps using the same shard and moves to the shorter of two random shards when
+		//! its shard is contended. Workers drain the shards in round robin order, so tasks of different
+		//! shards run in no particular order, and the queue policy orders the tasks within a shard only.
+		//! While workers are reserved, tagged tasks go to the shared queue, so those of the reserved class
+		//! reach their queue, see reserve_workers. The shards do not count against queue limits, so a pool
+		//! has either.
+		//! \return false if the pool has shards already, producers might be using them, or has queue limits
+		bool set_submission_shards(std::size_t const count)
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			if(shard_count_ != 0 || max_pending_tasks_ != 0 || max_pending_bytes_ != 0)
+			{
+				return false;
+			}
+			shards_.reset(new submission_shard[count]);
+			shard_count_ = count;
+			update_submission_path();
+			return true;
+		}
+
+		//! \brief call f with the queue policy object locked, e.g. to set scheduler options like bucket_prio_scheduler::set_aging
+		template <typename Function>
+		void configure_scheduler(Function f)
+		{
+			task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_other);
+			f(task_queue_);
+		}
+
+	private:
+		//! \brief add a task to a submission shard or the queue, blocks while the queue is full
+		void schedule_queued(queued_task_type const & entry, worker_context::clock_type::time_point const & now)
+		{
+			if(schedule_sharded(entry, now))
+			{
+				return;
+			}
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_schedule);
+			while(queue_full(entry.bytes))
+			{
+				wait_for_queue_space(lock);
+			}
+			enqueue(entry, now);
+		}
+
+		//! \brief add a task to the queue and wake a worker, called with worker_mutex_ held
+		void enqueue(queued_task_type const & entry, worker_context::clock_type::time_point const & now)
+		{
+			task_added(now, add_task(entry));
+		}
+
+		//! \brief count a task which was added to the queue and wake a worker, called with worker_mutex_ held
+		//! \param reserved the task is in the queue of the reserved class, which every worker takes
+		//! \param count number of tasks added at once
+		//! \param target the worker which takes the task, 0 if any worker may take it
+		void task_added(worker_context::clock_type::time_point const & now, bool const reserved, std::size_t const count = 1, worker_context * const target = 0)
+		{
+			scheduled_count_ += count;
+			detect_stuck_workers(worker_context::ticks(now));
+			for(std::size_t i = 0; i < count && parked_workers_count_ > static_cast<int>(pending_notifies_.size()); ++i)
+			{
+				pending_notifies_.push_back(now);
+			}
+			if(compensating_ > 0)
+			{
+				// the parked workers which took a blocked worker's share got tasks
+				add_compensating_worker();
+			}
+			if(tracing_)
+			{
+				client_trace_->record(trace_schedule, pending_tasks_count());
+			}
+			if(metrics_)
+			{
+				shm_metrics_header & h = metrics_->header();
+				h.scheduled.fetch_add(count, memory_order_relaxed);
+				h.pending.store(pending_tasks_count(), memory_order_relaxed);
+			}
+			if(target)
+			{
+				wake_worker(*target);
+			}
+			else if(count == 1 && (reserved || parked_exclusive_ == 0))
+			{
+				wake_one_worker();		
+			}
+			else
+			{
+				// a batch needs several workers, and the woken worker might be one which only takes reserved tasks
+				wake_all_workers();
+			}
+		}	
+
+		//! \brief wake the worker which parked last, its cache is the warmest, called with worker_mutex_ held
+		void wake_one_worker()
+		{
+			if(!waiting_workers_.empty())
+			{
+				waiting_workers_.back()->wake_event.notify_one();
+				waiting_workers_.pop_back();
+			}
+		}
+
+		//! \brief wake all parked workers, called with worker_mutex_ held
+		void wake_all_workers()
+		{
+			for(typename std::vector<worker_context*>::const_iterator it = waiting_workers_.begin(); it != waiting_workers_.end(); ++it)
+			{
+				(*it)->wake_event.notify_one();
+			}
+			waiting_workers_.clear();
+		}
+
+		//! \brief wake a worker if it is parked and was not woken yet, called with worker_mutex_ held
+		void wake_worker(worker_context & context)
+		{
+			typename std::vector<worker_context*>::iterator const it = std::find(waiting_workers_.begin(), waiting_workers_.end(), &context);
+			if(it != waiting_workers_.end())
+			{
+				context.wake_event.notify_one();
+				waiting_workers_.erase(it);
+			}
+		}
+
+		//! \brief remove a worker which returns from its wait from the parked workers, called with worker_mutex_ held
+		//! A worker which timed out or woke spuriously is still in the list.
+		void forget_waiting_worker(worker_context & context)
+		{
+			typename std::vector<worker_context*>::iterator const it = std::find(waiting_workers_.begin(), waiting_workers_.end(), &context);
+			if(it != waiting_workers_.end())
+			{
+				waiting_workers_.erase(it);
+			}
+		}
+
+		//! \brief update the worker's reservation and get the queues it takes tasks from, called with worker_mutex_ held
+		int fetch_sources(worker_context & context)
+		{
+			if(context.reserved && reserved_active_ > reserved_target_)
+			{
+				context.reserved = false;
+				--reserved_active_;
+			}
+			else if(!context.reserved && reserved_active_ < reserved_target_)
+			{
+				context.reserved = true;
+				++reserved_active_;
+			}
+			return context.reserved && reserved_exclusive_ ? fetch_reserved : fetch_any;
+		}
+
+		//! \brief get the per-class statistics of the shared, affinity and submission queues, called with task_queue_mutex_ held
+		void collect_queued_class_stats(std::vector<class_stats> & out) const
+		{
+			collect_class_stats(task_queue_, out);
+			std::vector<class_stats> part;
+			for(typename affinity_queue_map::const_iterator it = affinity_queues_.begin(); it != affinity_queues_.end(); ++it)
+			{
+				part.clear();
+				collect_class_stats(*it->second.tasks, part);
+				merge_class_stats(out, part);
+			}
+			for(std::size_t i = 0; i < shard_count_; ++i)
+			{
+				mutex::scoped_lock lock(shards_[i].guard);
+				part.clear();
+				collect_class_stats(shards_[i].tasks, part);
+				merge_class_stats(out, part);
+			}
+		}
+
+		//! \brief get the number of queued tasks, called with task_queue_mutex_ held
+		int queued_count() const
+		{
+			return task_queue_.size() + static_cast<int>(reserved_queue_.size()) + affine_pending_ + sharded_pending_.load(memory_order_relaxed)
+				+ run_next_pending_.load(memory_order_relaxed);
+		}
+
+		//! \brief publish the settings producers read without the pool's lock, called with worker_mutex_ held
+		void update_submission_path()
+		{
+			run_next_active_.store(run_next_limit_ > 0, memory_order_relaxed);
+			sharded_submission_.store(shard_count_ > 0, memory_order_release);
+			reserving_.store(!reserved_tag_.empty());
+			submission_observed_.store(tracing_ || metrics_);
+		}
+
+		//! \brief check if a task might belong to the reserved class, which only the locked path routes to its queue
+		bool maybe_reserved(queued_task_type const & entry) const
+		{
+			return !entry.tag.empty() && reserving_.load(memory_order_relaxed);
+		}
+
+		//! \brief trace and export a task which bypasses task_added, called before a worker can take the task
+		//! \param queued tasks in the shards or slots with the new one
+		void observe_submission(int const queued)
+		{
+			if(!submission_observed_.load(memory_order_relaxed))
+			{
+				return;
+			}
+			if(shared_ptr<trace_buffer> const trace = atomic_load(&client_trace_))
+			{
+				trace->record(trace_schedule, queued);
+			}
+			if(shared_ptr<shm_metrics_segment> const metrics = atomic_load(&metrics_))
+			{
+				// a worker which takes the task stores the exact queue length afterwards
+				shm_metrics_header & h = metrics->header();
+				h.scheduled.fetch_add(1, memory_order_relaxed);
+				h.pending.fetch_add(1, memory_order_relaxed);
+			}
+		}
+
+		//! \brief get the run-next slot of the calling thread, 0 if it is not a worker
+		static run_next_slot * & current_run_next_slot()
+		{
+			static thread_local run_next_slot * slot = 0;
+			return slot;
+		}
+
+		static void blocking_begun(void * const p)
+		{
+			blocking_target & target = *static_cast<blocking_target *>(p);
+			target.pool->begin_blocking(*target.context);
+		}
+
+		static void blocking_ended(void * const p)
+		{
+			blocking_target & target = *static_cast<blocking_target *>(p);
+			target.pool->end_blocking(*target.context);
+		}
+
+		//! \brief mark the calling worker blocked, called by its blocking regions
+		void begin_blocking(worker_context & context)
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			if(run_next_slot * const slot = current_run_next_slot())
+			{
+				// the slot's task would wait for the blocking call
+				queue_run_next(*slot);
+			}
+			if(!context.blocked)
+			{
+				context.blocked = true;
+				worker_blocked();
+			}
+		}
+
+		//! \brief unmark the calling worker, called by its blocking regions
+		void end_blocking(worker_context & context)
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			worker_unblocked(context);
+		}
+
+		//! \brief count a blocked worker and add a worker for it, called with worker_mutex_ held
+		void worker_blocked()
+		{
+			++blocked_workers_;
+			if(compensating_ >= max_compensating_)
+			{
+				return;
+			}
+			++compensating_;
+			++compensations_count_;
+			change_target_worker_count(1);
+			if(retiring_ > 0)
+			{
+				// a worker which did not leave yet stays
+				--retiring_;
+			}
+			add_compensating_worker();
+		}
+
+		//! \brief bring the workers up to a target raised for blocked ones, called with worker_mutex_ held
+		//! Parked workers take the blocked workers' tasks first, then spare workers return, a thread is started last.
+		void add_compensating_worker()
+		{
+			if(worker_adjust_amount(target_worker_count_) <= 0
+				|| parked_workers_count_ > static_cast<int>(pending_notifies_.size()))
+			{
+				return;
+			}
+			if(spare_workers_ > 0)
+			{
+				reactivate_spare_workers(1);
+				return;
+			}
+			try
+			{
+				worker_thread<pool_type>::create_and_attach(this->shared_from_this());
+			}
+			catch(thread_resource_error const &)
+			{
+				--compensating_;
+				change_target_worker_count(-1);
+			}
+		}
+
+		//! \brief uncount a worker which no longer blocks and retire a worker added for it, called with worker_mutex_ held
+		void worker_unblocked(worker_context & context)
+		{
+			if(!context.blocked)
+			{
+				return;
+			}
+			context.blocked = false;
+			--blocked_workers_;
+			if(compensating_ > blocked_workers_)
+			{
+				--compensating_;
+				if(worker_adjust_amount(change_target_worker_count(-1)) < 0)
+				{
+					// a parked worker becomes a spare one, otherwise the next one which finishes a task
+					++retiring_;
+					wake_all_workers();
+				}
+			}
+		}
+
+		//! \brief park a worker which leaves for the end of a blocking region as a spare one, called with worker_mutex_ held
+		//! The spare worker gives up its affine tasks and reserved class and waits until reactivate_spare_workers picks it.
+		//! \return true if the worker fetches tasks again, false if it has to leave the pool
+		bool park_spare_worker(worker_context & context, run_next_slot & slot, event_mutex::scoped_lock & lock)
+		{
+			if(retiring_ == 0 || spare_workers_ >= max_compensating_)
+			{
+				return false;
+			}
+			--retiring_;
+			queue_run_next(slot);
+			requeue_affine_tasks(context);
+			if(context.reserved)
+			{
+				context.reserved = false;
+				--reserved_active_;
+			}
+			context.spare = true;
+			{
+				worker_counting_mutex::scoped_lock counting_lock(worker_counting_mutex_, lock_site_counters);
+				fetching_workers_count_--;
+				++spare_workers_;
+				worker_counting_event_.notify_all();
+			}
+			worker_exit_on_request_event_.notify_all();
+			while(reactivated_ == 0)
+			{
+				spare_worker_event_.wait(lock);
+			}
+			--reactivated_;
+			context.spare = false;
+			return true;
+		}
+
+		//! \brief let spare workers fetch tasks again, called with worker_mutex_ held
+		//! They count as fetching right away, so resize and the compensation do not start threads for them.
+		void reactivate_spare_workers(int const count)
+		{
+			{
+				worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_counters);
+				spare_workers_ -= count;
+				fetching_workers_count_ += count;
+				worker_counting_event_.notify_all();
+			}
+			reactivated_ += count;
+			spare_worker_event_.notify_all();
+		}
+
+		//! \brief treat workers which run one task longer than the stuck threshold like blocked ones, called with worker_mutex_ held
+		void detect_stuck_workers(int64_t const now)
+		{
+			if(now < next_stuck_scan_.load(memory_order_relaxed))
+			{
+				return;
+			}
+			next_stuck_scan_.store(now + stuck_after_ns_ / 4, memory_order_relaxed);
+			for(std::vector<worker_context*>::const_iterator it = workers_.begin(); it != workers_.end(); ++it)
+			{
+				worker_context & w = **it;
+				int64_t const busy_since = w.busy_since.load(memory_order_relaxed);
+				if(!w.blocked && busy_since != 0 && now - busy_since > stuck_after_ns_)
+				{
+					w.blocked = true;
+					worker_blocked();
+				}
+			}
+		}
+
+		//! \brief take the worker's next task from its run-next slot or the queues, called with worker_mutex_ held
+		bool take_task(queued_task_type & task, worker_context & context, run_next_slot & slot, trace_buffer * const trace)
+		{
+			int const sources = fetch_sources(context);
+			if(slot.streak < run_next_limit_ && sources == fetch_any)
+			{
+				mutex::scoped_lock lock(slot.guard);
+				if(slot.occupied)
+				{
+					task = slot.task;
+					slot.occupied = false;
+					slot.streak++;
+					run_next_pending_.fetch_sub(1);
+					return true;
+				}
+			}
+			// the limit was reached, the slots were disabled or the worker was reserved
+			queue_run_next(slot);
+			slot.streak = 0;
+			return fetch_task(task, sources, &context, trace)
+				|| (sources == fetch_any && steal_run_next(task, slot, trace));
+		}
+
+		//! \brief move the task of a run-next slot to the shared queue, called with worker_mutex_ held
+		void queue_run_next(run_next_slot & slot)
+		{
+			queued_task_type task;
+			{
+				mutex::scoped_lock lock(slot.guard);
+				if(!slot.occupied)
+				{
+					return;
+				}
+				slot.occupied = false;
+				task = slot.task;
+			}
+			add_task(task);
+			run_next_pending_.fetch_sub(1);
+			wake_one_worker();
+		}
+
+		//! \brief take the task of another worker's run-next slot which waited longer than the steal delay, called with worker_mutex_ held
+		bool steal_run_next(queued_task_type & task, run_next_slot const & own, trace_buffer * const trace)
+		{
+			if(run_next_pending_.load() == 0)
+			{
+				return false;
+			}
+			int64_t const now = worker_context::ticks(worker_context::clock_type::now());
+			for(typename std::vector<run_next_slot*>::const_iterator it = run_next_slots_.begin(); it != run_next_slots_.end(); ++it)
+			{
+				run_next_slot & victim = **it;
+				if(&victim == &own)
+				{
+					continue;
+				}
+				mutex::scoped_lock lock(victim.guard);
+				if(victim.occupied && now - victim.since >= run_next_steal_ns_)
+				{
+					task = victim.task;
+					victim.occupied = false;
+					run_next_pending_.fetch_sub(1);
+					if(trace)
+					{
+						trace->record(trace_steal, victim.worker);
+					}
+					return true;
+				}
+			}
+			return false;
+		}
+
+		//! \brief wake a parked worker to watch a task put into a slot, unless one watches the slots already
+		//! A worker counts itself parked before it checks run_next_pending_ and waits, and stops watching or
+		//! clears the request before it checks again, so either it sees the task or this sees the worker.
+		void wake_run_next_watcher()
+		{
+			if(parked_workers_count_.load() > 0 && run_next_watchers_.load() == 0 && !run_next_watch_requested_.load())
+			{
+				event_mutex::scoped_lock lock(worker_mutex_, lock_site_schedule);
+				notify_run_next_watcher();
+			}
+		}
+
+		//! \brief wake a parked worker if slot tasks wait and no worker watches them, called with worker_mutex_ held
+		void notify_run_next_watcher()
+		{
+			if(run_next_pending_.load() == 0 || run_next_watchers_ > 0 || run_next_watch_requested_ || parked_workers_count_ == 0)
+			{
+				return;
+			}
+			run_next_watch_requested_ = true;
+			if(parked_exclusive_ == 0)
+			{
+				wake_one_worker();
+			}
+			else
+			{
+				// the woken worker might be one which only takes reserved tasks
+				wake_all_workers();
+			}
+		}
+
+		//! \brief queue the task of the calling worker's slot and stop offering it, called with worker_mutex_ held
+		void release_run_next_slot(run_next_slot & slot)
+		{
+			queue_run_next(slot);
+			run_next_slots_.erase(std::find(run_next_slots_.begin(), run_next_slots_.end(), &slot));
+			current_run_next_slot() = 0;
+		}
+
+		//! \brief add a task to a submission shard and wake a parked worker
+		//! \return false if the pool does not use sharded submission, the task was not added then
+		bool schedule_sharded(queued_task_type const & entry, worker_context::clock_type::time_point const & now)
+		{
+			if(!sharded_submission_.load(memory_order_acquire) || maybe_reserved(entry))
+			{
+				return false;
+			}
+			observe_submission(sharded_pending_.load(memory_order_relaxed) + 1);
+			producer_state & producer = this_producer();
+			submission_shard * s = &shards_[producer.home % shard_count_];
+			if(!s->guard.try_lock())
+			{
+				// power of two choices
+				uint64_t r = producer.random;
+				r ^= r << 13;
+				r ^= r >> 7;
+				r ^= r << 17;
+				producer.random = r;
+				std::size_t const a = r % shard_count_;
+				std::size_t const b = (r >> 32) % shard_count_;
+				producer.home = shards_[a].size.load(memory_order_relaxed) <= shards_[b].size.load(memory_order_relaxed) ? a : b;
+				s = &shards_[producer.home];
+				s->guard.lock();
+			}
+			{
+				mutex::scoped_lock lock(s->guard, adopt_lock);
+				s->tasks.push(entry);
+				s->size.fetch_add(1, memory_order_relaxed);
+				sharded_bytes_.fetch_add(entry.bytes, memory_order_relaxed);
+				sharded_count_.fetch_add(1, memory_order_relaxed);
+			}
+			// a worker counts itself parked before it checks sharded_pending_ and waits,
+			// so either it sees the task or this sees the worker
+			sharded_pending_.fetch_add(1);
+			int64_t const ticks = worker_context::ticks(now);
+			bool const compensate = compensating_.load(memory_order_relaxed) > 0 || ticks >= next_stuck_scan_.load(memory_order_relaxed);
+			if(parked_workers_count_.load() > 0 || compensate)
+			{
+				event_mutex::scoped_lock lock(worker_mutex_, lock_site_schedule);
+				if(parked_workers_count_ > static_cast<int>(pending_notifies_.size()))
+				{
+					pending_notifies_.push_back(now);
+				}
+				if(compensate)
+				{
+					// like task_added: find stuck workers, and add the worker owed for a blocked one once no parked worker takes its share
+					detect_stuck_workers(ticks);
+					if(compensating_ > 0)
+					{
+						add_compensating_worker();
+					}
+				}
+				wake_one_worker();
+			}
+			return true;
+		}
+
+		//! \brief get the shard selection state of the calling thread, the first shard is picked in round robin order
+		static producer_state & this_producer()
+		{
+			static thread_specific_ptr<producer_state> state;
+			static atomic<std::size_t> next_home(0);
+			producer_state * p = state.get();
+			if(p == 0)
+			{
+				p = new producer_state();
+				p->home = next_home.fetch_add(1, memory_order_relaxed);
+				p->random = hash<thread::id>()(this_thread::get_id()) * 0x9E3779B97F4A7C15ull | 1;
+				state.reset(p);
+			}
+			return *p;
+		}
 
-	private:	
-		mutable worker_counting_mutex	worker_counting_mutex_;			//protects follow counters
-		mutable condition_variable_any worker_counting_event_;			//signals when follow counters changed
+		//! \brief take a task from the next non-empty submission shard, called with task_queue_mutex_ held
+		bool fetch_sharded_task(queued_task_type & task)
+		{
+			if(sharded_pending_.load() == 0)
+			{
+				return false;
+			}
+			for(std::size_t i = 0; i < shard_count_; ++i)
+			{
+				submission_shard & s = shards_[shard_cursor_];
+				shard_cursor_ = (shard_cursor_ + 1) % shard_count_;
+				if(s.size.load(memory_order_relaxed) == 0)
+				{
+					continue;
+				}
+				mutex::scoped_lock lock(s.guard);
+				if(s.tasks.empty())
+				{
+					continue;
+				}
+				task = s.tasks.top();
+				s.tasks.pop();
+				s.size.fetch_sub(1, memory_order_relaxed);
+				sharded_pending_.fetch_sub(1);
+				sharded_bytes_.fetch_sub(task.bytes, memory_order_relaxed);
+				return true;
+			}
+			return false;
+		}
 
-		int target_worker_count_;			// target worker count
-		int fetching_workers_count_;			// count workers in fetching state
-		int processing_workers_count_;		// count workers in processing state
-		resize_mutex resize_mutex_;	//! make sure one resize call each time
+		//! \brief pick the worker of an affine task, called with worker_mutex_ held
+		//! \return 0 if the task goes to the shared queue
+		worker_context * affinity_target(std::size_t const key, task_tag const & tag) const
+		{
+			if(workers_.empty() || (!reserved_tag_.empty() && tag == reserved_tag_))
+			{
+				return 0;
+			}
+			worker_context * const target = workers_[key % workers_.size()];
+			return (target->reserved && reserved_exclusive_) || target->spare ? 0 : target;
+		}
 
-	private: 
-		mutable task_queue_mutex task_queue_mutex_;		//protects task_queue
-		queue_policy_type  task_queue_;			//task queue policy object
-		condition_variable task_queue_changed_event_;
+		//! \brief add a task to the queue of a worker, called with worker_mutex_ held
+		//! \return false if the worker's queue holds the affinity limit
+		bool add_affine_task(queued_task_type const & t, worker_context const & target)
+		{
+			task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_schedule);
+			typename affinity_queue_map::iterator const it = affinity_queues_.find(target.id);
+			if(it == affinity_queues_.end() || it->second.tasks->size() >= affinity_limit_)
+			{
+				return false;
+			}
+			it->second.tasks->push(t);
+			affine_pending_++;
+			pending_bytes_ += t.bytes;
+			task_queue_changed_event_.notify_all();
+			return true;
+		}
 
-	private:
+		//! \brief check if a task of the given size exceeds the queue limits, called with worker_mutex_ held
+		bool queue_full(std::size_t const bytes) const
+		{
+			if(max_pending_tasks_ == 0 && max_pending_bytes_ == 0)
+			{
+				// unbounded, keep task_queue_mutex_ off the schedule path
+				return false;
+			}
+			task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_schedule);
+			int const pending = queued_count();
+			if(pending == 0)
+			{
+				return false;
+			}
+			return (max_pending_tasks_ > 0 && pending >= max_pending_tasks_)
+				|| (max_pending_bytes_ > 0 && pending_bytes_ + sharded_bytes_.load(memory_order_relaxed) + bytes > max_pending_bytes_);
+		}
 
-		//!
-		mutable event_mutex worker_mutex_;
-		mutable condition_variable worker_state_changed_event_;
-		mutable condition_variable_any worker_fetch_one_event_;		 
-		condition_variable_any worker_enter_event_;			
-		condition_variable_any worker_exit_on_request_event_;
-		condition_variable_any worker_exit_on_exception_event_;
-	public:
-		/// Constructor.
-		pool_core()
-			: target_worker_count_(0)
-			, fetching_workers_count_(0)
-			, processing_workers_count_(0)			
+		//! \brief block until a worker takes a task from the queue
+		//! Throws no_worker if the pool has no worker which could do so.
+		//! \return false if the deadline passed
+		bool wait_for_queue_space(event_mutex::scoped_lock & lock, worker_context::clock_type::time_point const * deadline = 0)
 		{
-			//pool_type volatile & self_ref = *this;
-			//m_size_policy.reset(new size_policy_type());
-			
-			task_queue_.clear();
+			if(total_workers_count() == 0)
+			{
+				throw no_worker();
+			}
+			bool woken = true;
+			++blocked_producers_;
+			if(deadline)
+			{
+				woken = queue_space_event_.wait_until(lock, *deadline) == cv_status::no_timeout;
+			}
+			else
+			{
+				queue_space_event_.wait(lock);
+			}
+			--blocked_producers_;
+			return woken;
 		}
 
+		//! \brief predict the queue wait of a new task, called with worker_mutex_ held
+		//! The task starts after the tasks ahead of it and one task per busy worker completed.
+		int64_t predicted_queue_wait_ns() const
+		{
+			int const workers = total_workers_count();
+			if(workers == 0)
+			{
+				return (std::numeric_limits<int64_t>::max)();
+			}
+			int const ahead = pending_tasks_count() + processing_workers_count() - workers + 1;
+			if(ahead <= 0 || mean_service_ns_ == 0)
+			{
+				return 0;
+			}
+			return ahead * mean_service_ns_ / workers;
+		}
 
-		/// Destructor.
-		~pool_core()
+		//! \brief update the moving average of the service time, called with worker_mutex_ held
+		void record_service_time(int64_t const run_ns)
 		{
-			clear_pending_tasks();
-			//terminate();	//ã˵workeruserٱpool_coreshared_ptr
+			mean_service_ns_ = mean_service_ns_ == 0 ? run_ns : mean_service_ns_ + (run_ns - mean_service_ns_) / 16;
 		}
-		
-		void schedule(task_type const & task)
+
+		//! \brief apply the overflow policy to a task which does not fit, called with worker_mutex_ held
+		//! The queue policies can only remove their top task, so the tasks which would run next are dropped.
+		//! \return true if queued tasks were dropped and the task fits now
+		bool make_room(std::size_t const bytes)
 		{
-			event_mutex::scoped_lock lock(worker_mutex_);
-			add_task(task);
-			worker_fetch_one_event_.notify_one();		
-		}	
+			if(overflow_policy_ == overflow_reject)
+			{
+				rejected_count_++;
+				return false;
+			}
+			queued_task_type dropped;
+			while(queue_full(bytes) && (fetch_task(dropped, fetch_shared) || fetch_task(dropped, fetch_sharded) || fetch_task(dropped, fetch_affine) || fetch_task(dropped, fetch_reserved)))
+			{
+				dropped_count_++;
+			}
+			return true;
+		}
+
+	public:
 		int total_workers_count() const{
-			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_);
+			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_query);
 			return fetching_workers_count_ + processing_workers_count_;
 		}
 
 		int fetching_workers_count() const 
 		{
-			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_);
+			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_query);
 			return fetching_workers_count_;
 		}
 
 		int processing_workers_count() const 
 		{
-			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_);
+			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_query);
 			return processing_workers_count_;
 		}
 
 		int pending_tasks_count() const 
 		{
-			task_queue_mutex::scoped_lock lock(task_queue_mutex_);
-			return task_queue_.size();		
+			task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_query);
+			return queued_count();
+		}
+
+		//! \brief get the utilisation of each worker and of the whole pool
+		//! The aggregate includes the workers which already left the pool.
+		pool_stats stats() const
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_query);
+			pool_stats result;
+			result.total = retired_stats_;
+			for(std::vector<worker_context*>::const_iterator it = workers_.begin(); it != workers_.end(); ++it)
+			{
+				worker_stats const s = (*it)->stats();
+				if(!(*it)->spare)
+				{
+					result.workers.push_back(s);
+				}
+				result.total += s;
+			}
+
+			worker_context::tag_stats_map tags = retired_tags_;
+			for(std::vector<worker_context*>::const_iterator it = workers_.begin(); it != workers_.end(); ++it)
+			{
+				(*it)->collect_tag_stats(tags);
+			}
+			for(worker_context::tag_stats_map::const_iterator it = tags.begin(); it != tags.end(); ++it)
+			{
+				result.tags.push_back(it->second);
+			}
+
+			{
+				task_queue_mutex::scoped_lock queue_lock(task_queue_mutex_, lock_site_query);
+				result.queue.pending = queued_count();
+				result.queue.pending_bytes = pending_bytes_ + sharded_bytes_.load(memory_order_relaxed);
+				result.queue.expired = expired_count_;
+				result.queue.stolen = stolen_count_;
+				collect_queued_class_stats(result.classes);
+			}
+			result.queue.scheduled = scheduled_count_ + sharded_count_.load(memory_order_relaxed) + run_next_count_.load(memory_order_relaxed);
+			result.queue.rejected = rejected_count_;
+			result.queue.dropped = dropped_count_;
+			result.queue.shed = shed_count_;
+			result.queue.affine = affine_count_;
+			result.compensating = compensating_;
+			result.compensations = compensations_count_;
+			result.spare = spare_workers_;
+			result.queue.mean_service_time = chrono::nanoseconds(mean_service_ns_);
+			lock.unlock();
+
+			task_queue_mutex_.profile("task_queue_mutex", result.locks);
+			worker_mutex_.profile("worker_mutex", result.locks);
+			worker_counting_mutex_.profile("worker_counting_mutex", result.locks);
+			return result;
+		}
+
+		//! \brief read cycles, instructions and cache misses around tagged tasks
+		//! Requires perf_event_open on Linux, elsewhere tags only get CPU and wall time.
+		void enable_hardware_counters(bool enable)
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			hardware_counters_ = enable;
+		}
+
+		//! \brief start a tracing session
+		//! Schedule, fetch and execute events are recorded into per-worker ring buffers
+		//! from now on. Events of a previous session are discarded.
+		//! \param events_per_buffer capacity of each ring buffer, older events are overwritten
+		void enable_tracing(std::size_t events_per_buffer)
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			trace_generation_++;
+			trace_capacity_ = events_per_buffer;
+			trace_origin_ticks_ = trace_clock::now();
+			trace_origin_ns_ = trace_clock::steady_ns();
+			trace_buffers_.clear();
+			atomic_store(&client_trace_, shared_ptr<trace_buffer>(new trace_buffer(events_per_buffer, -1, 0)));
+			trace_buffers_.push_back(client_trace_);
+			tracing_ = true;
+			update_submission_path();
+		}
+
+		//! \brief publish counters and latency histograms in a shared memory object
+		//! The object is /dev/shm/threadpool.<pid>.<n> on Linux and can be watched with threadpool-top.
+		//! A previous export of this pool is removed.
+		//! \param name the pool's name shown by readers
+		//! \return false if the object could not be created
+		bool enable_metrics_export(char const * name)
+		{
+			shared_ptr<shm_metrics_segment> segment(new shm_metrics_segment(name));
+			if(!segment->available())
+			{
+				return false;
+			}
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			if(metrics_)
+			{
+				metrics_->close();
+			}
+			atomic_store(&metrics_, segment);
+			update_submission_path();
+			publish_worker_counts();
+			metrics_->header().pending.store(pending_tasks_count(), memory_order_relaxed);
+			return true;
+		}
+
+		//! \brief remove the shared memory object once no worker uses it anymore
+		void disable_metrics_export()
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			if(metrics_)
+			{
+				metrics_->close();
+			}
+			atomic_store(&metrics_, shared_ptr<shm_metrics_segment>());
+			update_submission_path();
+		}
+
+		//! \brief log arrival time, tag, queue wait and run duration of each task into a file
+		//! The file can be replayed against other pool configurations with workload_replay.
+		//! A previous recording of this pool is completed.
+		//! \param path the file to create
+		//! \return false if the file could not be created
+		bool enable_recording(char const * path)
+		{
+			shared_ptr<workload_writer> writer(new workload_writer(path, worker_context::ticks(worker_context::clock_type::now())));
+			if(!writer->is_open())
+			{
+				return false;
+			}
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			if(recorder_)
+			{
+				recorder_->close();
+			}
+			recorder_ = writer;
+			return true;
+		}
+
+		//! \brief complete and close the workload file, tasks which finish later are not logged
+		void disable_recording()
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			if(recorder_)
+			{
+				recorder_->close();
+			}
+			recorder_.reset();
+		}
+
+		//! \brief stop recording, the recorded events are kept for export
+		void disable_tracing()
+		{
+			event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+			tracing_ = false;
+			// the buffer stays in trace_buffers_ for the export
+			atomic_store(&client_trace_, shared_ptr<trace_buffer>());
+			update_submission_path();
+		}
+
+		//! \brief write the events of the current or last tracing session as Chrome trace JSON
+		void write_chrome_trace(std::ostream & out) const
+		{
+			std::vector<shared_ptr<trace_buffer> > buffers;
+			uint64_t origin_ticks;
+			int64_t origin_ns;
+			{
+				event_mutex::scoped_lock lock(worker_mutex_, lock_site_other);
+				buffers = trace_buffers_;
+				origin_ticks = trace_origin_ticks_;
+				origin_ns = trace_origin_ns_;
+			}
+
+			chrome_trace_writer writer(out, origin_ticks, origin_ns);
+			for(std::vector<shared_ptr<trace_buffer> >::const_iterator it = buffers.begin(); it != buffers.end(); ++it)
+			{
+				writer.write(**it);
+			}
 		}
 
    
@@ -191,7 +1620,7 @@ namespace boost { namespace threadpool { namespace detail
 			int worker_adjust = worker_adjust_amount(worker_count);		
 
 			if(worker_adjust > 0){
-				event_mutex::scoped_lock lock(worker_mutex_);
+				event_mutex::scoped_lock lock(worker_mutex_, lock_site_resize);
 
 				set_target_worker_count(worker_count);
 
@@ -200,9 +1629,9 @@ namespace boost { namespace threadpool { namespace detail
 				{			
 					try
 					{
-						worker_thread<pool_type>::create_and_attach(shared_from_this());
+						worker_thread<pool_type>::create_and_attach(this->shared_from_this());
 					}
-					catch(thread_resource_error)
+					catch(thread_resource_error const &)
 					{
 						return false;
 					}					
@@ -210,7 +1639,7 @@ namespace boost { namespace threadpool { namespace detail
 					//worker_adjust--;
 				}
 			}else if(worker_adjust < 0){
-				event_mutex::scoped_lock lock(worker_mutex_);										
+				event_mutex::scoped_lock lock(worker_mutex_, lock_site_resize);										
 
 				while (worker_adjust_amount(worker_count) < 0)
 				{				
@@ -222,7 +1651,7 @@ namespace boost { namespace threadpool { namespace detail
 
 						set_target_worker_count(last_total_worker - 1);					
 
-						worker_fetch_one_event_.notify_one();	
+						wake_one_worker();	
 
 						while(total_workers_count() >= last_total_worker){
 							worker_exit_on_request_event_.wait(lock);
@@ -254,17 +1683,20 @@ namespace boost { namespace threadpool { namespace detail
 			//	}
 			//	return true;
 			//}
+			return true;
 		}
 
 		//wait_for_all_worker_exit for all worker to exit from fetching or processing state
 		void wait_for_all_worker_exit() const{
-			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_);
+			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_query);
 
 			while (total_workers_count() > 0)
 			{
 				worker_counting_event_.wait(lock);
 			}
 		};
+		//! \brief wait until the queues are empty and no worker is processing a task
+		//! \throws no_worker if the pool has no worker to run the pending tasks
 		void wait_for_all_task_done() const {
 			/*event_mutex::scoped_lock evt_lock(worker_mutex_);
 			while(pending_tasks_count() > 0 || processing_workers_count() > 0 ){
@@ -276,9 +1708,9 @@ namespace boost { namespace threadpool { namespace detail
 			
 			{
 				//worker_counting_mutex::scoped_lock lock(worker_counting_mutex_);
-				event_mutex::scoped_lock lock(worker_mutex_);
+				event_mutex::scoped_lock lock(worker_mutex_, lock_site_query);
 				
-				while(pending_tasks_count() > 0){
+				while(pending_tasks_count() > 0 || processing_workers_count() > 0){
 					if(total_workers_count() == 0){
 						throw no_worker();
 					}
@@ -295,9 +1727,9 @@ namespace boost { namespace threadpool { namespace detail
 			resize_mutex::scoped_lock resize_lock(resize_mutex_);
 			
 			{//set target worker count to 0 and notify all workers to exit
-				event_mutex::scoped_lock lock(worker_mutex_);
+				event_mutex::scoped_lock lock(worker_mutex_, lock_site_resize);
 				set_target_worker_count(0);
-				worker_fetch_one_event_.notify_all();
+				wake_all_workers();
 			}
 
 			/*
@@ -320,8 +1752,22 @@ namespace boost { namespace threadpool { namespace detail
 		*/
 		void clear_pending_tasks()
 		{ 
-			task_queue_mutex::scoped_lock lock(task_queue_mutex_);
+			task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_other);
 			task_queue_.clear();
+			reserved_queue_.clear();
+			for(typename affinity_queue_map::iterator it = affinity_queues_.begin(); it != affinity_queues_.end(); ++it)
+			{
+				it->second.tasks->clear();
+			}
+			affine_pending_ = 0;
+			pending_bytes_ = 0;
+			for(std::size_t i = 0; i < shard_count_; ++i)
+			{
+				mutex::scoped_lock shard_lock(shards_[i].guard);
+				sharded_pending_.fetch_sub(shards_[i].size.exchange(0, memory_order_relaxed));
+				shards_[i].tasks.clear();
+			}
+			sharded_bytes_.store(0, memory_order_relaxed);
 		} 
 
 		/*! 
@@ -332,23 +1778,53 @@ namespace boost { namespace threadpool { namespace detail
 		*/   
 		bool task_queue_empty() const
 		{
-			task_queue_mutex::scoped_lock lock(task_queue_mutex_);
-			return task_queue_.empty();
+			task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_query);
+			return task_queue_.empty() && reserved_queue_.empty() && affine_pending_ == 0 && sharded_pending_.load() == 0
+				&& run_next_pending_.load() == 0;
 		}	
 		
 		//! \brief set target worker count with signal
-		//! use by pool_core::resize and pool_core::terminate to update target worker count
+		//! use by pool_core::resize and pool_core::terminate to update target worker count, called with worker_mutex_ held
+		//! The new target replaces the workers added for blocked ones, the spare workers join the workers
+		//! and leave if they exceed it.
 		void set_target_worker_count(int target)
 		{
-			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_);
+			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_resize);
+			compensating_ = 0;
+			retiring_ = 0;
+			if(spare_workers_ > 0)
+			{
+				reactivate_spare_workers(spare_workers_);
+			}
+			store_target_worker_count(target);
+		}
+
+		//! \brief add delta to the target worker count, e.g. for compensation
+		//! \return the new target
+		int change_target_worker_count(int const delta)
+		{
+			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_resize);
+			int const target = (std::max)(0, target_worker_count_ + delta);
+			store_target_worker_count(target);
+			return target;
+		}
+
+		//! \brief set target worker count, called with worker_counting_mutex_ held
+		void store_target_worker_count(int const target)
+		{
 			target_worker_count_ = target;
 			worker_counting_event_.notify_all();
+			if(tracing_)
+			{
+				client_trace_->record(trace_resize, target);
+			}
+			publish_worker_counts();
 		}
 		//! \brief caculate how many worker should be terminated or spawned
 		//
 		int worker_adjust_amount(int target) 
 		{		
-			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_);			
+			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_counters);			
 			target -= fetching_workers_count_;
 			target -= processing_workers_count_;
 
@@ -357,38 +1833,124 @@ namespace boost { namespace threadpool { namespace detail
 		
 		//! \brief update counters and emit signal
 		void worker_begin_fetching(){
-			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_);				
+			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_counters);				
 			fetching_workers_count_++;
 			worker_counting_event_.notify_all();			
 		};
 		//! \brief update counters and emit signal
 		void worker_fetching_to_processing(){
-			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_);				
+			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_counters);				
 			fetching_workers_count_--;
 			processing_workers_count_++;
 			worker_counting_event_.notify_all();
+			publish_worker_counts();
 		};
 		//! \brief update counters and emit signal
 		void worker_processing_to_fetching(){
-			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_);				
+			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_counters);				
 			processing_workers_count_--;
 			fetching_workers_count_++;
 			worker_counting_event_.notify_all();
+			publish_worker_counts();
 		};
 		//! \brief update counters and emit signal
 		void worker_fetching_to_exit(){			
-			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_);		
+			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_counters);		
 			fetching_workers_count_--;				
 			worker_counting_event_.notify_all();
 			
 		};
+		//! \brief register a worker's context, called with worker_mutex_ held
+		void attach_worker(worker_context & context){
+			context.id = next_worker_id_++;
+			workers_.push_back(&context);
+			{
+				task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_resize);
+				affinity_queue & q = affinity_queues_[context.id];
+				q.owner = &context;
+				q.tasks.reset(new queue_policy_type());
+				q.running = false;
+			}
+			publish_worker_counts();
+		};
+		//! \brief unregister a worker's context and keep its counters, called with worker_mutex_ held
+		void detach_worker(worker_context & context){
+			workers_.erase(std::find(workers_.begin(), workers_.end(), &context));
+			requeue_affine_tasks(context);
+			{
+				task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_resize);
+				affinity_queues_.erase(context.id);
+			}
+			if(context.reserved)
+			{
+				context.reserved = false;
+				--reserved_active_;
+			}
+			retired_stats_ += context.stats();
+			context.collect_tag_stats(retired_tags_);
+			context.metrics.reset();
+			context.recorder.reset();
+			context.record_buffer.reset();
+			publish_worker_counts();
+		};
+		//! \brief move the tasks routed to a worker to the shared queue, called with worker_mutex_ held
+		void requeue_affine_tasks(worker_context const & context){
+			task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_resize);
+			queue_policy_type & tasks = *affinity_queues_[context.id].tasks;
+			if(!tasks.empty())
+			{
+				for(; !tasks.empty(); tasks.pop())
+				{
+					task_queue_.push(tasks.top());
+					affine_pending_--;
+				}
+				task_queue_changed_event_.notify_all();
+				wake_all_workers();
+			}
+		};
+		//! \brief copy the worker and target counts into the exported metrics, called with worker_mutex_ held
+		void publish_worker_counts(){
+			if(metrics_)
+			{
+				worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_counters);
+				shm_metrics_header & h = metrics_->header();
+				h.workers.store(workers_.size(), memory_order_relaxed);
+				h.processing.store(processing_workers_count_, memory_order_relaxed);
+				h.target_workers.store(target_worker_count_ > 0 ? target_worker_count_ : 0, memory_order_relaxed);
+			}
+		};
+		//! \brief get the worker's buffer of the current tracing session, called with worker_mutex_ held
+		//! \return 0 if tracing is disabled
+		trace_buffer * worker_trace_buffer(worker_context & context){
+			if(!tracing_)
+			{
+				return 0;
+			}
+			if(context.trace_generation != trace_generation_)
+			{
+				context.trace.reset(new trace_buffer(trace_capacity_, context.id, current_os_thread_id()));
+				context.trace_generation = trace_generation_;
+				trace_buffers_.push_back(context.trace);
+			}
+			return context.trace.get();
+		};
 		//! \brief update counters and emit signal
-		void worker_processing_to_exception(){		
-			event_mutex::scoped_lock evt_lock(worker_mutex_);
-			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_);		
+		void worker_processing_to_exception(worker_context & context){		
+			event_mutex::scoped_lock evt_lock(worker_mutex_, lock_site_other);
+			if(run_next_slot * const slot = current_run_next_slot())
+			{
+				// called on the worker's thread while the task unwinds
+				release_run_next_slot(*slot);
+			}
+			detail::current_blocking_hooks() = 0;
+			worker_unblocked(context);
+			detach_worker(context);
+			worker_counting_mutex::scoped_lock lock(worker_counting_mutex_, lock_site_counters);		
 			processing_workers_count_--;
 			worker_counting_event_.notify_all();
+			publish_worker_counts();
 			worker_exit_on_exception_event_.notify_all();
+			queue_space_event_.notify_all();
 			//worker_state_changed_event_.notify_all();
 		};
 
@@ -396,77 +1958,355 @@ namespace boost { namespace threadpool { namespace detail
 		//! returns false immediately if the queue is empty.
 		//! otherwise it will return true , indicating the
 		//! Task & task is valid. This method is thread-safe.		
-		bool fetch_task(Task & task){
-			task_queue_mutex::scoped_lock lock(task_queue_mutex_);
-			if(task_queue_.size()){		  
-				task = task_queue_.top();
-				task_queue_.pop();
+		//! Tasks whose deadline passed are dropped. Tasks of the reserved class are taken first,
+		//! then those routed to the worker, then shared ones, then those routed to busy workers.
+		//! \param sources the queues to take a task from, see fetch_source
+		//! \param context the fetching worker, 0 to take affine tasks of any worker
+		//! \param trace the worker's trace buffer, receives steal events
+		bool fetch_task(queued_task_type & task, int const sources = fetch_any, worker_context const * const context = 0, trace_buffer * const trace = 0){
+			task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_fetch_task);
+			affinity_queue * const own = context ? find_affinity_queue(*context) : 0;
+			if(own){
+				own->running = false;
+			}
+			while(true){		  
+				queue_policy_type * affine = 0;
+				bool sharded = false;
+				if((sources & fetch_reserved) && !reserved_queue_.empty()){
+					task = reserved_queue_.front();
+					reserved_queue_.pop_front();
+				}else if((sources & fetch_affine) && own && !own->tasks->empty()){
+					affine = own->tasks.get();
+					task = affine->top();
+					affine->pop();
+					affine_pending_--;
+				}else if((sources & fetch_shared) && task_queue_.size()){
+					task = task_queue_.top();
+					task_queue_.pop();
+				}else if((sources & fetch_sharded) && fetch_sharded_task(task)){
+					sharded = true;
+				}else if((sources & fetch_affine) && (affine = victim_affinity_queue(context, trace)) != 0){
+					task = affine->top();
+					affine->pop();
+					affine_pending_--;
+				}else{
+					return false;
+				}
+				if(!sharded){
+					pending_bytes_ -= task.bytes;
+				}
 				task_queue_changed_event_.notify_all();
+				if(task.deadline != 0 && task.deadline < worker_context::ticks(worker_context::clock_type::now()))
+				{
+					expired_count_++;
+					continue;
+				}
+				if(own){
+					own->running = true;
+				}
 				return true;
-			}else{
-				return false;
 			}
 		};
 
-		//! \brief add a task into task queue policy
+		//! \brief get the affinity queue of a worker, called with task_queue_mutex_ held
+		//! \return 0 if the worker left the pool
+		affinity_queue * find_affinity_queue(worker_context const & context){
+			typename affinity_queue_map::iterator const it = affinity_queues_.find(context.id);
+			return it != affinity_queues_.end() ? &it->second : 0;
+		}
+
+		//! \brief pick the longest affinity queue of a worker which runs a task, called with task_queue_mutex_ held
+		//! An owner which does not run a task is about to take its tasks itself.
+		//! \param thief the fetching worker, 0 to pick among all workers
+		queue_policy_type * victim_affinity_queue(worker_context const * const thief, trace_buffer * const trace){
+			if(affine_pending_ == 0){
+				return 0;
+			}
+			affinity_queue const * victim = 0;
+			for(typename affinity_queue_map::const_iterator it = affinity_queues_.begin(); it != affinity_queues_.end(); ++it){
+				affinity_queue const & q = it->second;
+				if(q.owner != thief && !q.tasks->empty() && (thief == 0 || q.running)
+					&& (victim == 0 || q.tasks->size() > victim->tasks->size())){
+					victim = &q;
+				}
+			}
+			if(victim == 0){
+				return 0;
+			}
+			if(thief != 0){
+				stolen_count_++;
+				if(trace){
+					trace->record(trace_steal, victim->owner->id);
+				}
+			}
+			return victim->tasks.get();
+		}
+
+		//! \brief add a task into task queue policy, or into the reserved queue if it belongs to the reserved class
 		//! This method is thread-safe.
-		void add_task(Task const& t){
-			task_queue_mutex::scoped_lock lock(task_queue_mutex_);
-			task_queue_.push(t);
+		//! \return true if the task was added to the reserved queue
+		bool add_task(queued_task_type const& t, std::size_t const count = 1){
+			task_queue_mutex::scoped_lock lock(task_queue_mutex_, lock_site_schedule);
+			bool const reserved = !reserved_tag_.empty() && t.tag == reserved_tag_;
+			for(std::size_t i = 0; i < count; ++i){
+				if(reserved){
+					reserved_queue_.push_back(t);
+				}else{
+					task_queue_.push(t);
+				}
+			}
+			pending_bytes_ += t.bytes * count;
 			task_queue_changed_event_.notify_all();
+			return reserved;
 		};
 
 		//! \brief entry method for worker
 		//! ThreadSafety : yes
-		void execute_task()
+		void execute_task(worker_context & context)
 		{
+			typedef worker_context::clock_type clock_type;
+			run_next_slot slot;
+			slot.owner = this;
+			slot.worker = context.id;
+			slot.occupied = false;
+			slot.since = 0;
+			slot.streak = 0;
 			{
-				event_mutex::scoped_lock evt_lock(worker_mutex_);
+				event_mutex::scoped_lock evt_lock(worker_mutex_, lock_site_resize);
+				attach_worker(context);
+				run_next_slots_.push_back(&slot);
 				worker_begin_fetching();
 				worker_enter_event_.notify_all();
 				worker_state_changed_event_.notify_all();
 			}
+
+			char thread_name[32];
+			std::sprintf(thread_name, "threadpool-%d", context.id);
+			set_current_thread_name(thread_name);
+
+			current_run_next_slot() = &slot;
+
+			blocking_target hooks;
+			hooks.begin = &pool_type::blocking_begun;
+			hooks.end = &pool_type::blocking_ended;
+			hooks.argument = &hooks;
+			hooks.depth = 0;
+			hooks.pool = this;
+			hooks.context = &context;
+			detail::current_blocking_hooks() = &hooks;
 			
 			bool from_processing = false;
+			int64_t last_run_ns = 0;
+			uint64_t run_next_seen = 0;		// run_next_count_ when the worker last watched the slots
+			clock_type::time_point fetch_begin = clock_type::now();
 
 			while(true){
-				function0<void> task;	
+				queued_task_type task;	
+				bool fetched = false;
+				bool count_hardware = false;
+				int64_t parked_ns = 0;
+				bool woken = false;
+				clock_type::time_point notified_at;
+				trace_buffer * trace = 0;
 
 				{			
-					event_mutex::scoped_lock awake_lock(worker_mutex_);
+					event_mutex::scoped_lock awake_lock(worker_mutex_, lock_site_fetch_task);
+
+					trace = worker_trace_buffer(context);
+					count_hardware = hardware_counters_;
 					
 					//fetching state
 					if(from_processing){
+						record_service_time(last_run_ns);
 						worker_processing_to_fetching();
 						worker_state_changed_event_.notify_all();
+						// a stuck task returned
+						worker_unblocked(context);
+						detect_stuck_workers(worker_context::ticks(clock_type::now()));
 					}else{
 						from_processing = true;
 					}					
 
-					while(worker_adjust_amount(target_worker_count_) >= 0 && !fetch_task(task))
-					{						
-						worker_fetch_one_event_.wait(awake_lock);
+					// a worker which leaves for the end of a blocking region may stay as a spare one
+					while(true)
+					{
+						while(worker_adjust_amount(target_worker_count_) >= 0 && !(fetched = take_task(task, context, slot, trace)))
+						{						
+							clock_type::time_point const park_begin = clock_type::now();
+							bool const exclusive = context.reserved && reserved_exclusive_;
+							++parked_workers_count_;
+							parked_exclusive_ += exclusive ? 1 : 0;
+							context.parked_since.store(worker_context::ticks(park_begin), memory_order_relaxed);
+							if(trace)
+							{
+								trace->record(trace_park);
+							}
+							// a sharded producer does not take worker_mutex_ unless it sees a parked worker,
+							// a worker which cannot take its task waits for the shards to be drained by another
+							if(exclusive || sharded_pending_.load() == 0)
+							{
+								if(!exclusive && run_next_watchers_ == 0
+									&& (run_next_pending_.load() > 0 || run_next_count_.load() != run_next_seen))
+								{
+									// the slots are in use, their tasks are taken once they waited the steal delay
+									run_next_seen = run_next_count_.load();
+									++run_next_watchers_;
+									waiting_workers_.push_back(&context);
+									context.wake_event.wait_for(awake_lock, chrono::nanoseconds(run_next_steal_ns_));
+									forget_waiting_worker(context);
+									--run_next_watchers_;
+								}
+								else
+								{
+									waiting_workers_.push_back(&context);
+									context.wake_event.wait(awake_lock);
+									forget_waiting_worker(context);
+								}
+								// this might be the worker woken to watch the slots, it checks them next
+								run_next_watch_requested_ = false;
+							}
+							trace = worker_trace_buffer(context);
+							if(trace)
+							{
+								trace->record(trace_wake);
+							}
+							context.parked_since.store(0, memory_order_relaxed);
+							--parked_workers_count_;
+							parked_exclusive_ -= exclusive ? 1 : 0;
+							parked_ns += worker_context::elapsed_ns(park_begin, clock_type::now());
+
+							woken = !pending_notifies_.empty();
+							if(woken)
+							{
+								notified_at = pending_notifies_.front();
+								pending_notifies_.pop_front();
+							}
+						}
+						clock_type::time_point const spare_begin = clock_type::now();
+						if(fetched || !park_spare_worker(context, slot, awake_lock))
+						{
+							break;
+						}
+						parked_ns += worker_context::elapsed_ns(spare_begin, clock_type::now());
+						trace = worker_trace_buffer(context);
 					}
 
-					if()
-					if(!task){
+					if(!fetched){
+						context.parked_ns.add(parked_ns);
+						context.spinning_ns.add(worker_context::elapsed_ns(fetch_begin, clock_type::now()) - parked_ns);
+						release_run_next_slot(slot);
+						notify_run_next_watcher();
+						detail::current_blocking_hooks() = 0;
+						detach_worker(context);
 						worker_fetching_to_exit();
 						worker_exit_on_request_event_.notify_all();
+						queue_space_event_.notify_all();
 						//worker_state_changed_event_.notify_all();
 						return;
 					}else{
 						worker_fetching_to_processing();
+						// a watcher which got a task hands the watch over
+						notify_run_next_watcher();
 						//worker_state_changed_event_.notify_all();
 					}
+
+					if(blocked_producers_ > 0)
+					{
+						queue_space_event_.notify_all();
+					}
+
+					context.metrics = metrics_;
+					if(metrics_)
+					{
+						metrics_->header().pending.store(pending_tasks_count(), memory_order_relaxed);
+					}
+					if(context.recorder != recorder_)
+					{
+						context.recorder = recorder_;
+						context.record_buffer = recorder_ ? recorder_->add_buffer() : shared_ptr<workload_record_buffer>();
+					}
 					
 				}	
 
-				if(task)
+				if(fetched)
 				{					
-					scope_guard guard(bind(&pool_type::worker_processing_to_exception,shared_from_this()));				
+					clock_type::time_point const task_begin = clock_type::now();
+					context.parked_ns.add(parked_ns);
+					context.spinning_ns.add(worker_context::elapsed_ns(fetch_begin, task_begin) - parked_ns);
+					if(woken)
+					{
+						int64_t const latency = worker_context::elapsed_ns(notified_at, task_begin);
+						context.wakeups.add(1);
+						context.wake_latency_ns.add(latency);
+						context.max_wake_latency_ns.set_max(latency);
+					}
+
+					// the worker thread owns a reference to the pool, so this stays valid
+					member_scope_guard<pool_type, worker_context> guard(this, &pool_type::worker_processing_to_exception, context);
+					context.busy_since.store(worker_context::ticks(task_begin), memory_order_relaxed);
+					if(trace)
+					{
+						trace->record(trace_start);
+					}
+
+					bool const accounted = !task.tag.empty();
+					chrono::thread_clock::time_point cpu_begin;
+					hardware_sample hardware_begin;
+					bool hardware_read = false;
+					if(accounted)
+					{
+						if(count_hardware && !context.counters)
+						{
+							context.counters.reset(new hardware_counters());
+						}
+						hardware_read = count_hardware && context.counters->read(hardware_begin);
+						cpu_begin = chrono::thread_clock::now();
+					}
+
 					task();
+
+					if(accounted)
+					{
+						int64_t const cpu_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::thread_clock::now() - cpu_begin).count();
+						hardware_sample hardware_end;
+						if(hardware_read && context.counters->read(hardware_end))
+						{
+							hardware_end.cycles -= hardware_begin.cycles;
+							hardware_end.instructions -= hardware_begin.instructions;
+							hardware_end.llc_misses -= hardware_begin.llc_misses;
+						}
+						else
+						{
+							hardware_read = false;
+						}
+						context.charge(task.tag, cpu_ns, worker_context::elapsed_ns(task_begin, clock_type::now()), hardware_read ? &hardware_end : 0);
+					}
+					if(trace)
+					{
+						trace->record(trace_end);
+					}
 					guard.disable();
-					
+
+					fetch_begin = clock_type::now();
+					context.busy_since.store(0, memory_order_relaxed);
+					int64_t const run_ns = worker_context::elapsed_ns(task_begin, fetch_begin);
+					last_run_ns = run_ns;
+					context.busy_ns.add(run_ns);
+					context.tasks_executed.add(1);
+					if(context.metrics)
+					{
+						context.metrics->record_task(context.id, worker_context::ticks(task_begin) - task.enqueued, run_ns);
+					}
+					if(context.record_buffer)
+					{
+						recorded_task const r = { task.enqueued - context.recorder->origin(), task.tag, worker_context::ticks(task_begin) - task.enqueued, run_ns };
+						std::vector<recorded_task> full;
+						context.record_buffer->append(r, full);
+						if(!full.empty())
+						{
+							context.recorder->write(full);
+						}
+					}
 				}			
 			}
 			return;
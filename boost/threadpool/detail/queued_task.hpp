@@ -0,0 +1,96 @@
+/*! \file
+* \brief Queue entry of the pool.
+*
+* The pool stores tasks together with the information it needs
+* about them after they were scheduled.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_DETAIL_QUEUED_TASK_HPP_INCLUDED
+#define THREADPOOL_DETAIL_QUEUED_TASK_HPP_INCLUDED
+
+
+#include <boost/threadpool/task_adaptors.hpp>
+
+#include <boost/cstdint.hpp>
+
+#include <cstddef>
+
+
+
+namespace boost { namespace threadpool { namespace detail
+{
+
+  /*! \brief Task as it is stored in the pool's scheduler.
+  *
+  * A queued_task behaves like the task it wraps: it can be executed,
+  * compared with operator< and asked for its priority, so the scheduling
+  * policies order it like the task itself.
+  *
+  * \see pool_core
+  */
+  template <typename Task>
+  class queued_task
+  {
+  public:
+    typedef void result_type; //!< Indicates the functor's result type.
+    typedef Task task_type;   //!< Indicates the wrapped task's type.
+
+    Task function;            //!< The scheduled task.
+    task_tag tag;             //!< Accounting tag given at schedule time.
+    int64_t enqueued;         //!< Steady clock nanoseconds when the task was scheduled.
+    std::size_t bytes;        //!< Estimated memory held by the entry, charged to the queue's byte capacity.
+    int64_t deadline;         //!< Steady clock nanoseconds after which the task is dropped instead of run, 0 for none.
+
+  public:
+    queued_task()
+      : enqueued(0)
+      , bytes(0)
+      , deadline(0)
+    {
+    }
+
+    queued_task(Task const & task, task_tag const & label, int64_t const enqueued_at, std::size_t const size = 0)
+      : function(task)
+      , tag(label)
+      , enqueued(enqueued_at)
+      , bytes(size)
+      , deadline(0)
+    {
+    }
+
+    /*! Executes the task.
+    */
+    void operator() (void) const
+    {
+      function();
+    }
+
+    /*! Gets the priority of the task, only available for tasks which have one.
+    */
+    unsigned int priority() const
+    {
+      return function.priority();
+    }
+
+    /*! Orders queue entries like their tasks.
+    */
+    bool operator< (queued_task const & rhs) const
+    {
+      return function < rhs.function;
+    }
+  };
+
+
+} } } // namespace boost::threadpool::detail
+
+#endif // THREADPOOL_DETAIL_QUEUED_TASK_HPP_INCLUDED
+
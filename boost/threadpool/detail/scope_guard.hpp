@@ -55,6 +55,41 @@ public:
 
 
 
+//! Calls a member function with a reference argument on exit. Stores no function object, so it never allocates.
+template <typename T, typename Arg>
+class member_scope_guard
+: private boost::noncopyable
+{
+	T * const   m_object;
+	void (T::* const m_function)(Arg &);
+	Arg &       m_argument;
+	bool        m_is_active;
+
+public:
+	member_scope_guard(T * object, void (T::*call_on_exit)(Arg &), Arg & argument)
+	: m_object(object)
+	, m_function(call_on_exit)
+	, m_argument(argument)
+	, m_is_active(true)
+	{
+	}
+
+	~member_scope_guard()
+	{
+		if(m_is_active)
+		{
+			(m_object->*m_function)(m_argument);
+		}
+	}
+
+	void disable()
+	{
+		m_is_active = false;
+	}
+};
+
+
+
 
 
 
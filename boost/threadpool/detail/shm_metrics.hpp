@@ -0,0 +1,338 @@
+/*! \file
+* \brief Metrics export through shared memory.
+*
+* A pool which exports its metrics publishes counters and latency
+* histograms in a POSIX shared memory object, which appears on Linux as
+* /dev/shm/threadpool.<pid>.<n>. Other processes, e.g. threadpool-top, map
+* the object read-only. The pool never waits for a reader and is not
+* informed about readers, so reading costs the pool nothing.
+*
+* Layout (version 1): a shm_metrics_header followed by slot_count
+* shm_metrics_slot records. All counters are 64 bit atomics which are only
+* incremented or overwritten, hence a reader sees consistent values of each
+* counter, but not a consistent snapshot of all of them.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_DETAIL_SHM_METRICS_HPP_INCLUDED
+#define THREADPOOL_DETAIL_SHM_METRICS_HPP_INCLUDED
+
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/static_assert.hpp>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#if !defined(_WIN32)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  define THREADPOOL_HAS_SHM_METRICS
+#endif
+
+
+
+namespace boost { namespace threadpool { namespace detail
+{
+
+  uint32_t const shm_metrics_magic = 0x4d505054;  //!< "TPPM" in little endian.
+  uint32_t const shm_metrics_version = 1;
+  std::size_t const shm_metrics_slots = 64;       //!< Per-worker records, workers share a slot if their ids are equal modulo this.
+  std::size_t const shm_metrics_buckets = 40;     //!< Histogram buckets, bucket i counts durations in [2^i, 2^(i+1)) nanoseconds.
+  std::size_t const shm_metrics_name_size = 64;
+
+  BOOST_STATIC_ASSERT(sizeof(atomic<uint64_t>) == sizeof(uint64_t));
+
+
+  /*! \brief Pool wide values of the shared memory layout.
+  */
+  struct shm_metrics_header
+  {
+    atomic<uint32_t> magic;             //!< shm_metrics_magic, stored last when the object is initialised.
+    uint32_t version;                   //!< Layout version, readers must reject versions they do not know.
+    uint32_t size;                      //!< Size of the object in bytes.
+    uint32_t slot_count;                //!< Number of shm_metrics_slot records after the header.
+    uint32_t bucket_count;              //!< Number of buckets of each histogram.
+    uint32_t reserved;
+    int64_t pid;                        //!< Process which owns the pool.
+    char name[shm_metrics_name_size];   //!< Pool name given to enable_metrics_export, null terminated.
+
+    atomic<uint64_t> closed;            //!< Set to 1 when the pool stops exporting.
+    atomic<uint64_t> scheduled;         //!< Number of tasks scheduled.
+    atomic<uint64_t> pending;           //!< Queue depth after the last schedule or fetch.
+    atomic<uint64_t> workers;           //!< Number of workers attached to the pool.
+    atomic<uint64_t> processing;        //!< Number of workers running a task.
+    atomic<uint64_t> target_workers;    //!< Worker count requested by resize.
+  };
+
+
+  /*! \brief Counters of a worker in the shared memory layout.
+  */
+  struct shm_metrics_slot
+  {
+    atomic<uint64_t> executed;                          //!< Number of tasks run.
+    atomic<uint64_t> busy_ns;                           //!< Time spent in tasks.
+    atomic<uint64_t> queue_wait[shm_metrics_buckets];   //!< Histogram of the time from schedule to start.
+    atomic<uint64_t> run_time[shm_metrics_buckets];     //!< Histogram of the task durations.
+  };
+
+
+  /*! Gets the histogram bucket of a duration.
+  */
+  inline std::size_t shm_metrics_bucket(int64_t const ns)
+  {
+    std::size_t bucket = 0;
+    for(uint64_t v = ns > 1 ? static_cast<uint64_t>(ns) : 1; v > 1 && bucket + 1 < shm_metrics_buckets; v >>= 1)
+    {
+      ++bucket;
+    }
+    return bucket;
+  }
+
+  inline std::size_t shm_metrics_size()
+  {
+    return sizeof(shm_metrics_header) + shm_metrics_slots * sizeof(shm_metrics_slot);
+  }
+
+
+
+  /*! \brief Shared memory object a pool publishes its metrics in.
+  *
+  * The object is created by the constructor and removed by the destructor.
+  * Counters are updated with relaxed atomic operations; a slot is written by
+  * the workers mapped to it, the header by threads holding the pool's
+  * worker mutex.
+  */
+  class shm_metrics_segment
+    : private noncopyable
+  {
+    void * m_base;
+    char m_path[64];
+
+  public:
+    /*! Constructor.
+    * \param name Name shown by threadpool-top, truncated to 63 characters.
+    */
+    explicit shm_metrics_segment(char const * const name)
+      : m_base(0)
+    {
+      m_path[0] = 0;
+#if defined(THREADPOOL_HAS_SHM_METRICS)
+      static atomic<int> sequence(0);
+      std::sprintf(m_path, "/threadpool.%ld.%d", static_cast<long>(getpid()), sequence.fetch_add(1, memory_order_relaxed));
+
+      int const fd = shm_open(m_path, O_CREAT | O_EXCL | O_RDWR, 0644);
+      if(fd == -1)
+      {
+        m_path[0] = 0;
+        return;
+      }
+      void * const base = ftruncate(fd, static_cast<off_t>(shm_metrics_size())) == 0
+        ? mmap(0, shm_metrics_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+        : MAP_FAILED;
+      ::close(fd);
+      if(base == MAP_FAILED)
+      {
+        shm_unlink(m_path);
+        m_path[0] = 0;
+        return;
+      }
+      m_base = base;
+
+      shm_metrics_header * const h = new(m_base) shm_metrics_header();
+      h->version = shm_metrics_version;
+      h->size = static_cast<uint32_t>(shm_metrics_size());
+      h->slot_count = static_cast<uint32_t>(shm_metrics_slots);
+      h->bucket_count = static_cast<uint32_t>(shm_metrics_buckets);
+      h->reserved = 0;
+      h->pid = getpid();
+      std::strncpy(h->name, name, shm_metrics_name_size - 1);
+      h->name[shm_metrics_name_size - 1] = 0;
+      h->closed.store(0, memory_order_relaxed);
+      h->scheduled.store(0, memory_order_relaxed);
+      h->pending.store(0, memory_order_relaxed);
+      h->workers.store(0, memory_order_relaxed);
+      h->processing.store(0, memory_order_relaxed);
+      h->target_workers.store(0, memory_order_relaxed);
+      for(std::size_t i = 0; i < shm_metrics_slots; ++i)
+      {
+        new(&slot(static_cast<int>(i))) shm_metrics_slot();
+      }
+      h->magic.store(shm_metrics_magic, memory_order_release);
+#else
+      (void)name;
+#endif
+    }
+
+    ~shm_metrics_segment()
+    {
+      close();
+#if defined(THREADPOOL_HAS_SHM_METRICS)
+      if(m_base)
+      {
+        munmap(m_base, shm_metrics_size());
+      }
+#endif
+    }
+
+    /*! Marks the metrics as closed and removes the object's name, so that
+    * readers no longer find it. The mapping stays valid for the writers
+    * which still hold the segment.
+    */
+    void close()
+    {
+#if defined(THREADPOOL_HAS_SHM_METRICS)
+      if(m_base && m_path[0])
+      {
+        header().closed.store(1, memory_order_relaxed);
+        shm_unlink(m_path);
+        m_path[0] = 0;
+      }
+#endif
+    }
+
+    /*! Checks if the object could be created.
+    */
+    bool available() const
+    {
+      return m_base != 0;
+    }
+
+    /*! Gets the name of the shared memory object, e.g. /threadpool.1234.0, empty once closed.
+    */
+    char const * path() const
+    {
+      return m_path;
+    }
+
+    shm_metrics_header & header()
+    {
+      return *static_cast<shm_metrics_header *>(m_base);
+    }
+
+    /*! Gets the slot of a worker.
+    */
+    shm_metrics_slot & slot(int const worker_id)
+    {
+      shm_metrics_slot * const slots = reinterpret_cast<shm_metrics_slot *>(static_cast<char *>(m_base) + sizeof(shm_metrics_header));
+      return slots[static_cast<std::size_t>(worker_id) % shm_metrics_slots];
+    }
+
+    /*! Records a task which was run by a worker.
+    */
+    void record_task(int const worker_id, int64_t const queue_wait_ns, int64_t const run_ns)
+    {
+      shm_metrics_slot & s = slot(worker_id);
+      s.executed.fetch_add(1, memory_order_relaxed);
+      s.busy_ns.fetch_add(static_cast<uint64_t>(run_ns > 0 ? run_ns : 0), memory_order_relaxed);
+      s.queue_wait[shm_metrics_bucket(queue_wait_ns)].fetch_add(1, memory_order_relaxed);
+      s.run_time[shm_metrics_bucket(run_ns)].fetch_add(1, memory_order_relaxed);
+    }
+  };
+
+
+
+  /*! \brief Read-only mapping of a pool's metrics, used by readers in other processes.
+  */
+  class shm_metrics_view
+    : private noncopyable
+  {
+    void const * m_base;
+    std::size_t m_size;
+
+  public:
+    /*! Maps a shared memory object and validates its layout.
+    * \param path Name of the object, e.g. /threadpool.1234.0.
+    */
+    explicit shm_metrics_view(char const * const path)
+      : m_base(0)
+      , m_size(0)
+    {
+#if defined(THREADPOOL_HAS_SHM_METRICS)
+      int const fd = shm_open(path, O_RDONLY, 0);
+      if(fd == -1)
+      {
+        return;
+      }
+      struct stat st;
+      if(fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(shm_metrics_header))
+      {
+        void * const base = mmap(0, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if(base != MAP_FAILED)
+        {
+          m_base = base;
+          m_size = static_cast<std::size_t>(st.st_size);
+        }
+      }
+      ::close(fd);
+
+      if(m_base)
+      {
+        shm_metrics_header const & h = header();
+        if(h.magic.load(memory_order_acquire) != shm_metrics_magic
+          || h.version != shm_metrics_version
+          || h.size > m_size
+          || h.bucket_count != shm_metrics_buckets
+          || sizeof(shm_metrics_header) + h.slot_count * sizeof(shm_metrics_slot) > m_size)
+        {
+          unmap();
+        }
+      }
+#else
+      (void)path;
+#endif
+    }
+
+    ~shm_metrics_view()
+    {
+      unmap();
+    }
+
+    /*! Checks if the object exists and has a known layout.
+    */
+    bool valid() const
+    {
+      return m_base != 0;
+    }
+
+    shm_metrics_header const & header() const
+    {
+      return *static_cast<shm_metrics_header const *>(m_base);
+    }
+
+    shm_metrics_slot const & slot(std::size_t const index) const
+    {
+      return reinterpret_cast<shm_metrics_slot const *>(static_cast<char const *>(m_base) + sizeof(shm_metrics_header))[index];
+    }
+
+  private:
+    void unmap()
+    {
+#if defined(THREADPOOL_HAS_SHM_METRICS)
+      if(m_base)
+      {
+        munmap(const_cast<void *>(m_base), m_size);
+        m_base = 0;
+      }
+#endif
+    }
+  };
+
+
+} } } // namespace boost::threadpool::detail
+
+#endif // THREADPOOL_DETAIL_SHM_METRICS_HPP_INCLUDED
@@ -0,0 +1,359 @@
+/*! \file
+* \brief Task lifecycle tracing.
+*
+* This file contains the event buffers which are filled in tracing mode and
+* the export of their content as Chrome trace JSON, which is also read by
+* Perfetto (ui.perfetto.dev) and chrome://tracing.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_DETAIL_TRACE_HPP_INCLUDED
+#define THREADPOOL_DETAIL_TRACE_HPP_INCLUDED
+
+
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <ios>
+#include <ostream>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#  include <intrin.h>
+#  define THREADPOOL_TRACE_HAS_TSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#  include <x86intrin.h>
+#  define THREADPOOL_TRACE_HAS_TSC
+#endif
+
+#if defined(_WIN32)
+#  include <boost/winapi/thread.hpp>
+#  include <boost/winapi/get_current_process_id.hpp>
+#else
+#  include <pthread.h>
+#  include <unistd.h>
+#  if defined(__linux__)
+#    include <sys/syscall.h>
+#  endif
+#endif
+
+
+namespace boost { namespace threadpool { namespace detail
+{
+
+  /*! \brief Kinds of trace events.
+  */
+  enum trace_event_type
+  {
+    trace_schedule,   //!< A task was added to a queue, arg is the queue length, the submission shards and run-next slots count as one queue each.
+    trace_start,      //!< A worker started a task.
+    trace_end,        //!< A worker finished a task.
+    trace_steal,      //!< A worker took a task queued for another worker, arg is that worker's id.
+    trace_park,       //!< A worker found no task and blocked.
+    trace_wake,       //!< A parked worker was woken.
+    trace_resize      //!< The target worker count changed, arg is the new count.
+  };
+
+
+
+  /*! \brief Compact trace record.
+  */
+  struct trace_event
+  {
+    uint64_t timestamp;   //!< trace_clock ticks.
+    int32_t arg;          //!< Meaning depends on type.
+    uint8_t type;         //!< A trace_event_type.
+  };
+
+
+
+  /*! \brief Timestamp source of the trace.
+  *
+  * Reads the time stamp counter where available, which costs a few cycles,
+  * and falls back to the steady clock in nanoseconds otherwise.
+  */
+  struct trace_clock
+  {
+    static uint64_t now()
+    {
+#if defined(THREADPOOL_TRACE_HAS_TSC)
+      return __rdtsc();
+#else
+      return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    static int64_t steady_ns()
+    {
+      return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+  };
+
+
+
+  /*! Gets the id the operating system uses for the calling thread.
+  * The id matches the thread ids shown by perf and other system profilers.
+  */
+  inline long current_os_thread_id()
+  {
+#if defined(_WIN32)
+    return static_cast<long>(winapi::GetCurrentThreadId());
+#elif defined(__linux__)
+    return static_cast<long>(syscall(SYS_gettid));
+#else
+    return 0;
+#endif
+  }
+
+  inline long current_os_process_id()
+  {
+#if defined(_WIN32)
+    return static_cast<long>(winapi::GetCurrentProcessId());
+#else
+    return static_cast<long>(getpid());
+#endif
+  }
+
+  /*! Names the calling thread so that it can be identified in debuggers and profilers.
+  * \param name The name, truncated to 15 characters on Linux.
+  */
+  inline void set_current_thread_name(char const * name)
+  {
+#if defined(__linux__)
+    char truncated[16];
+    std::strncpy(truncated, name, sizeof(truncated) - 1);
+    truncated[sizeof(truncated) - 1] = 0;
+    pthread_setname_np(pthread_self(), truncated);
+#elif defined(__APPLE__)
+    pthread_setname_np(name);
+#else
+    (void)name;
+#endif
+  }
+
+
+
+  /*! \brief Ring buffer of trace events.
+  *
+  * A buffer is written by one thread, which makes its lock uncontended,
+  * and read when the trace is exported. When the buffer is full the
+  * oldest events are overwritten.
+  */
+  class trace_buffer
+    : private noncopyable
+  {
+    mutable mutex m_mutex;
+    std::vector<trace_event> m_events;
+    std::size_t m_next;
+    bool m_wrapped;
+
+  public:
+    int const track;          //!< Worker id, -1 for the events of threads which are not workers.
+    long const os_thread_id;  //!< Thread id of the writer, 0 if unknown.
+
+  public:
+    trace_buffer(std::size_t const capacity, int const track_id, long const thread_id)
+      : m_events(capacity > 0 ? capacity : 1)
+      , m_next(0)
+      , m_wrapped(false)
+      , track(track_id)
+      , os_thread_id(thread_id)
+    {
+    }
+
+    void record(trace_event_type const type, int32_t const arg = 0)
+    {
+      trace_event e;
+      e.timestamp = trace_clock::now();
+      e.arg = arg;
+      e.type = static_cast<uint8_t>(type);
+
+      mutex::scoped_lock lock(m_mutex);
+      m_events[m_next] = e;
+      if(++m_next == m_events.size())
+      {
+        m_next = 0;
+        m_wrapped = true;
+      }
+    }
+
+    /*! Copies the buffered events in the order they were recorded.
+    */
+    void copy_to(std::vector<trace_event> & out) const
+    {
+      mutex::scoped_lock lock(m_mutex);
+      if(m_wrapped)
+      {
+        out.insert(out.end(), m_events.begin() + m_next, m_events.end());
+      }
+      out.insert(out.end(), m_events.begin(), m_events.begin() + m_next);
+    }
+  };
+
+
+
+  /*! \brief Writes trace buffers as Chrome trace JSON.
+  *
+  * Task execution and parking become complete events on the track of the
+  * worker, schedule, steal and resize become instant events. Timestamps are
+  * converted to microseconds relative to the moment tracing was enabled.
+  */
+  class chrome_trace_writer
+  {
+    std::ostream & m_out;
+    std::ios_base::fmtflags const m_flags;
+    std::streamsize const m_precision;
+    long const m_pid;
+    uint64_t const m_origin;
+    double const m_ticks_per_us;
+    bool m_first;
+
+  public:
+    /*! Constructor.
+    * \param out The stream which receives the JSON document.
+    * \param origin_ticks trace_clock value at which tracing was enabled.
+    * \param origin_ns Steady clock nanoseconds at which tracing was enabled.
+    */
+    chrome_trace_writer(std::ostream & out, uint64_t const origin_ticks, int64_t const origin_ns)
+      : m_out(out)
+      , m_flags(out.flags())
+      , m_precision(out.precision())
+      , m_pid(current_os_process_id())
+      , m_origin(origin_ticks)
+      , m_ticks_per_us(ticks_per_us(origin_ticks, origin_ns))
+      , m_first(true)
+    {
+      m_out.setf(std::ios_base::fixed, std::ios_base::floatfield);
+      m_out.precision(3);
+      m_out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    }
+
+    ~chrome_trace_writer()
+    {
+      m_out << "\n]}\n";
+      m_out.flags(m_flags);
+      m_out.precision(m_precision);
+    }
+
+    void write(trace_buffer const & buffer)
+    {
+      long const tid = buffer.os_thread_id != 0 ? buffer.os_thread_id : 1000000 + buffer.track;
+
+      char name[64];
+      if(buffer.track >= 0)
+      {
+        std::sprintf(name, "threadpool-%d", buffer.track);
+      }
+      else
+      {
+        std::sprintf(name, "threadpool-clients");
+      }
+      begin_event();
+      m_out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << m_pid << ",\"tid\":" << tid
+            << ",\"args\":{\"name\":\"" << name << "\"}}";
+
+      std::vector<trace_event> events;
+      buffer.copy_to(events);
+
+      uint64_t task_begin = 0;
+      uint64_t park_begin = 0;
+      for(std::vector<trace_event>::const_iterator it = events.begin(); it != events.end(); ++it)
+      {
+        switch(it->type)
+        {
+        case trace_start:
+          task_begin = it->timestamp;
+          break;
+        case trace_end:
+          if(task_begin != 0)
+          {
+            complete("task", tid, task_begin, it->timestamp);
+            task_begin = 0;
+          }
+          break;
+        case trace_park:
+          park_begin = it->timestamp;
+          break;
+        case trace_wake:
+          if(park_begin != 0)
+          {
+            complete("parked", tid, park_begin, it->timestamp);
+            park_begin = 0;
+          }
+          break;
+        case trace_schedule:
+          instant("schedule", tid, it->timestamp, "pending", it->arg);
+          break;
+        case trace_steal:
+          instant("steal", tid, it->timestamp, "victim", it->arg);
+          break;
+        case trace_resize:
+          instant("resize", tid, it->timestamp, "workers", it->arg);
+          break;
+        }
+      }
+      if(task_begin != 0)
+      {
+        begin_event();
+        m_out << "{\"name\":\"task\",\"ph\":\"B\",\"pid\":" << m_pid << ",\"tid\":" << tid
+              << ",\"ts\":" << to_us(task_begin) << "}";
+      }
+    }
+
+  private:
+    static double ticks_per_us(uint64_t const origin_ticks, int64_t const origin_ns)
+    {
+      int64_t const elapsed_ns = trace_clock::steady_ns() - origin_ns;
+      uint64_t const elapsed_ticks = trace_clock::now() - origin_ticks;
+      if(elapsed_ns <= 0 || elapsed_ticks == 0)
+      {
+        return 1000.0;
+      }
+      return double(elapsed_ticks) * 1000.0 / double(elapsed_ns);
+    }
+
+    double to_us(uint64_t const ticks) const
+    {
+      return ticks > m_origin ? double(ticks - m_origin) / m_ticks_per_us : 0.0;
+    }
+
+    void begin_event()
+    {
+      m_out << (m_first ? "\n" : ",\n");
+      m_first = false;
+    }
+
+    void complete(char const * name, long const tid, uint64_t const begin, uint64_t const end)
+    {
+      begin_event();
+      m_out << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":" << m_pid << ",\"tid\":" << tid
+            << ",\"ts\":" << to_us(begin) << ",\"dur\":" << (to_us(end) - to_us(begin)) << "}";
+    }
+
+    void instant(char const * name, long const tid, uint64_t const at, char const * arg_name, int32_t const arg)
+    {
+      begin_event();
+      m_out << "{\"name\":\"" << name << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":" << m_pid << ",\"tid\":" << tid
+            << ",\"ts\":" << to_us(at) << ",\"args\":{\"" << arg_name << "\":" << arg << "}}";
+    }
+  };
+
+
+} } } // namespace boost::threadpool::detail
+
+#endif // THREADPOOL_DETAIL_TRACE_HPP_INCLUDED
+
@@ -0,0 +1,210 @@
+/*! \file
+* \brief Per-worker state.
+*
+* The worker context holds the state a pool keeps for each of its
+* worker threads.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_DETAIL_WORKER_CONTEXT_HPP_INCLUDED
+#define THREADPOOL_DETAIL_WORKER_CONTEXT_HPP_INCLUDED
+
+
+#include <boost/threadpool/pool_stats.hpp>
+#include <boost/threadpool/detail/trace.hpp>
+#include <boost/threadpool/detail/hardware_counters.hpp>
+#include <boost/threadpool/detail/shm_metrics.hpp>
+#include <boost/threadpool/detail/workload_record.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+
+
+
+namespace boost { namespace threadpool { namespace detail
+{
+
+  /*! \brief Counter which is written by one thread and read by many.
+  *
+  * Only the owning worker updates the value, so an increment needs no
+  * read-modify-write instruction. Readers see a consistent value of each
+  * counter but not of the whole set.
+  */
+  class worker_counter
+    : private noncopyable
+  {
+    atomic<int64_t> m_value;
+
+  public:
+    worker_counter()
+      : m_value(0)
+    {
+    }
+
+    void add(int64_t const delta)
+    {
+      m_value.store(m_value.load(memory_order_relaxed) + delta, memory_order_relaxed);
+    }
+
+    void set_max(int64_t const value)
+    {
+      if(m_value.load(memory_order_relaxed) < value)
+      {
+        m_value.store(value, memory_order_relaxed);
+      }
+    }
+
+    int64_t load() const
+    {
+      return m_value.load(memory_order_relaxed);
+    }
+  };
+
+
+
+  /*! \brief State of a worker thread.
+  *
+  * A worker_context is owned by the worker_thread and registered at its pool
+  * while the worker executes tasks.
+  *
+  * \see pool_core, worker_thread
+  */
+  class worker_context
+    : private noncopyable
+  {
+  public:
+    typedef chrono::steady_clock clock_type;
+    typedef std::map<task_tag, tag_stats> tag_stats_map;
+
+    int id;                             //!< Assigned by the pool when the worker enters it.
+
+    worker_counter tasks_executed;
+    worker_counter busy_ns;
+    worker_counter spinning_ns;
+    worker_counter parked_ns;
+    worker_counter wakeups;
+    worker_counter wake_latency_ns;
+    worker_counter max_wake_latency_ns;
+
+    atomic<int64_t> busy_since;         //!< Clock ticks when the running task started, 0 if the worker is not running a task.
+    atomic<int64_t> parked_since;       //!< Clock ticks when the worker was parked, 0 if it is not parked.
+
+    shared_ptr<trace_buffer> trace;     //!< Event buffer in tracing mode, only accessed by the worker itself.
+    int trace_generation;               //!< Tracing session the buffer belongs to.
+
+    bool reserved;                      //!< Serves the pool's reserved task class, protected by the pool's worker mutex.
+    bool blocked;                       //!< Runs a blocking region or is stuck in a task, the pool compensates for it. Protected by the pool's worker mutex.
+    bool spare;                         //!< Parked for the next compensation, takes no tasks. Protected by the pool's worker mutex.
+
+    condition_variable_any wake_event;  //!< Signals the worker while it is parked, notified with the pool's worker mutex held.
+
+    scoped_ptr<hardware_counters> counters; //!< Opened on first use, only accessed by the worker itself.
+
+    shared_ptr<shm_metrics_segment> metrics;  //!< Exported metrics of the pool, copied by the worker while it holds the pool's worker mutex.
+
+    shared_ptr<workload_writer> recorder;     //!< Workload file in recording mode, copied like metrics.
+    shared_ptr<workload_record_buffer> record_buffer; //!< The worker's buffer of recorder.
+
+  private:
+    mutable mutex m_tag_mutex;          //!< Protects m_tags, only contended while the pool's statistics are read.
+    tag_stats_map m_tags;
+
+  public:
+    worker_context()
+      : id(-1)
+      , busy_since(0)
+      , parked_since(0)
+      , trace_generation(0)
+      , reserved(false)
+      , blocked(false)
+      , spare(false)
+    {
+    }
+
+    /*! Reads the counters.
+    * \return The worker's statistics. The task or park which is in progress is accounted up to now.
+    */
+    worker_stats stats() const
+    {
+      int64_t const now = ticks(clock_type::now());
+      int64_t const busy_begin = busy_since.load(memory_order_relaxed);
+      int64_t const park_begin = parked_since.load(memory_order_relaxed);
+
+      worker_stats s;
+      s.id = id;
+      s.tasks_executed = static_cast<uint64_t>(tasks_executed.load());
+      s.busy_time = chrono::nanoseconds(busy_ns.load() + (busy_begin != 0 ? now - busy_begin : 0));
+      s.spinning_time = chrono::nanoseconds(spinning_ns.load());
+      s.parked_time = chrono::nanoseconds(parked_ns.load() + (park_begin != 0 ? now - park_begin : 0));
+      s.wakeups = static_cast<uint64_t>(wakeups.load());
+      s.wake_latency = chrono::nanoseconds(wake_latency_ns.load());
+      s.max_wake_latency = chrono::nanoseconds(max_wake_latency_ns.load());
+      s.reserved = reserved;
+      s.blocked = blocked;
+      return s;
+    }
+
+    /*! Charges a task's consumption to its tag.
+    * \param hardware The difference of the hardware counters or 0 if they were not read.
+    */
+    void charge(task_tag const & tag, int64_t const cpu_ns, int64_t const wall_ns, hardware_sample const * const hardware)
+    {
+      mutex::scoped_lock lock(m_tag_mutex);
+      tag_stats & s = m_tags[tag];
+      s.tag = tag;
+      s.tasks_executed++;
+      s.cpu_time += chrono::nanoseconds(cpu_ns);
+      s.wall_time += chrono::nanoseconds(wall_ns);
+      if(hardware)
+      {
+        s.has_hardware_counters = true;
+        s.cycles += hardware->cycles;
+        s.instructions += hardware->instructions;
+        s.llc_misses += hardware->llc_misses;
+      }
+    }
+
+    /*! Adds the per-tag counters of this worker to a map.
+    */
+    void collect_tag_stats(tag_stats_map & out) const
+    {
+      mutex::scoped_lock lock(m_tag_mutex);
+      for(tag_stats_map::const_iterator it = m_tags.begin(); it != m_tags.end(); ++it)
+      {
+        tag_stats & s = out[it->first];
+        s.tag = it->first;
+        s += it->second;
+      }
+    }
+
+    static int64_t ticks(clock_type::time_point const & t)
+    {
+      return chrono::duration_cast<chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+
+    static int64_t elapsed_ns(clock_type::time_point const & from, clock_type::time_point const & to)
+    {
+      return chrono::duration_cast<chrono::nanoseconds>(to - from).count();
+    }
+  };
+
+
+} } } // namespace boost::threadpool::detail
+
+#endif // THREADPOOL_DETAIL_WORKER_CONTEXT_HPP_INCLUDED
+
@@ -19,6 +19,7 @@
 
 
 #include <boost/threadpool/detail/scope_guard.hpp>
+#include <boost/threadpool/detail/worker_context.hpp>
 
 #include <boost/smart_ptr.hpp>
 #include <boost/thread.hpp>
@@ -55,7 +56,9 @@ namespace boost { namespace threadpool { namespace detail
 	private:
 		typename pool_type::ptr_type      m_pool;     //!< Pointer to the pool which created the worker.
 
-		boost::thread  thread_;   //!< Pointer to the thread which executes the run loop.
+		boost::thread  thread_;   //!< The thread which executes the run loop, detached once started.
+
+		worker_context m_context; //!< State and counters the pool keeps for this worker.
 		
 		
     
@@ -73,17 +76,16 @@ namespace boost { namespace threadpool { namespace detail
 	  */
 	  
 	  void run(){
-		  m_pool->execute_task();		  
+		  // The thread keeps the worker alive, so the worker must not keep the pool alive
+		  // after it left: the pool is destroyed when its last worker exits.
+		  pool_ptr pool;
+		  pool.swap(m_pool);
+		  pool->execute_task(m_context);
 	  }
 	
-	  /*! Joins the worker's thread.
-	  */
-	  void join()
-	  {
-		  thread_->join();
-	  }
-	  	
 	  /*! Constructs a new worker thread and attaches it to the pool.
+	  * The thread is detached: it owns the worker, which otherwise would own the thread,
+	  * and releases its resources when it leaves the pool.
 	  * \param pool Pointer to the pool.
 	  */
 
@@ -93,10 +95,11 @@ namespace boost { namespace threadpool { namespace detail
 		  ptr_type worker(new worker_thread(pool));
 		  if(!worker)
 		  {		 
-			  throw std::bad_alloc("boost::thread_pool::detail::worker_thread");
+			  throw std::bad_alloc();
 		  }
 
 		  worker->thread_ = boost::thread(bind(&worker_thread::run, worker));
+		  worker->thread_.detach();
 
 		  return worker;
 	  };
@@ -0,0 +1,398 @@
+/*! \file
+* \brief Workload recording.
+*
+* In recording mode a pool logs the arrival time, tag, queue wait and run
+* duration of every task into a compact binary file, which the
+* workload_replay tool feeds into other pool configurations.
+*
+* File format (version 1): the 8 byte header "TPWR", version (uint32 little
+* endian), followed by records. Numbers are unsigned LEB128 varints, signed
+* ones zigzag encoded. Each record starts with its kind:
+*   0 tag definition: index, 1 and name length (at most 4096) and name
+*     bytes, or 0 and id
+*   1 task: arrival delta to the previous task's arrival (signed, ns),
+*     tag index (0 for untagged tasks), queue wait (ns), run duration (ns)
+* Tasks are logged in the order they finish, so arrival deltas may be negative.
+* Arrival times are relative to the moment recording was enabled.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_DETAIL_WORKLOAD_RECORD_HPP_INCLUDED
+#define THREADPOOL_DETAIL_WORKLOAD_RECORD_HPP_INCLUDED
+
+
+#include <boost/threadpool/task_adaptors.hpp>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+
+
+namespace boost { namespace threadpool { namespace detail
+{
+
+  char const workload_record_magic[4] = { 'T', 'P', 'W', 'R' };
+  uint32_t const workload_record_version = 1;
+  std::size_t const workload_record_max_tag_length = 4096;  //!< Longer tag names are truncated, a longer length marks a corrupt file.
+
+  enum workload_record_kind
+  {
+    workload_record_tag = 0,
+    workload_record_task = 1
+  };
+
+
+  /*! \brief A task as it is logged.
+  */
+  struct recorded_task
+  {
+    int64_t arrival;      //!< Nanoseconds since recording was enabled.
+    task_tag tag;         //!< Tag given at schedule time.
+    int64_t queue_wait;   //!< Nanoseconds from schedule to start.
+    int64_t run;          //!< Nanoseconds the task ran.
+  };
+
+
+
+  /*! \brief Tasks logged by one worker.
+  *
+  * The buffer is written by its worker, which makes its lock uncontended,
+  * and drained into the file when it is full or recording stops.
+  */
+  class workload_record_buffer
+    : private noncopyable
+  {
+    mutex m_mutex;
+    std::vector<recorded_task> m_tasks;
+
+  public:
+    static std::size_t const capacity = 4096;
+
+    /*! Appends a task.
+    * \param full Receives the buffered tasks if the buffer is full, they have to be written by the caller.
+    */
+    void append(recorded_task const & task, std::vector<recorded_task> & full)
+    {
+      mutex::scoped_lock lock(m_mutex);
+      m_tasks.push_back(task);
+      if(m_tasks.size() >= capacity)
+      {
+        full.swap(m_tasks);
+        m_tasks.clear();
+      }
+    }
+
+    void drain(std::vector<recorded_task> & out)
+    {
+      mutex::scoped_lock lock(m_mutex);
+      out.insert(out.end(), m_tasks.begin(), m_tasks.end());
+      m_tasks.clear();
+    }
+  };
+
+
+
+  /*! \brief Encodes logged tasks into a file.
+  */
+  class workload_writer
+    : private noncopyable
+  {
+    mutex m_mutex;
+    std::FILE * m_file;
+    int64_t const m_origin;
+    int64_t m_last_arrival;
+    std::map<task_tag, uint32_t> m_tag_indices;
+    std::vector<shared_ptr<workload_record_buffer> > m_buffers;
+    std::vector<unsigned char> m_out;
+
+  public:
+    /*! Constructor.
+    * \param path The file to create.
+    * \param origin Steady clock nanoseconds arrival times are relative to.
+    */
+    workload_writer(char const * const path, int64_t const origin)
+      : m_file(std::fopen(path, "wb"))
+      , m_origin(origin)
+      , m_last_arrival(0)
+    {
+      if(m_file)
+      {
+        unsigned char header[8];
+        std::memcpy(header, workload_record_magic, 4);
+        for(int i = 0; i < 4; ++i)
+        {
+          header[4 + i] = static_cast<unsigned char>(workload_record_version >> (8 * i));
+        }
+        std::fwrite(header, 1, sizeof(header), m_file);
+      }
+    }
+
+    ~workload_writer()
+    {
+      close();
+    }
+
+    bool is_open() const
+    {
+      return m_file != 0;
+    }
+
+    int64_t origin() const
+    {
+      return m_origin;
+    }
+
+    /*! Creates the buffer of a worker.
+    */
+    shared_ptr<workload_record_buffer> add_buffer()
+    {
+      shared_ptr<workload_record_buffer> buffer(new workload_record_buffer());
+      mutex::scoped_lock lock(m_mutex);
+      m_buffers.push_back(buffer);
+      return buffer;
+    }
+
+    /*! Encodes tasks and writes them to the file.
+    */
+    void write(std::vector<recorded_task> const & tasks)
+    {
+      mutex::scoped_lock lock(m_mutex);
+      encode(tasks);
+    }
+
+    /*! Writes the tasks of all buffers and closes the file.
+    */
+    void close()
+    {
+      mutex::scoped_lock lock(m_mutex);
+      if(!m_file)
+      {
+        return;
+      }
+      std::vector<recorded_task> tasks;
+      for(std::vector<shared_ptr<workload_record_buffer> >::const_iterator it = m_buffers.begin(); it != m_buffers.end(); ++it)
+      {
+        (*it)->drain(tasks);
+      }
+      encode(tasks);
+      std::fclose(m_file);
+      m_file = 0;
+    }
+
+  private:
+    void encode(std::vector<recorded_task> const & tasks)
+    {
+      if(!m_file)
+      {
+        return;
+      }
+      m_out.clear();
+      for(std::vector<recorded_task>::const_iterator it = tasks.begin(); it != tasks.end(); ++it)
+      {
+        uint32_t tag_index = 0;
+        if(!it->tag.empty())
+        {
+          std::map<task_tag, uint32_t>::const_iterator const known = m_tag_indices.find(it->tag);
+          if(known != m_tag_indices.end())
+          {
+            tag_index = known->second;
+          }
+          else
+          {
+            tag_index = static_cast<uint32_t>(m_tag_indices.size() + 1);
+            m_tag_indices[it->tag] = tag_index;
+            put(workload_record_tag);
+            put(tag_index);
+            if(it->tag.name())
+            {
+              std::size_t const length = (std::min)(std::strlen(it->tag.name()), workload_record_max_tag_length);
+              put(1);
+              put(length);
+              m_out.insert(m_out.end(), it->tag.name(), it->tag.name() + length);
+            }
+            else
+            {
+              put(0);
+              put(it->tag.id());
+            }
+          }
+        }
+
+        put(workload_record_task);
+        put_signed(it->arrival - m_last_arrival);
+        m_last_arrival = it->arrival;
+        put(tag_index);
+        put(it->queue_wait > 0 ? it->queue_wait : 0);
+        put(it->run > 0 ? it->run : 0);
+      }
+      if(!m_out.empty())
+      {
+        std::fwrite(&m_out[0], 1, m_out.size(), m_file);
+      }
+    }
+
+    void put(uint64_t value)
+    {
+      while(value >= 0x80)
+      {
+        m_out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+      }
+      m_out.push_back(static_cast<unsigned char>(value));
+    }
+
+    void put_signed(int64_t const value)
+    {
+      put((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+  };
+
+
+
+  /*! \brief Decodes a workload file.
+  *
+  * Names of tags point into strings owned by the reader.
+  */
+  class workload_reader
+    : private noncopyable
+  {
+    std::FILE * m_file;
+    bool m_valid;
+    int64_t m_last_arrival;
+    std::deque<std::string> m_names;
+    std::vector<task_tag> m_tags;
+
+  public:
+    explicit workload_reader(char const * const path)
+      : m_file(std::fopen(path, "rb"))
+      , m_valid(false)
+      , m_last_arrival(0)
+    {
+      m_tags.push_back(task_tag());
+      unsigned char header[8];
+      if(m_file && std::fread(header, 1, sizeof(header), m_file) == sizeof(header))
+      {
+        uint32_t version = 0;
+        for(int i = 0; i < 4; ++i)
+        {
+          version |= static_cast<uint32_t>(header[4 + i]) << (8 * i);
+        }
+        m_valid = std::memcmp(header, workload_record_magic, 4) == 0 && version == workload_record_version;
+      }
+    }
+
+    ~workload_reader()
+    {
+      if(m_file)
+      {
+        std::fclose(m_file);
+      }
+    }
+
+    /*! Checks if the file exists and has a known format.
+    */
+    bool valid() const
+    {
+      return m_valid;
+    }
+
+    /*! Reads the next task.
+    * \return false at the end of the file or if it is corrupt.
+    */
+    bool next(recorded_task & task)
+    {
+      uint64_t kind;
+      while(m_valid && get(kind))
+      {
+        if(kind == workload_record_tag)
+        {
+          uint64_t index, is_name, value;
+          if(!get(index) || !get(is_name) || !get(value) || index != m_tags.size())
+          {
+            break;
+          }
+          if(is_name)
+          {
+            if(value > workload_record_max_tag_length)
+            {
+              break;
+            }
+            std::string name(static_cast<std::size_t>(value), '\0');
+            if(value > 0 && std::fread(&name[0], 1, name.size(), m_file) != name.size())
+            {
+              break;
+            }
+            m_names.push_back(name);
+            m_tags.push_back(task_tag(m_names.back().c_str()));
+          }
+          else
+          {
+            m_tags.push_back(task_tag(static_cast<unsigned int>(value)));
+          }
+        }
+        else if(kind == workload_record_task)
+        {
+          uint64_t delta, tag_index, queue_wait, run;
+          if(!get(delta) || !get(tag_index) || !get(queue_wait) || !get(run) || tag_index >= m_tags.size())
+          {
+            break;
+          }
+          m_last_arrival += static_cast<int64_t>((delta >> 1) ^ (0 - (delta & 1)));
+          task.arrival = m_last_arrival;
+          task.tag = m_tags[static_cast<std::size_t>(tag_index)];
+          task.queue_wait = static_cast<int64_t>(queue_wait);
+          task.run = static_cast<int64_t>(run);
+          return true;
+        }
+        else
+        {
+          break;
+        }
+      }
+      m_valid = false;
+      return false;
+    }
+
+  private:
+    bool get(uint64_t & value)
+    {
+      value = 0;
+      for(int shift = 0; shift < 64; shift += 7)
+      {
+        int const c = std::fgetc(m_file);
+        if(c == EOF)
+        {
+          return false;
+        }
+        value |= static_cast<uint64_t>(c & 0x7f) << shift;
+        if(!(c & 0x80))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+  };
+
+
+} } } // namespace boost::threadpool::detail
+
+#endif // THREADPOOL_DETAIL_WORKLOAD_RECORD_HPP_INCLUDED
@@ -0,0 +1,789 @@
+/*! \file
+* \brief Sender/receiver adapter in the style of std::execution (P2300).
+*
+* get_scheduler(pool) returns a scheduler whose schedule() is a sender that
+* completes on a worker of the pool. then, bulk and when_all compose senders
+* into pipelines, sync_wait runs a pipeline and waits for its result.
+*
+* An operation state is created by connect(sender, receiver) and owns all
+* state of the pipeline, so starting it allocates nothing besides the queue
+* entries: the tasks which are scheduled point to the operation state. bulk
+* adds its whole fan-out with one schedule_bulk call.
+*
+* A receiver is a class with the members set_value(values...),
+* set_error(std::exception_ptr) and set_stopped(). Each sender declares the
+* values it sends as value_types, a std::tuple. Adaptors report exceptions of
+* their own functions to set_error, receivers must not throw.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_EXECUTION_HPP_INCLUDED
+#define THREADPOOL_EXECUTION_HPP_INCLUDED
+
+#if __cplusplus < 201703L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#error "boost/threadpool/execution.hpp requires C++17"
+#endif
+
+#include <boost/threadpool/task_adaptors.hpp>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+
+namespace boost { namespace threadpool { namespace execution
+{
+
+  template <typename Pool>
+  class pool_scheduler;
+
+
+  namespace detail
+  {
+    /*! \brief Values sent by then: nothing if the function returns void, else its result.
+    */
+    template <typename F, typename Values>
+    struct then_values;
+
+    template <typename F, typename... Ts>
+    struct then_values<F, std::tuple<Ts...> >
+    {
+      typedef std::decay_t<std::invoke_result_t<F &, Ts...> > result_type;
+      typedef std::conditional_t<std::is_void_v<result_type>, std::tuple<>, std::tuple<result_type> > type;
+    };
+
+    /*! \brief Values sent by when_all: the values of all senders in order.
+    */
+    template <typename... Values>
+    struct concat_values
+    {
+      typedef decltype(std::tuple_cat(std::declval<Values>()...)) type;
+    };
+
+
+
+    /*! \brief Operation state of schedule: enqueues one task which completes the receiver on a worker.
+    */
+    template <typename Pool, typename Receiver>
+    class schedule_operation
+      : private noncopyable
+    {
+      Pool * m_pool;
+      Receiver m_receiver;
+
+    public:
+      schedule_operation(Pool & pool, Receiver receiver)
+        : m_pool(&pool)
+        , m_receiver(std::move(receiver))
+      {
+      }
+
+      void start()
+      {
+        try
+        {
+          m_pool->schedule(raw_task_func(&run, this));
+        }
+        catch(...)
+        {
+          m_receiver.set_error(std::current_exception());
+        }
+      }
+
+    private:
+      static void run(void * const self)
+      {
+        static_cast<schedule_operation *>(self)->m_receiver.set_value();
+      }
+    };
+
+
+
+    /*! \brief Receiver of then: applies the function to the values and passes its result on.
+    */
+    template <typename F, typename Receiver>
+    class then_receiver
+    {
+      F m_function;
+      Receiver m_receiver;
+
+    public:
+      then_receiver(F const & function, Receiver receiver)
+        : m_function(function)
+        , m_receiver(std::move(receiver))
+      {
+      }
+
+      template <typename... Ts>
+      void set_value(Ts &&... values)
+      {
+        typedef std::invoke_result_t<F &, Ts...> result_type;
+        if constexpr(std::is_void_v<result_type>)
+        {
+          try
+          {
+            std::invoke(m_function, std::forward<Ts>(values)...);
+          }
+          catch(...)
+          {
+            m_receiver.set_error(std::current_exception());
+            return;
+          }
+          m_receiver.set_value();
+        }
+        else
+        {
+          std::optional<std::decay_t<result_type> > result;
+          try
+          {
+            result.emplace(std::invoke(m_function, std::forward<Ts>(values)...));
+          }
+          catch(...)
+          {
+            m_receiver.set_error(std::current_exception());
+            return;
+          }
+          m_receiver.set_value(std::move(*result));
+        }
+      }
+
+      void set_error(std::exception_ptr const & error)
+      {
+        m_receiver.set_error(error);
+      }
+
+      void set_stopped()
+      {
+        m_receiver.set_stopped();
+      }
+    };
+
+
+
+    template <typename Operation>
+    class bulk_receiver
+    {
+      Operation * m_operation;
+
+    public:
+      explicit bulk_receiver(Operation * const operation)
+        : m_operation(operation)
+      {
+      }
+
+      template <typename... Ts>
+      void set_value(Ts &&... values)
+      {
+        m_operation->fan_out(std::forward<Ts>(values)...);
+      }
+
+      void set_error(std::exception_ptr const & error)
+      {
+        m_operation->receiver().set_error(error);
+      }
+
+      void set_stopped()
+      {
+        m_operation->receiver().set_stopped();
+      }
+    };
+
+    /*! \brief Operation state of bulk.
+    *
+    * When the predecessor completed, its values are kept here and one batch
+    * of shape identical tasks is enqueued. Each task takes the next index,
+    * the last one to finish completes the receiver.
+    */
+    template <typename Sender, typename Shape, typename F, typename Receiver>
+    class bulk_operation
+      : private noncopyable
+    {
+      typedef typename Sender::value_types values_type;
+      typedef decltype(std::declval<Sender const &>().completion_scheduler()) scheduler_type;
+      typedef decltype(std::declval<Sender const &>().connect(std::declval<bulk_receiver<bulk_operation> >())) inner_type;
+
+      scheduler_type m_scheduler;
+      Shape m_shape;
+      F m_function;
+      Receiver m_receiver;
+      std::optional<values_type> m_values;
+      std::atomic<std::size_t> m_next;          //!< Index the next task takes.
+      std::atomic<std::size_t> m_remaining;     //!< Tasks which did not finish yet.
+      std::atomic<bool> m_failed;
+      std::exception_ptr m_error;               //!< First exception of the function, written by the task which set m_failed.
+      inner_type m_inner;                       //!< Refers to this, so it is constructed last.
+
+    public:
+      bulk_operation(Sender const & sender, Shape const shape, F const & function, Receiver receiver)
+        : m_scheduler(sender.completion_scheduler())
+        , m_shape(shape)
+        , m_function(function)
+        , m_receiver(std::move(receiver))
+        , m_next(0)
+        , m_remaining(0)
+        , m_failed(false)
+        , m_inner(sender.connect(bulk_receiver<bulk_operation>(this)))
+      {
+      }
+
+      void start()
+      {
+        m_inner.start();
+      }
+
+      Receiver & receiver()
+      {
+        return m_receiver;
+      }
+
+      template <typename... Ts>
+      void fan_out(Ts &&... values)
+      {
+        m_values.emplace(std::forward<Ts>(values)...);
+        std::size_t const count = static_cast<std::size_t>(m_shape);
+        if(count == 0)
+        {
+          complete();
+          return;
+        }
+        m_remaining.store(count, std::memory_order_relaxed);
+        try
+        {
+          m_scheduler.pool().schedule_bulk(raw_task_func(&run, this), count);
+        }
+        catch(...)
+        {
+          m_receiver.set_error(std::current_exception());
+        }
+      }
+
+    private:
+      static void run(void * const self)
+      {
+        bulk_operation * const op = static_cast<bulk_operation *>(self);
+        Shape const index = static_cast<Shape>(op->m_next.fetch_add(1, std::memory_order_relaxed));
+        if(!op->m_failed.load(std::memory_order_relaxed))
+        {
+          try
+          {
+            std::apply([op, index](auto &... values) { std::invoke(op->m_function, index, values...); }, *op->m_values);
+          }
+          catch(...)
+          {
+            if(!op->m_failed.exchange(true))
+            {
+              op->m_error = std::current_exception();
+            }
+          }
+        }
+        if(op->m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+          op->complete();
+        }
+      }
+
+      void complete()
+      {
+        if(m_failed.load(std::memory_order_relaxed))
+        {
+          m_receiver.set_error(m_error);
+          return;
+        }
+        std::apply([this](auto &... values) { m_receiver.set_value(std::move(values)...); }, *m_values);
+      }
+    };
+
+
+
+    template <std::size_t I, typename Operation>
+    class when_all_receiver
+    {
+      Operation * m_operation;
+
+    public:
+      explicit when_all_receiver(Operation * const operation)
+        : m_operation(operation)
+      {
+      }
+
+      template <typename... Ts>
+      void set_value(Ts &&... values)
+      {
+        m_operation->template value<I>(std::forward<Ts>(values)...);
+      }
+
+      void set_error(std::exception_ptr const & error)
+      {
+        m_operation->error(error);
+      }
+
+      void set_stopped()
+      {
+        m_operation->stopped();
+      }
+    };
+
+    /*! \brief Operation states of the senders of when_all.
+    * They are not movable, hence a recursive structure instead of a tuple.
+    */
+    template <std::size_t I, typename Operation, typename Senders, std::size_t N = std::tuple_size<Senders>::value>
+    class when_all_children
+    {
+      typedef std::tuple_element_t<I, Senders> sender_type;
+      typedef decltype(std::declval<sender_type const &>().connect(std::declval<when_all_receiver<I, Operation> >())) inner_type;
+
+      inner_type m_inner;
+      when_all_children<I + 1, Operation, Senders, N> m_rest;
+
+    public:
+      when_all_children(Senders const & senders, Operation * const operation)
+        : m_inner(std::get<I>(senders).connect(when_all_receiver<I, Operation>(operation)))
+        , m_rest(senders, operation)
+      {
+      }
+
+      void start()
+      {
+        m_inner.start();
+        m_rest.start();
+      }
+    };
+
+    template <std::size_t N, typename Operation, typename Senders>
+    class when_all_children<N, Operation, Senders, N>
+    {
+    public:
+      when_all_children(Senders const &, Operation * const)
+      {
+      }
+
+      void start()
+      {
+      }
+    };
+
+    /*! \brief Operation state of when_all.
+    *
+    * Completes when all senders completed: with their values, or with the
+    * first error or stop. Senders which are still running are not cancelled.
+    */
+    template <typename Receiver, typename... Senders>
+    class when_all_operation
+      : private noncopyable
+    {
+      enum state
+      {
+        state_values,
+        state_error,
+        state_stopped
+      };
+
+      typedef std::tuple<Senders...> senders_type;
+
+      Receiver m_receiver;
+      std::tuple<std::optional<typename Senders::value_types>...> m_values;
+      std::atomic<std::size_t> m_remaining;
+      std::atomic<int> m_state;
+      std::exception_ptr m_error;             //!< Written by the sender which left state_values.
+      when_all_children<0, when_all_operation, senders_type> m_children;
+
+    public:
+      when_all_operation(senders_type const & senders, Receiver receiver)
+        : m_receiver(std::move(receiver))
+        , m_remaining(0)
+        , m_state(state_values)
+        , m_children(senders, this)
+      {
+      }
+
+      void start()
+      {
+        // one extra count keeps the operation alive until all senders are started
+        m_remaining.store(sizeof...(Senders) + 1, std::memory_order_relaxed);
+        m_children.start();
+        done();
+      }
+
+      template <std::size_t I, typename... Ts>
+      void value(Ts &&... values)
+      {
+        std::get<I>(m_values).emplace(std::forward<Ts>(values)...);
+        done();
+      }
+
+      void error(std::exception_ptr const & error)
+      {
+        int expected = state_values;
+        if(m_state.compare_exchange_strong(expected, state_error))
+        {
+          m_error = error;
+        }
+        done();
+      }
+
+      void stopped()
+      {
+        int expected = state_values;
+        m_state.compare_exchange_strong(expected, state_stopped);
+        done();
+      }
+
+    private:
+      void done()
+      {
+        if(m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+          complete();
+        }
+      }
+
+      void complete()
+      {
+        switch(m_state.load(std::memory_order_relaxed))
+        {
+        case state_error:
+          m_receiver.set_error(m_error);
+          break;
+        case state_stopped:
+          m_receiver.set_stopped();
+          break;
+        default:
+          std::apply([this](auto &&... values) { m_receiver.set_value(std::move(values)...); },
+            std::apply([](auto &... slots) { return std::tuple_cat(std::move(*slots)...); }, m_values));
+          break;
+        }
+      }
+    };
+
+
+
+    template <typename Values>
+    struct sync_wait_state
+    {
+      mutex m_mutex;
+      condition_variable m_done_event;
+      bool m_done;
+      std::optional<Values> m_values;
+      std::exception_ptr m_error;
+
+      sync_wait_state()
+        : m_done(false)
+      {
+      }
+    };
+
+    /*! \brief Receiver of sync_wait. Notifies under the lock, the state lives on the waiter's stack.
+    */
+    template <typename Values>
+    class sync_wait_receiver
+    {
+      sync_wait_state<Values> * m_state;
+
+    public:
+      explicit sync_wait_receiver(sync_wait_state<Values> * const state)
+        : m_state(state)
+      {
+      }
+
+      template <typename... Ts>
+      void set_value(Ts &&... values)
+      {
+        mutex::scoped_lock lock(m_state->m_mutex);
+        m_state->m_values.emplace(std::forward<Ts>(values)...);
+        m_state->m_done = true;
+        m_state->m_done_event.notify_all();
+      }
+
+      void set_error(std::exception_ptr const & error)
+      {
+        mutex::scoped_lock lock(m_state->m_mutex);
+        m_state->m_error = error;
+        m_state->m_done = true;
+        m_state->m_done_event.notify_all();
+      }
+
+      void set_stopped()
+      {
+        mutex::scoped_lock lock(m_state->m_mutex);
+        m_state->m_done = true;
+        m_state->m_done_event.notify_all();
+      }
+    };
+  } // namespace detail
+
+
+
+  /*! \brief Sender which completes on a worker of a pool, without values.
+  */
+  template <typename Pool>
+  class schedule_sender
+  {
+    Pool * m_pool;
+
+  public:
+    typedef std::tuple<> value_types;
+
+    explicit schedule_sender(Pool & pool)
+      : m_pool(&pool)
+    {
+    }
+
+    pool_scheduler<Pool> completion_scheduler() const
+    {
+      return pool_scheduler<Pool>(*m_pool);
+    }
+
+    template <typename Receiver>
+    detail::schedule_operation<Pool, Receiver> connect(Receiver receiver) const
+    {
+      return detail::schedule_operation<Pool, Receiver>(*m_pool, std::move(receiver));
+    }
+  };
+
+
+  /*! \brief Scheduler of a pool.
+  * \param Pool A pool whose tasks are task_func objects and which has schedule_bulk, e.g. fifo_pool or lifo_pool_core.
+  */
+  template <typename Pool>
+  class pool_scheduler
+  {
+    Pool * m_pool;
+
+  public:
+    explicit pool_scheduler(Pool & pool)
+      : m_pool(&pool)
+    {
+    }
+
+    schedule_sender<Pool> schedule() const
+    {
+      return schedule_sender<Pool>(*m_pool);
+    }
+
+    Pool & pool() const
+    {
+      return *m_pool;
+    }
+
+    bool operator==(pool_scheduler const & other) const
+    {
+      return m_pool == other.m_pool;
+    }
+
+    bool operator!=(pool_scheduler const & other) const
+    {
+      return m_pool != other.m_pool;
+    }
+  };
+
+
+  /*! \brief Sender which applies a function to the values of another sender.
+  * The function runs where the other sender completes.
+  */
+  template <typename Sender, typename F>
+  class then_sender
+  {
+    Sender m_sender;
+    F m_function;
+
+  public:
+    typedef typename detail::then_values<F, typename Sender::value_types>::type value_types;
+
+    then_sender(Sender const & sender, F const & function)
+      : m_sender(sender)
+      , m_function(function)
+    {
+    }
+
+    auto completion_scheduler() const
+    {
+      return m_sender.completion_scheduler();
+    }
+
+    template <typename Receiver>
+    auto connect(Receiver receiver) const
+    {
+      return m_sender.connect(detail::then_receiver<F, Receiver>(m_function, std::move(receiver)));
+    }
+  };
+
+
+  /*! \brief Sender which calls a function shape times in parallel on the pool the other sender completes on.
+  * The function gets the index and the values of the other sender, which are passed on when all calls finished.
+  */
+  template <typename Sender, typename Shape, typename F>
+  class bulk_sender
+  {
+    Sender m_sender;
+    Shape m_shape;
+    F m_function;
+
+  public:
+    typedef typename Sender::value_types value_types;
+
+    bulk_sender(Sender const & sender, Shape const shape, F const & function)
+      : m_sender(sender)
+      , m_shape(shape)
+      , m_function(function)
+    {
+    }
+
+    auto completion_scheduler() const
+    {
+      return m_sender.completion_scheduler();
+    }
+
+    template <typename Receiver>
+    detail::bulk_operation<Sender, Shape, F, Receiver> connect(Receiver receiver) const
+    {
+      return detail::bulk_operation<Sender, Shape, F, Receiver>(m_sender, m_shape, m_function, std::move(receiver));
+    }
+  };
+
+
+  /*! \brief Sender which completes when all senders completed, with all their values.
+  */
+  template <typename... Senders>
+  class when_all_sender
+  {
+    std::tuple<Senders...> m_senders;
+
+  public:
+    typedef typename detail::concat_values<typename Senders::value_types...>::type value_types;
+
+    explicit when_all_sender(Senders const &... senders)
+      : m_senders(senders...)
+    {
+    }
+
+    template <typename Receiver>
+    detail::when_all_operation<Receiver, Senders...> connect(Receiver receiver) const
+    {
+      return detail::when_all_operation<Receiver, Senders...>(m_senders, std::move(receiver));
+    }
+  };
+
+
+
+  template <typename F>
+  struct then_closure
+  {
+    F function;
+  };
+
+  template <typename Shape, typename F>
+  struct bulk_closure
+  {
+    Shape shape;
+    F function;
+  };
+
+
+  template <typename Pool>
+  pool_scheduler<Pool> get_scheduler(Pool & pool)
+  {
+    return pool_scheduler<Pool>(pool);
+  }
+
+  template <typename Pool>
+  schedule_sender<Pool> schedule(pool_scheduler<Pool> const & scheduler)
+  {
+    return scheduler.schedule();
+  }
+
+  template <typename Sender, typename Receiver>
+  auto connect(Sender const & sender, Receiver receiver)
+  {
+    return sender.connect(std::move(receiver));
+  }
+
+  template <typename Sender, typename F>
+  then_sender<Sender, F> then(Sender const & sender, F const & function)
+  {
+    return then_sender<Sender, F>(sender, function);
+  }
+
+  template <typename F>
+  then_closure<F> then(F const & function)
+  {
+    then_closure<F> const closure = { function };
+    return closure;
+  }
+
+  template <typename Sender, typename Shape, typename F>
+  bulk_sender<Sender, Shape, F> bulk(Sender const & sender, Shape const shape, F const & function)
+  {
+    return bulk_sender<Sender, Shape, F>(sender, shape, function);
+  }
+
+  template <typename Shape, typename F>
+  bulk_closure<Shape, F> bulk(Shape const shape, F const & function)
+  {
+    bulk_closure<Shape, F> const closure = { shape, function };
+    return closure;
+  }
+
+  template <typename... Senders>
+  when_all_sender<Senders...> when_all(Senders const &... senders)
+  {
+    return when_all_sender<Senders...>(senders...);
+  }
+
+  template <typename Sender, typename F>
+  then_sender<Sender, F> operator|(Sender const & sender, then_closure<F> const & closure)
+  {
+    return then_sender<Sender, F>(sender, closure.function);
+  }
+
+  template <typename Sender, typename Shape, typename F>
+  bulk_sender<Sender, Shape, F> operator|(Sender const & sender, bulk_closure<Shape, F> const & closure)
+  {
+    return bulk_sender<Sender, Shape, F>(sender, closure.shape, closure.function);
+  }
+
+
+  /*! Starts a sender and blocks until it completes. Must not be called on a worker of the pool the sender needs.
+  * \return The sent values, empty if the sender was stopped.
+  * \throws The exception the sender completed with.
+  */
+  template <typename Sender>
+  std::optional<typename Sender::value_types> sync_wait(Sender const & sender)
+  {
+    typedef typename Sender::value_types values_type;
+    detail::sync_wait_state<values_type> state;
+    auto operation = sender.connect(detail::sync_wait_receiver<values_type>(&state));
+    operation.start();
+
+    mutex::scoped_lock lock(state.m_mutex);
+    while(!state.m_done)
+    {
+      state.m_done_event.wait(lock);
+    }
+    if(state.m_error)
+    {
+      std::rethrow_exception(state.m_error);
+    }
+    return std::move(state.m_values);
+  }
+
+
+} } } // namespace boost::threadpool::execution
+
+#endif // THREADPOOL_EXECUTION_HPP_INCLUDED
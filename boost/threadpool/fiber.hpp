@@ -0,0 +1,441 @@
+/*! \file
+* \brief Stackful fibers on pool workers.
+*
+* schedule_fiber runs a task on a fiber, a stack of its own which the pool's
+* workers switch to. When the task waits for a fiber_event or yields, the
+* fiber is suspended instead of the worker thread, and the worker goes on
+* with other tasks. Setting the event schedules the fiber again, it continues
+* on whichever worker takes it. Many blocking-style logical tasks thereby
+* share a few threads.
+*
+* Fiber stacks are taken from a fiber_stack_pool and returned to it when the
+* fiber finished. Built on Boost.Context, link with boost_context.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_FIBER_HPP_INCLUDED
+#define THREADPOOL_FIBER_HPP_INCLUDED
+
+#include <boost/threadpool/task_adaptors.hpp>
+
+#include <boost/context/fiber.hpp>
+#include <boost/context/fixedsize_stack.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <exception>
+#include <memory>
+#include <vector>
+
+
+namespace boost { namespace threadpool
+{
+
+  /*! \brief Cache of fiber stacks.
+  *
+  * Stacks of finished fibers are kept for the next fibers, up to a limit.
+  * The pool is thread-safe and must outlive the fibers which use it.
+  */
+  class fiber_stack_pool
+    : private noncopyable
+  {
+    mutex m_mutex;
+    context::fixedsize_stack m_allocator;
+    std::vector<context::stack_context> m_free;
+    std::size_t m_max_cached;
+
+  public:
+    /*! Constructor.
+    * \param stack_size Bytes per stack.
+    * \param max_cached Number of unused stacks kept.
+    */
+    explicit fiber_stack_pool(std::size_t const stack_size = 64 * 1024, std::size_t const max_cached = 1024)
+      : m_allocator(stack_size)
+      , m_max_cached(max_cached)
+    {
+    }
+
+    ~fiber_stack_pool()
+    {
+      for(std::vector<context::stack_context>::iterator it = m_free.begin(); it != m_free.end(); ++it)
+      {
+        m_allocator.deallocate(*it);
+      }
+    }
+
+    context::stack_context allocate()
+    {
+      {
+        mutex::scoped_lock lock(m_mutex);
+        if(!m_free.empty())
+        {
+          context::stack_context const stack = m_free.back();
+          m_free.pop_back();
+          return stack;
+        }
+      }
+      return m_allocator.allocate();
+    }
+
+    void deallocate(context::stack_context & stack)
+    {
+      {
+        mutex::scoped_lock lock(m_mutex);
+        if(m_free.size() < m_max_cached)
+        {
+          m_free.push_back(stack);
+          return;
+        }
+      }
+      m_allocator.deallocate(stack);
+    }
+
+    /*! Gets the pool used when schedule_fiber is not given one, with 64 KiB stacks.
+    */
+    static fiber_stack_pool & instance()
+    {
+      static fiber_stack_pool pool;
+      return pool;
+    }
+  };
+
+
+  class fiber_event;
+
+  namespace detail
+  {
+    /*! \brief StackAllocator which refers to a fiber_stack_pool.
+    */
+    class fiber_stack_allocator
+    {
+      fiber_stack_pool * m_pool;
+
+    public:
+      explicit fiber_stack_allocator(fiber_stack_pool & pool)
+        : m_pool(&pool)
+      {
+      }
+
+      context::stack_context allocate()
+      {
+        return m_pool->allocate();
+      }
+
+      void deallocate(context::stack_context & stack)
+      {
+        m_pool->deallocate(stack);
+      }
+    };
+
+
+    /*! \brief A task running on a fiber.
+    *
+    * The object is owned by whoever holds it: the pool's queue while it is
+    * scheduled, the worker while it runs and the fiber_event while it waits.
+    * It deletes itself when the task finished.
+    */
+    class fiber_task
+      : private noncopyable
+    {
+      enum suspend_reason
+      {
+        suspended_yield,
+        suspended_wait
+      };
+
+      context::fiber m_fiber;               //!< The task's fiber while it is suspended or scheduled.
+      context::fiber m_worker;              //!< The worker's context while the task's fiber runs.
+      task_func m_task;
+      void * m_pool;
+      void (*m_schedule)(void *, raw_task_func const &);
+      void (*m_reschedule)(void *, raw_task_func const &);
+      suspend_reason m_reason;
+      fiber_event * m_event;                //!< Event the fiber waits for.
+      unsigned long m_generation;           //!< Number of times the event was set when the fiber decided to wait.
+      bool m_finished;
+      std::exception_ptr m_exception;       //!< Exception which escaped the task.
+
+    public:
+      template <typename Pool>
+      fiber_task(Pool & pool, task_func const & task, fiber_stack_pool & stacks)
+        : m_task(task)
+        , m_pool(&pool)
+        , m_schedule(&schedule_on<Pool>)
+        , m_reschedule(&reschedule_on<Pool>)
+        , m_reason(suspended_yield)
+        , m_event(0)
+        , m_generation(0)
+        , m_finished(false)
+      {
+        m_fiber = context::fiber(std::allocator_arg, fiber_stack_allocator(stacks), entry(this));
+      }
+
+      /*! Gets the fiber task which the calling thread runs, 0 if it is not a fiber.
+      */
+      static fiber_task *& current()
+      {
+        static thread_local fiber_task * running = 0;
+        return running;
+      }
+
+      /*! Schedules the task on its pool, to start or continue it.
+      */
+      void schedule()
+      {
+        m_schedule(m_pool, raw_task_func(&run, this));
+      }
+
+      /*! Queues the task behind the others, to continue it after a yield.
+      */
+      void reschedule()
+      {
+        m_reschedule(m_pool, raw_task_func(&run, this));
+      }
+
+      /*! Suspends the calling fiber, the worker reschedules it.
+      */
+      void yield()
+      {
+        m_reason = suspended_yield;
+        m_worker = std::move(m_worker).resume();
+      }
+
+      /*! Suspends the calling fiber, the worker hands it to the event.
+      */
+      void wait(fiber_event & event, unsigned long const generation)
+      {
+        m_reason = suspended_wait;
+        m_event = &event;
+        m_generation = generation;
+        m_worker = std::move(m_worker).resume();
+      }
+
+    private:
+      struct entry
+      {
+        fiber_task * task;
+
+        explicit entry(fiber_task * const t)
+          : task(t)
+        {
+        }
+
+        context::fiber operator()(context::fiber && worker) const
+        {
+          task->m_worker = std::move(worker);
+          try
+          {
+            task->m_task();
+          }
+          catch(context::detail::forced_unwind const &)
+          {
+            throw;
+          }
+          catch(...)
+          {
+            task->m_exception = std::current_exception();
+          }
+          task->m_finished = true;
+          return std::move(task->m_worker);
+        }
+      };
+
+      template <typename Pool>
+      static void schedule_on(void * const pool, raw_task_func const & task)
+      {
+        static_cast<Pool *>(pool)->schedule(task);
+      }
+
+      template <typename Pool>
+      static void reschedule_on(void * const pool, raw_task_func const & task)
+      {
+        static_cast<Pool *>(pool)->reschedule(task);
+      }
+
+      /*! Switches to the fiber on a worker until it suspends or finishes.
+      * A suspended fiber is published only here, after its stack was left,
+      * so no other worker resumes it while it is still running.
+      */
+      static void run(void * const self)
+      {
+        fiber_task * const task = static_cast<fiber_task *>(self);
+        fiber_task * const outer = current();
+        current() = task;
+        task->m_fiber = std::move(task->m_fiber).resume();
+        current() = outer;
+
+        if(task->m_finished)
+        {
+          std::exception_ptr const exception = task->m_exception;
+          delete task;
+          if(exception)
+          {
+            std::rethrow_exception(exception);
+          }
+        }
+        else if(task->m_reason == suspended_wait)
+        {
+          task->park();
+        }
+        else
+        {
+          task->reschedule();
+        }
+      }
+
+      void park();
+    };
+  } // namespace detail
+
+
+
+  /*! \brief Manual-reset event for fibers and threads.
+  *
+  * A fiber which waits for the event is suspended and its worker runs other
+  * tasks, a thread which is not a fiber blocks. set wakes all waiters and
+  * keeps the event set until reset.
+  */
+  class fiber_event
+    : private noncopyable
+  {
+    mutex m_mutex;
+    condition_variable m_set_event;
+    bool m_set;
+    unsigned long m_generation;             //!< Number of calls to set.
+    std::vector<detail::fiber_task *> m_waiters;
+
+    friend class detail::fiber_task;
+
+  public:
+    fiber_event()
+      : m_set(false)
+      , m_generation(0)
+    {
+    }
+
+    void set()
+    {
+      std::vector<detail::fiber_task *> waiters;
+      {
+        mutex::scoped_lock lock(m_mutex);
+        m_set = true;
+        ++m_generation;
+        waiters.swap(m_waiters);
+        m_set_event.notify_all();
+      }
+      for(std::vector<detail::fiber_task *>::iterator it = waiters.begin(); it != waiters.end(); ++it)
+      {
+        (*it)->schedule();
+      }
+    }
+
+    void reset()
+    {
+      mutex::scoped_lock lock(m_mutex);
+      m_set = false;
+    }
+
+    bool is_set()
+    {
+      mutex::scoped_lock lock(m_mutex);
+      return m_set;
+    }
+
+    /*! Waits until the event is set, suspending the fiber if called on one.
+    */
+    void wait()
+    {
+      detail::fiber_task * const task = detail::fiber_task::current();
+      mutex::scoped_lock lock(m_mutex);
+      if(task == 0)
+      {
+        while(!m_set)
+        {
+          m_set_event.wait(lock);
+        }
+        return;
+      }
+      if(!m_set)
+      {
+        unsigned long const generation = m_generation;
+        lock.unlock();
+        task->wait(*this, generation);
+      }
+    }
+
+  private:
+    /*! Takes a fiber which suspended in wait, or schedules it again if the event was set meanwhile.
+    */
+    void park(detail::fiber_task * const task, unsigned long const generation)
+    {
+      {
+        mutex::scoped_lock lock(m_mutex);
+        if(m_generation == generation)
+        {
+          m_waiters.push_back(task);
+          return;
+        }
+      }
+      task->schedule();
+    }
+  };
+
+  inline void detail::fiber_task::park()
+  {
+    m_event->park(this, m_generation);
+  }
+
+
+
+  /*! Runs a task on a fiber of a pool.
+  * \param pool A pool whose tasks are task_func objects, e.g. fifo_pool or lifo_pool_core.
+  * \param task The task. It may wait for fiber_events or call this_fiber::yield without blocking its worker.
+  * \param stacks The cache the fiber's stack is taken from.
+  */
+  template <typename Pool>
+  void schedule_fiber(Pool & pool, task_func const & task, fiber_stack_pool & stacks = fiber_stack_pool::instance())
+  {
+    (new detail::fiber_task(pool, task, stacks))->schedule();
+  }
+
+
+  namespace this_fiber
+  {
+    /*! Checks if the calling code runs on a fiber.
+    */
+    inline bool running()
+    {
+      return detail::fiber_task::current() != 0;
+    }
+
+    /*! Lets the worker run other tasks before the calling fiber continues.
+    * Yields the thread if the caller is not a fiber.
+    */
+    inline void yield()
+    {
+      detail::fiber_task * const task = detail::fiber_task::current();
+      if(task)
+      {
+        task->yield();
+      }
+      else
+      {
+        this_thread::yield();
+      }
+    }
+  } // namespace this_fiber
+
+
+} } // namespace boost::threadpool
+
+#endif // THREADPOOL_FIBER_HPP_INCLUDED
@@ -0,0 +1,301 @@
+/*! \file
+* \brief Pipeline of stages with a bounded number of items in flight.
+*
+* An input function produces items which pass through a sequence of stages.
+* Parallel stages process any number of items at once, serial stages one
+* at a time, either in input order or in any order. Each item travels on a
+* token; the number of tokens bounds the items in flight and with them the
+* memory held by the pipeline.
+*
+* A token is a pool task which carries its item through the stages. When a
+* serial stage is busy, or an in-order stage expects an earlier item, the
+* token is parked in the stage and its worker goes on with other tasks. The
+* item leaving the stage schedules the next parked token. Parking needs no
+* queue per stage: a serial stage keeps a fixed ring with one slot per token.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_PIPELINE_HPP_INCLUDED
+#define THREADPOOL_PIPELINE_HPP_INCLUDED
+
+#include <boost/threadpool/task_adaptors.hpp>
+
+#include <boost/assert.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstddef>
+#include <vector>
+
+
+namespace boost { namespace threadpool
+{
+
+  //! \brief how a pipeline stage processes items
+  enum stage_mode
+  {
+    stage_parallel,             //!< any number of items at once
+    stage_serial_in_order,      //!< one item at a time, in the order the input produced them
+    stage_serial_out_of_order   //!< one item at a time, in any order
+  };
+
+
+  /*! \brief Pipeline executed by the workers of a pool.
+  *
+  * The stages transform an item in place. Items are default constructed
+  * once per token and reused, so the input has to assign all their state.
+  * Stages must not be added while the pipeline runs. Stages must not throw.
+  *
+  * \param Pool A pool whose tasks are task_func objects, e.g. fifo_pool or lifo_pool_core.
+  * \param Item The type of the items.
+  */
+  template <typename Pool, typename Item>
+  class pipeline
+    : private noncopyable
+  {
+  public:
+    typedef function1<bool, Item &> input_func;   //!< Fills the item, returns false when the input is exhausted.
+    typedef function1<void, Item &> stage_func;
+
+  private:
+    struct token
+    {
+      pipeline * owner;
+      Item item;
+      std::size_t sequence;     //!< Position of the item in input order.
+      std::size_t stage;        //!< Index of the stage the item is at.
+      bool admitted;            //!< The serial stage was handed over to this token while it was parked.
+    };
+
+    struct stage
+    {
+      stage_mode mode;
+      stage_func function;
+      mutex guard;
+      bool busy;                      //!< A serial stage processes an item.
+      std::size_t next_sequence;      //!< Item an in-order stage takes next.
+      std::vector<token *> parked;    //!< One slot per token: by sequence for in-order stages, a ring otherwise.
+      std::size_t head;               //!< First parked token of an out-of-order stage.
+      std::size_t count;              //!< Parked tokens of an out-of-order stage.
+    };
+
+    Pool & m_pool;
+    std::vector<token> m_tokens;
+    std::vector<shared_ptr<stage> > m_stages;
+    input_func m_input;
+
+    mutex m_input_mutex;
+    bool m_input_done;                //!< Protected by m_input_mutex.
+    std::size_t m_next_sequence;      //!< Protected by m_input_mutex.
+
+    mutex m_mutex;
+    condition_variable m_done_event;
+    std::size_t m_active_tokens;      //!< Protected by m_mutex.
+
+  public:
+    /*! Constructor.
+    * \param max_tokens Number of items in flight at most.
+    */
+    pipeline(Pool & pool, std::size_t const max_tokens)
+      : m_pool(pool)
+      , m_tokens(max_tokens)
+      , m_input_done(false)
+      , m_next_sequence(0)
+      , m_active_tokens(0)
+    {
+      BOOST_ASSERT(max_tokens > 0);
+      for(std::size_t i = 0; i < m_tokens.size(); ++i)
+      {
+        m_tokens[i].owner = this;
+      }
+    }
+
+    /*! Sets the input. It is called by one thread at a time.
+    */
+    void set_input(input_func const & input)
+    {
+      m_input = input;
+    }
+
+    /*! Appends a stage.
+    */
+    void add_stage(stage_mode const mode, stage_func const & function)
+    {
+      shared_ptr<stage> s(new stage());
+      s->mode = mode;
+      s->function = function;
+      s->parked.resize(m_tokens.size());
+      m_stages.push_back(s);
+    }
+
+    /*! Runs the pipeline until the input is exhausted and all items passed all stages.
+    * Must not be called by a worker of the pool, which might be needed for the stages.
+    */
+    void run()
+    {
+      BOOST_ASSERT(m_input);
+      m_input_done = false;
+      m_next_sequence = 0;
+      for(std::size_t i = 0; i < m_stages.size(); ++i)
+      {
+        stage & s = *m_stages[i];
+        s.busy = false;
+        s.next_sequence = 0;
+        s.head = 0;
+        s.count = 0;
+      }
+
+      m_active_tokens = m_tokens.size();
+      for(std::size_t i = 0; i < m_tokens.size(); ++i)
+      {
+        m_tokens[i].stage = 0;
+        m_tokens[i].admitted = false;
+        m_pool.schedule(raw_task_func(&process, &m_tokens[i]));
+      }
+
+      mutex::scoped_lock lock(m_mutex);
+      while(m_active_tokens > 0)
+      {
+        m_done_event.wait(lock);
+      }
+    }
+
+  private:
+    /*! Carries the token's item through the stages, then fetches the next item, until the token is parked or the input is exhausted.
+    */
+    static void process(void * const p)
+    {
+      token & t = *static_cast<token *>(p);
+      pipeline & owner = *t.owner;
+      while(true)
+      {
+        if(!t.admitted && t.stage == 0 && !owner.fetch(t))
+        {
+          owner.retire();
+          return;
+        }
+        while(t.stage < owner.m_stages.size())
+        {
+          stage & s = *owner.m_stages[t.stage];
+          if(s.mode == stage_parallel)
+          {
+            s.function(t.item);
+            ++t.stage;
+            continue;
+          }
+          if(t.admitted)
+          {
+            t.admitted = false;
+          }
+          else if(!enter(s, t))
+          {
+            return;
+          }
+          s.function(t.item);
+          if(token * const next = leave(s))
+          {
+            owner.m_pool.schedule(raw_task_func(&process, next));
+          }
+          ++t.stage;
+        }
+        t.stage = 0;
+      }
+    }
+
+    bool fetch(token & t)
+    {
+      mutex::scoped_lock lock(m_input_mutex);
+      if(m_input_done || !m_input(t.item))
+      {
+        m_input_done = true;
+        return false;
+      }
+      t.sequence = m_next_sequence++;
+      return true;
+    }
+
+    void retire()
+    {
+      mutex::scoped_lock lock(m_mutex);
+      if(--m_active_tokens == 0)
+      {
+        m_done_event.notify_all();
+      }
+    }
+
+    /*! Enters a serial stage or parks the token in it.
+    */
+    static bool enter(stage & s, token & t)
+    {
+      mutex::scoped_lock lock(s.guard);
+      bool const turn = s.mode == stage_serial_out_of_order || t.sequence == s.next_sequence;
+      if(!s.busy && turn)
+      {
+        s.busy = true;
+        return true;
+      }
+      if(s.mode == stage_serial_in_order)
+      {
+        // tokens in flight have distinct sequences within a window of the token count
+        token * & slot = s.parked[t.sequence % s.parked.size()];
+        BOOST_ASSERT(slot == 0);
+        slot = &t;
+      }
+      else
+      {
+        s.parked[(s.head + s.count) % s.parked.size()] = &t;
+        ++s.count;
+      }
+      return false;
+    }
+
+    /*! Leaves a serial stage.
+    * \return The parked token the stage was handed over to, 0 if none.
+    */
+    static token * leave(stage & s)
+    {
+      mutex::scoped_lock lock(s.guard);
+      token * next = 0;
+      if(s.mode == stage_serial_in_order)
+      {
+        ++s.next_sequence;
+        token * & slot = s.parked[s.next_sequence % s.parked.size()];
+        if(slot != 0 && slot->sequence == s.next_sequence)
+        {
+          next = slot;
+          slot = 0;
+        }
+      }
+      else if(s.count > 0)
+      {
+        next = s.parked[s.head];
+        s.head = (s.head + 1) % s.parked.size();
+        --s.count;
+      }
+      if(next)
+      {
+        next->admitted = true;
+      }
+      else
+      {
+        s.busy = false;
+      }
+      return next;
+    }
+  };
+
+
+} } // namespace boost::threadpool
+
+#endif // THREADPOOL_PIPELINE_HPP_INCLUDED
@@ -8,12 +8,87 @@ namespace boost{ namespace threadpool{
 		core_->resize(initial_threads);
 	}
 
-	void fifo_pool::schedule( task_type const & task )
+	void fifo_pool::schedule( task_type const & task, task_tag const & tag /*= task_tag()*/, std::size_t bytes /*= 0*/ )
 	{
-		core_->schedule(task);
+		core_->schedule(task, tag, bytes);
 		return;
 	}
 
+	schedule_awaitable fifo_pool::schedule()
+	{
+		return schedule_awaitable(*this);
+	}
+
+	void fifo_pool::reschedule( task_type const & task, task_tag const & tag /*= task_tag()*/, std::size_t bytes /*= 0*/ )
+	{
+		core_->reschedule(task, tag, bytes);
+	}
+
+	void fifo_pool::schedule_bulk( task_type const & task, std::size_t count, task_tag const & tag /*= task_tag()*/, std::size_t bytes /*= 0*/ )
+	{
+		core_->schedule_bulk(task, count, tag, bytes);
+	}
+
+	void fifo_pool::schedule_affine( task_type const & task, std::size_t key, task_tag const & tag /*= task_tag()*/, std::size_t bytes /*= 0*/ )
+	{
+		core_->schedule_affine(task, key, tag, bytes);
+	}
+
+	bool fifo_pool::try_schedule( task_type const & task, task_tag const & tag /*= task_tag()*/, std::size_t bytes /*= 0*/ )
+	{
+		return core_->try_schedule(task, tag, bytes);
+	}
+
+	bool fifo_pool::schedule_for( task_type const & task, chrono::nanoseconds const & timeout, task_tag const & tag /*= task_tag()*/, std::size_t bytes /*= 0*/ )
+	{
+		return core_->schedule_for(task, timeout, tag, bytes);
+	}
+
+	bool fifo_pool::try_schedule_within( task_type const & task, chrono::nanoseconds const & budget, task_tag const & tag /*= task_tag()*/, std::size_t bytes /*= 0*/ )
+	{
+		return core_->try_schedule_within(task, budget, tag, bytes);
+	}
+
+	chrono::nanoseconds fifo_pool::predicted_queue_wait() const
+	{
+		return core_->predicted_queue_wait();
+	}
+
+	bool fifo_pool::set_queue_limits( int max_tasks, std::size_t max_bytes /*= 0*/ )
+	{
+		return core_->set_queue_limits(max_tasks, max_bytes);
+	}
+
+	void fifo_pool::set_overflow_policy( overflow_policy policy )
+	{
+		core_->set_overflow_policy(policy);
+	}
+
+	void fifo_pool::set_affinity_limit( int limit )
+	{
+		core_->set_affinity_limit(limit);
+	}
+
+	bool fifo_pool::set_submission_shards( std::size_t count )
+	{
+		return core_->set_submission_shards(count);
+	}
+
+	void fifo_pool::set_run_next_limit( int limit, chrono::nanoseconds const & steal_after /*= chrono::milliseconds(1)*/ )
+	{
+		core_->set_run_next_limit(limit, steal_after);
+	}
+
+	void fifo_pool::set_compensation( int max_workers, chrono::nanoseconds const & stuck_after /*= chrono::nanoseconds(0)*/ )
+	{
+		core_->set_compensation(max_workers, stuck_after);
+	}
+
+	void fifo_pool::reserve_workers( task_tag const & tag, int count, bool exclusive /*= true*/ )
+	{
+		core_->reserve_workers(tag, count, exclusive);
+	}
+
 	int fifo_pool::total_workers_count() const
 	{
 		return core_->total_workers_count();
@@ -33,6 +108,51 @@ namespace boost{ namespace threadpool{
 	{
 		return core_->pending_tasks_count();
 	}
+
+	pool_stats fifo_pool::stats() const
+	{
+		return core_->stats();
+	}
+
+	void fifo_pool::enable_hardware_counters( bool enable /*= true*/ )
+	{
+		core_->enable_hardware_counters(enable);
+	}
+
+	void fifo_pool::enable_tracing( std::size_t events_per_buffer /*= 65536*/ )
+	{
+		core_->enable_tracing(events_per_buffer);
+	}
+
+	void fifo_pool::disable_tracing()
+	{
+		core_->disable_tracing();
+	}
+
+	bool fifo_pool::enable_metrics_export( char const * name )
+	{
+		return core_->enable_metrics_export(name);
+	}
+
+	void fifo_pool::disable_metrics_export()
+	{
+		core_->disable_metrics_export();
+	}
+
+	bool fifo_pool::enable_recording( char const * path )
+	{
+		return core_->enable_recording(path);
+	}
+
+	void fifo_pool::disable_recording()
+	{
+		core_->disable_recording();
+	}
+
+	void fifo_pool::write_chrome_trace( std::ostream & out ) const
+	{
+		core_->write_chrome_trace(out);
+	}
 	
 	//ṩȡΪò
 	/*
@@ -27,6 +27,10 @@
 #include <boost/threadpool/task_adaptors.hpp>
 //#include <boost/threadpool/detail/pool_core.hpp>	//this is hidden as pimpl requires
 #include <boost/threadpool/scheduling_policies.hpp>
+#include <boost/threadpool/pool_stats.hpp>
+
+#include <cstddef>
+#include <iosfwd>
 
 /// The namespace threadpool contains a thread pool and related utility classes.
 namespace boost { namespace threadpool
@@ -41,10 +45,16 @@ namespace boost { namespace threadpool
 
 	typedef detail::pool_core<task_func, lifo_scheduler> lifo_pool_core;
 	typedef detail::pool_core<prio_task_func, prio_scheduler> prio_pool_core;
+	typedef detail::pool_core<prio_task_func, bucket_prio_scheduler> bucket_prio_pool_core;
+	typedef detail::pool_core<prio_task_func, indexed_prio_scheduler> indexed_prio_pool_core;
+	typedef detail::pool_core<task_func, fair_share_scheduler> fair_share_pool_core;
 
 	
 	typedef shared_ptr<lifo_pool_core> lifo_pool_core_ptr;
 	typedef shared_ptr<prio_pool_core> prio_pool_core_ptr;
+	typedef shared_ptr<bucket_prio_pool_core> bucket_prio_pool_core_ptr;
+	typedef shared_ptr<indexed_prio_pool_core> indexed_prio_pool_core_ptr;
+	typedef shared_ptr<fair_share_pool_core> fair_share_pool_core_ptr;
 
 	template <class PoolCore>
 	shared_ptr<PoolCore> make_pool(){
@@ -52,6 +62,16 @@ namespace boost { namespace threadpool
 	};
 
 	struct no_worker{};
+
+	//! \brief what happens to a task which does not fit into a bounded queue
+	enum overflow_policy
+	{
+		overflow_reject,		//!< the new task is rejected
+		overflow_drop_next		//!< the tasks which would run next are dropped until the new task fits, the oldest with fifo_scheduler. Warning: with the priority schedulers the highest priority tasks are dropped first
+	};
+
+  class schedule_awaitable;
+
   class fifo_pool   
   {
   public: // Type definitions
@@ -68,7 +88,67 @@ namespace boost { namespace threadpool
     
     fifo_pool(int initial_threads = 0);
 	  
-	void schedule(task_type const & task);
+	//! \param tag tasks with a non-empty tag are charged their CPU time and hardware counters, see stats()
+	//! \param bytes estimated memory held by the task, charged to the queue's byte capacity
+	//! Blocks while the queue is full, see set_queue_limits.
+	void schedule(task_type const & task, task_tag const & tag = task_tag(), std::size_t bytes = 0);
+
+	//! awaitable for C++20 coroutines: co_await pool.schedule() continues the coroutine on a worker
+	schedule_awaitable schedule();
+
+	//! like schedule, but never into the calling worker's run-next slot, for tasks which yield their worker
+	void reschedule(task_type const & task, task_tag const & tag = task_tag(), std::size_t bytes = 0);
+
+	//! adds count copies of task with one queue operation, for fan-out
+	//! Blocks while the queue is full, the limits are checked once for the batch.
+	void schedule_bulk(task_type const & task, std::size_t count, task_tag const & tag = task_tag(), std::size_t bytes = 0);
+
+	//! runs tasks with the same key on the same worker while it keeps up, for cache locality
+	//! Other workers take the task while its worker is busy, see set_affinity_limit.
+	void schedule_affine(task_type const & task, std::size_t key, task_tag const & tag = task_tag(), std::size_t bytes = 0);
+
+	//! never blocks, applies the overflow policy if the queue is full
+	//! \return false if the task was rejected
+	bool try_schedule(task_type const & task, task_tag const & tag = task_tag(), std::size_t bytes = 0);
+
+	//! waits at most timeout for room in the queue, then applies the overflow policy
+	//! \return false if the task was rejected
+	bool schedule_for(task_type const & task, chrono::nanoseconds const & timeout, task_tag const & tag = task_tag(), std::size_t bytes = 0);
+
+	//! admission control: never blocks, sheds the task if its predicted queue wait exceeds budget
+	//! and drops it at dequeue if it did not start within budget
+	//! \return false if the task was shed or rejected
+	bool try_schedule_within(task_type const & task, chrono::nanoseconds const & budget, task_tag const & tag = task_tag(), std::size_t bytes = 0);
+
+	//! queue wait of a task scheduled now, estimated from queue depth and measured service time
+	chrono::nanoseconds predicted_queue_wait() const;
+
+	//! bound the queue by number of tasks and by estimated bytes, 0 means unlimited
+	//! Returns false if the pool has submission shards, which bypass the limits.
+	bool set_queue_limits(int max_tasks, std::size_t max_bytes = 0);
+
+	void set_overflow_policy(overflow_policy policy);
+
+	//! tasks queued for one worker above which schedule_affine uses the shared queue, 8 by default
+	void set_affinity_limit(int limit);
+
+	//! many producers: schedule adds to one of count queues without taking the pool's lock
+	//! Relaxes the FIFO order between tasks of different producers. Returns false if the pool has shards or queue limits already.
+	bool set_submission_shards(std::size_t count);
+
+	//! message-passing chains: a task scheduled by a task runs next on the same worker,
+	//! at most limit times in a row, 0 disables. Parked workers take it after it waited steal_after.
+	void set_run_next_limit(int limit, chrono::nanoseconds const & steal_after = chrono::milliseconds(1));
+
+	//! adds up to max_workers workers while tasks block in a blocking_region
+	//! or run one task longer than stuck_after, 0 disables the detection.
+	//! Retired workers stay parked for the next blocking region.
+	void set_compensation(int max_workers, chrono::nanoseconds const & stuck_after = chrono::nanoseconds(0));
+
+	//! dedicate count workers to the tasks tagged with tag, they run before all other tasks
+	//! \param exclusive if false the reserved workers also run other tasks while tag has none queued
+	//! \remarks an empty tag cancels the reservation
+	void reserve_workers(task_tag const & tag, int count, bool exclusive = true);
     
     int total_workers_count() const;
 
@@ -77,6 +157,33 @@ namespace boost { namespace threadpool
 	int processing_workers_count() const;
 
 	int pending_tasks_count() const;
+
+	//! busy, spinning and parked time and wake latency per worker and in aggregate
+	pool_stats stats() const;
+
+	//! also count cycles, instructions and LLC misses of tagged tasks (Linux perf_event_open)
+	void enable_hardware_counters(bool enable = true);
+
+	//! record schedule, start, end, park, wake and resize events into per-worker ring buffers
+	void enable_tracing(std::size_t events_per_buffer = 65536);
+
+	void disable_tracing();
+
+	//! publish queue depth, throughput and latency histograms in /dev/shm for threadpool-top
+	//! \return false if the shared memory object could not be created
+	bool enable_metrics_export(char const * name);
+
+	void disable_metrics_export();
+
+	//! log arrival time, tag, queue wait and run duration of each task into a binary file for workload_replay
+	//! \return false if the file could not be created
+	bool enable_recording(char const * path);
+
+	//! complete and close the workload file
+	void disable_recording();
+
+	//! write the recorded events as Chrome trace JSON, which can be opened in Perfetto or chrome://tracing
+	void write_chrome_trace(std::ostream & out) const;
    
 	//ò
 	/*void clear_pending_tasks();*/
@@ -86,11 +193,56 @@ namespace boost { namespace threadpool
 	
 	void wait_for_all_worker_exit() const;	
 
+	//! waits until no task is queued and the tasks which are being processed finished
 	void wait_for_all_task_done() const;
 
 	void terminate();   
   };
 
+
+
+  /*! \brief Awaitable which moves a coroutine onto a worker of a fifo_pool.
+  *
+  * co_await pool.schedule() suspends the coroutine and schedules its frame as a
+  * raw_task_func, so resuming on the worker does not allocate. Only the awaiting
+  * code needs C++20, the pool itself does not depend on it.
+  *
+  * \see coroutine.hpp
+  */
+  class schedule_awaitable
+  {
+  private:
+    fifo_pool * m_pool;
+
+  public:
+    explicit schedule_awaitable(fifo_pool & pool)
+      : m_pool(&pool)
+    {
+    }
+
+    bool await_ready() const
+    {
+      return false;
+    }
+
+    template <typename Handle>
+    void await_suspend(Handle const handle) const
+    {
+      m_pool->schedule(raw_task_func(&resume<Handle>, handle.address()));
+    }
+
+    void await_resume() const
+    {
+    }
+
+  private:
+    template <typename Handle>
+    static void resume(void * const frame)
+    {
+      Handle::from_address(frame).resume();
+    }
+  };
+
 } } // namespace boost::threadpool
 
 #endif // THREADPOOL_POOL_HPP_INCLUDED
@@ -0,0 +1,272 @@
+/*! \file
+* \brief Pool statistics.
+*
+* This file contains the value types which report how a pool and
+* its workers spend their time.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+
+#ifndef THREADPOOL_POOL_STATS_HPP_INCLUDED
+#define THREADPOOL_POOL_STATS_HPP_INCLUDED
+
+#include <cstddef>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/chrono.hpp>
+#include <boost/threadpool/task_adaptors.hpp>
+
+
+namespace boost { namespace threadpool
+{
+
+  /*! \brief Utilisation of a worker thread.
+  *
+  * The durations are accumulated since the worker entered the pool.
+  * busy_time, spinning_time and parked_time partition the worker's
+  * lifetime: a worker is either running a task, looking for one, or
+  * blocked until a task is scheduled.
+  *
+  * \see pool_stats
+  */
+  struct worker_stats
+  {
+    int id;                                     //!< Worker number, unique within its pool. -1 for aggregates.
+    uint64_t tasks_executed;                    //!< Number of tasks the worker ran.
+    chrono::nanoseconds busy_time;              //!< Time spent inside task functions.
+    chrono::nanoseconds spinning_time;          //!< Time spent in the fetching state without being parked.
+    chrono::nanoseconds parked_time;            //!< Time spent waiting for a task to be scheduled.
+    uint64_t wakeups;                           //!< Number of times the worker was woken by schedule and ran a task.
+    chrono::nanoseconds wake_latency;           //!< Accumulated time from the schedule's notification until the woken task started.
+    chrono::nanoseconds max_wake_latency;       //!< Longest single wake latency.
+    bool reserved;                              //!< Indicates that the worker serves the reserved task class, see reserve_workers.
+    bool blocked;                               //!< Indicates that the worker runs a blocking region or is stuck in a task, see set_compensation.
+
+    worker_stats()
+      : id(-1)
+      , tasks_executed(0)
+      , busy_time(0)
+      , spinning_time(0)
+      , parked_time(0)
+      , wakeups(0)
+      , wake_latency(0)
+      , max_wake_latency(0)
+      , reserved(false)
+      , blocked(false)
+    {
+    }
+
+    /*! Adds the counters of another worker.
+    * \param rhs The statistics to add.
+    * \return *this
+    */
+    worker_stats & operator+= (worker_stats const & rhs)
+    {
+      tasks_executed += rhs.tasks_executed;
+      busy_time += rhs.busy_time;
+      spinning_time += rhs.spinning_time;
+      parked_time += rhs.parked_time;
+      wakeups += rhs.wakeups;
+      wake_latency += rhs.wake_latency;
+      if(max_wake_latency < rhs.max_wake_latency)
+      {
+        max_wake_latency = rhs.max_wake_latency;
+      }
+      return *this;
+    }
+
+    /*! Gets the fraction of the accounted time the worker was running tasks.
+    * \return A value between 0 and 1. A pool whose workers are close to 1 is CPU-bound, close to 0 it is starved.
+    */
+    double utilisation() const
+    {
+      chrono::nanoseconds const total = busy_time + spinning_time + parked_time;
+      return total.count() > 0 ? double(busy_time.count()) / double(total.count()) : 0.0;
+    }
+
+    /*! Gets the average time from notification to task start.
+    * \return The mean wake latency or zero if the worker was never woken.
+    */
+    chrono::nanoseconds mean_wake_latency() const
+    {
+      return wakeups > 0 ? chrono::nanoseconds(wake_latency.count() / static_cast<int64_t>(wakeups)) : chrono::nanoseconds(0);
+    }
+  };
+
+
+
+  /*! \brief Resources consumed by the tasks with the same tag.
+  *
+  * The CPU time is measured with the thread's CPU clock around each task,
+  * hence time the task spent blocked is not included, unlike in wall_time.
+  * The hardware counters are only valid if has_hardware_counters is true.
+  *
+  * \see task_tag
+  */
+  struct tag_stats
+  {
+    task_tag tag;                       //!< The tag the counters are charged to.
+    uint64_t tasks_executed;            //!< Number of tasks with this tag.
+    chrono::nanoseconds cpu_time;       //!< CPU time consumed by the tasks.
+    chrono::nanoseconds wall_time;      //!< Elapsed time while the tasks ran.
+    bool has_hardware_counters;         //!< Indicates that hardware counters were read for at least one task.
+    uint64_t cycles;                    //!< CPU cycles in user mode.
+    uint64_t instructions;              //!< Retired instructions in user mode.
+    uint64_t llc_misses;                //!< Last level cache misses in user mode.
+
+    tag_stats()
+      : tasks_executed(0)
+      , cpu_time(0)
+      , wall_time(0)
+      , has_hardware_counters(false)
+      , cycles(0)
+      , instructions(0)
+      , llc_misses(0)
+    {
+    }
+
+    /*! Adds the counters of the same tag.
+    * \param rhs The statistics to add.
+    * \return *this
+    */
+    tag_stats & operator+= (tag_stats const & rhs)
+    {
+      tasks_executed += rhs.tasks_executed;
+      cpu_time += rhs.cpu_time;
+      wall_time += rhs.wall_time;
+      has_hardware_counters = has_hardware_counters || rhs.has_hardware_counters;
+      cycles += rhs.cycles;
+      instructions += rhs.instructions;
+      llc_misses += rhs.llc_misses;
+      return *this;
+    }
+  };
+
+
+
+  /*! \brief Contention of one of the pool's mutexes at one call site.
+  *
+  * Only available in builds with BOOST_THREADPOOL_LOCK_PROFILING defined.
+  * An acquisition is contended if the mutex was held by another thread.
+  */
+  struct lock_stats
+  {
+    char const * mutex_name;            //!< task_queue_mutex, worker_mutex or worker_counting_mutex.
+    char const * site_name;             //!< Where the mutex was acquired, e.g. schedule or fetch_task.
+    uint64_t acquisitions;              //!< Number of acquisitions.
+    uint64_t contended;                 //!< Number of acquisitions which had to wait.
+    chrono::nanoseconds wait_time;      //!< Total time spent waiting for the mutex.
+    chrono::nanoseconds hold_time;      //!< Total time the mutex was held.
+
+    lock_stats()
+      : mutex_name("")
+      , site_name("")
+      , acquisitions(0)
+      , contended(0)
+      , wait_time(0)
+      , hold_time(0)
+    {
+    }
+  };
+
+
+
+  /*! \brief Occupancy of the task queue and the tasks it turned away.
+  *
+  * \see fifo_pool::set_queue_limits
+  */
+  struct queue_stats
+  {
+    int pending;                        //!< Tasks in the queue.
+    std::size_t pending_bytes;          //!< Estimated bytes of the tasks in the queue.
+    uint64_t scheduled;                 //!< Tasks added to the queue.
+    uint64_t rejected;                  //!< Tasks not added because the queue was full.
+    uint64_t dropped;                   //!< Queued tasks removed to make room for new ones.
+    uint64_t shed;                      //!< Tasks not added because their latency budget could not be met.
+    uint64_t expired;                   //!< Queued tasks dropped because their latency budget ran out before they started.
+    uint64_t affine;                    //!< Tasks added to the queue of the worker selected by their key.
+    uint64_t stolen;                    //!< Tasks of a worker's queue run by another worker.
+    chrono::nanoseconds mean_service_time;  //!< Moving average of the task run time, used to predict queue waits.
+
+    queue_stats()
+      : pending(0)
+      , pending_bytes(0)
+      , scheduled(0)
+      , rejected(0)
+      , dropped(0)
+      , shed(0)
+      , expired(0)
+      , affine(0)
+      , stolen(0)
+      , mean_service_time(0)
+    {
+    }
+  };
+
+
+
+  /*! \brief Queue depth and dispatch count of a task class.
+  *
+  * Only reported by pools with fair_share_scheduler, where the task tag
+  * selects the class.
+  *
+  * \see fair_share_scheduler
+  */
+  struct class_stats
+  {
+    task_tag tag;                       //!< The class, untagged tasks form a class of their own.
+    unsigned int weight;                //!< Tasks the class may dispatch per round.
+    int pending;                        //!< Tasks of the class in the queue.
+    uint64_t dispatched;                //!< Tasks of the class taken from the queue.
+
+    class_stats()
+      : weight(1)
+      , pending(0)
+      , dispatched(0)
+    {
+    }
+  };
+
+
+
+  /*! \brief Snapshot of a pool's statistics.
+  *
+  * The snapshot is taken atomically with respect to worker creation and
+  * termination, the counters of a single worker are read while it keeps running.
+  *
+  * \see worker_stats
+  */
+  struct pool_stats
+  {
+    worker_stats total;                 //!< Sum over all workers, including the ones which already left the pool.
+    std::vector<worker_stats> workers;  //!< The workers which are currently attached to the pool.
+    std::vector<tag_stats> tags;        //!< Consumption per task tag, ordered by tag.
+    std::vector<lock_stats> locks;      //!< Contention per mutex and call site, empty unless built with BOOST_THREADPOOL_LOCK_PROFILING.
+    queue_stats queue;                  //!< Queue occupancy and overflow counters.
+    std::vector<class_stats> classes;   //!< Queue depth per task class, ordered by tag, empty unless the pool uses fair_share_scheduler.
+    int compensating;                   //!< Workers added for blocked workers which are still in the pool's target size.
+    uint64_t compensations;             //!< Workers added for blocked workers since the pool was created.
+    int spare;                          //!< Workers retired after a blocking region which wait for the next one, not in workers.
+
+    pool_stats()
+      : compensating(0)
+      , compensations(0)
+      , spare(0)
+    {
+    }
+  };
+
+
+} } // namespace boost::threadpool
+
+#endif // THREADPOOL_POOL_STATS_HPP_INCLUDED
+
@@ -25,8 +25,21 @@
 
 #include <queue>
 #include <deque>
+#include <map>
+#include <vector>
+#include <algorithm>
 
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/threadpool/task_adaptors.hpp>
+#include <boost/threadpool/pool_stats.hpp>
+#include <boost/threadpool/detail/queued_task.hpp>
 
 namespace boost { namespace threadpool
 {
@@ -256,6 +269,859 @@ namespace boost { namespace threadpool
       }
     } 
   };
+
+
+
+  namespace detail
+  {
+    /*! Gets the index of the highest set bit.
+    * \param word A value other than 0.
+    */
+    inline unsigned int highest_bit(uint64_t word)
+    {
+#if defined(__GNUC__)
+      return 63 - __builtin_clzll(word);
+#else
+      unsigned int bit = 0;
+      for(unsigned int shift = 32; shift > 0; shift /= 2)
+      {
+        if(word >> shift)
+        {
+          word >>= shift;
+          bit += shift;
+        }
+      }
+      return bit;
+#endif
+    }
+  } // namespace detail
+
+
+
+  /*! \brief SchedulingPolicy which implements prioritized ordering with a bounded priority range.
+  *
+  * This container keeps one FIFO queue per priority level and a bitmap of the
+  * non-empty levels, so push and pop take constant time. Tasks of equal priority
+  * are removed in the order they were added. Priorities above the highest level
+  * are treated as the highest level.
+  *
+  * With aging enabled a waiting task gains one level each time the given number
+  * of tasks was removed, so low priority tasks are not starved by a steady stream
+  * of high priority ones. top and pop then compare the oldest task of each
+  * non-empty level, which is bounded by the number of levels.
+  *
+  * \param Task A function object which implements the operator() and priority().
+  *
+  * \see prio_task_func
+  *
+  */ 
+  template <typename Task = prio_task_func>  
+  class bucket_prio_scheduler
+  {
+  public:
+    typedef Task task_type; //!< Indicates the scheduler's task type.
+
+    static unsigned int const levels = 256; //!< Number of priority levels.
+
+  protected:
+    struct entry
+    {
+      task_type task;
+      uint64_t pushed;  //!< Value of m_clock when the task was added.
+    };
+
+    std::deque<entry> m_buckets[levels];  //!< Internal task containers, one per level.
+    uint64_t m_bitmap[levels / 64];       //!< Bit i is set if level i is not empty.
+    int m_size;                           //!< Number of tasks.
+    uint64_t m_clock;                     //!< Number of removed tasks, the time base of aging.
+    unsigned int m_aging;                 //!< Removed tasks after which a waiting task gains a level, 0 disables aging.
+
+
+  public:
+    bucket_prio_scheduler()
+      : m_size(0)
+      , m_clock(0)
+      , m_aging(0)
+    {
+      std::fill(m_bitmap, m_bitmap + levels / 64, 0);
+    }
+
+    /*! Enables aging.
+    * \param removals Number of removed tasks after which a waiting task gains one level, 0 disables aging.
+    */
+    void set_aging(unsigned int const removals)
+    {
+      m_aging = removals;
+    }
+
+    /*! Adds a new task to the scheduler.
+    * \param task The task object.
+    * \return true, if the task could be scheduled and false otherwise. 
+    */
+    bool push(task_type const & task)
+    {
+      unsigned int const level = (std::min)(task.priority(), levels - 1);
+      entry const e = { task, m_clock };
+      m_buckets[level].push_back(e);
+      m_bitmap[level / 64] |= uint64_t(1) << (level % 64);
+      ++m_size;
+      return true;
+    }
+
+    /*! Removes the task which should be executed next.
+    */
+    void pop()
+    {
+      unsigned int const level = next_level();
+      m_buckets[level].pop_front();
+      if(m_buckets[level].empty())
+      {
+        m_bitmap[level / 64] &= ~(uint64_t(1) << (level % 64));
+      }
+      --m_size;
+      ++m_clock;
+    }
+
+    /*! Gets the task which should be executed next.
+    *  \return The task object to be executed.
+    */
+    task_type const & top() const
+    {
+      return m_buckets[next_level()].front().task;
+    }
+
+    /*! Gets the current number of tasks in the scheduler.
+    *  \return The number of tasks.
+    *  \remarks Prefer empty() to size() == 0 to check if the scheduler is empty.
+    */
+    int size() const
+    {
+      return m_size;
+    }
+
+    /*! Checks if the scheduler is empty.
+    *  \return true if the scheduler contains no tasks, false otherwise.
+    *  \remarks Is more efficient than size() == 0. 
+    */
+    bool empty() const
+    {
+      return m_size == 0;
+    }
+
+    /*! Removes all tasks from the scheduler.
+    */  
+    void clear()
+    {    
+      for(unsigned int word = 0; word < levels / 64; ++word)
+      {
+        for(uint64_t bits = m_bitmap[word]; bits != 0; )
+        {
+          unsigned int const bit = detail::highest_bit(bits);
+          m_buckets[word * 64 + bit].clear();
+          bits &= ~(uint64_t(1) << bit);
+        }
+        m_bitmap[word] = 0;
+      }
+      m_size = 0;
+    } 
+
+  protected:
+    /*! Gets the highest non-empty level, the scheduler must not be empty.
+    */
+    unsigned int highest_level() const
+    {
+      unsigned int word = levels / 64 - 1;
+      while(m_bitmap[word] == 0)
+      {
+        --word;
+      }
+      return word * 64 + detail::highest_bit(m_bitmap[word]);
+    }
+
+    /*! Gets the level of the task which should be executed next, the scheduler must not be empty.
+    */
+    unsigned int next_level() const
+    {
+      unsigned int best = highest_level();
+      if(m_aging == 0)
+      {
+        return best;
+      }
+
+      // effective priority in units of 1 / m_aging levels, ties go to the higher level
+      uint64_t best_rank = uint64_t(best) * m_aging + (m_clock - m_buckets[best].front().pushed);
+      for(int word = best / 64; word >= 0; --word)
+      {
+        uint64_t bits = m_bitmap[word];
+        if(word == static_cast<int>(best / 64))
+        {
+          bits &= (uint64_t(1) << (best % 64)) - 1;
+        }
+        while(bits != 0)
+        {
+          unsigned int const level = word * 64 + detail::highest_bit(bits);
+          uint64_t const rank = uint64_t(level) * m_aging + (m_clock - m_buckets[level].front().pushed);
+          if(rank > best_rank)
+          {
+            best = level;
+            best_rank = rank;
+          }
+          bits &= ~(uint64_t(1) << (level % 64));
+        }
+      }
+      return best;
+    }
+  };
+  
+
+
+  /*! \brief SchedulingPolicy which implements prioritized ordering with changeable priorities.
+  *
+  * This container is a binary heap which knows the position of each task, so
+  * a queued task can be given a new priority or removed in O(log n). push_ticket
+  * returns a ticket which identifies the task until it leaves the scheduler.
+  * Tasks of equal priority are removed in the order they were added.
+  * The storage of removed tasks is reused, so push does not allocate once the
+  * scheduler reached its largest size.
+  *
+  * \param Task A function object which implements the operator() and priority().
+  *
+  * \see prio_task_func
+  * \see task_handle
+  *
+  */ 
+  template <typename Task = prio_task_func>  
+  class indexed_prio_scheduler
+  {
+  public:
+    typedef Task task_type; //!< Indicates the scheduler's task type.
+
+    /*! \brief Identifies a task in the scheduler.
+    */
+    struct ticket_type
+    {
+      uint32_t slot;
+      uint32_t generation;
+
+      ticket_type()
+        : slot(0)
+        , generation(0)
+      {
+      }
+    };
+
+  protected:
+    static std::size_t const not_queued = ~std::size_t(0);
+
+    struct slot
+    {
+      task_type task;
+      unsigned int priority;
+      uint64_t sequence;      //!< Order of push, breaks priority ties.
+      std::size_t position;   //!< Index in m_heap, not_queued if the slot is free.
+      uint32_t generation;    //!< Incremented each time the slot is freed, invalidates old tickets.
+    };
+
+    std::vector<slot> m_slots;          //!< Storage of the tasks.
+    std::vector<uint32_t> m_free;       //!< Free slots.
+    std::vector<uint32_t> m_heap;       //!< Slots ordered as a binary max-heap.
+    uint64_t m_sequence;                //!< Number of pushed tasks.
+
+
+  public:
+    indexed_prio_scheduler()
+      : m_sequence(0)
+    {
+    }
+
+    /*! Adds a new task to the scheduler.
+    * \param task The task object.
+    * \return true, if the task could be scheduled and false otherwise. 
+    */
+    bool push(task_type const & task)
+    {
+      push_ticket(task);
+      return true;
+    }
+
+    /*! Adds a new task to the scheduler.
+    * \param task The task object.
+    * \return The ticket of the task, valid until the task is removed.
+    */
+    ticket_type push_ticket(task_type const & task)
+    {
+      uint32_t index;
+      if(m_free.empty())
+      {
+        index = static_cast<uint32_t>(m_slots.size());
+        m_slots.push_back(slot());
+        m_slots.back().generation = 1;
+      }
+      else
+      {
+        index = m_free.back();
+        m_free.pop_back();
+      }
+      slot & s = m_slots[index];
+      s.task = task;
+      s.priority = task.priority();
+      s.sequence = m_sequence++;
+      s.position = m_heap.size();
+      m_heap.push_back(index);
+      sift_up(s.position);
+
+      ticket_type ticket;
+      ticket.slot = index;
+      ticket.generation = s.generation;
+      return ticket;
+    }
+
+    /*! Checks if the task of a ticket is still in the scheduler.
+    */
+    bool contains(ticket_type const & ticket) const
+    {
+      return ticket.slot < m_slots.size() && m_slots[ticket.slot].generation == ticket.generation
+        && m_slots[ticket.slot].position != not_queued;
+    }
+
+    /*! Changes the priority of a queued task.
+    * \return false if the task is no longer in the scheduler.
+    */
+    bool reprioritize(ticket_type const & ticket, unsigned int const priority)
+    {
+      if(!contains(ticket))
+      {
+        return false;
+      }
+      slot & s = m_slots[ticket.slot];
+      unsigned int const old = s.priority;
+      s.priority = priority;
+      if(priority > old)
+      {
+        sift_up(s.position);
+      }
+      else
+      {
+        sift_down(s.position);
+      }
+      return true;
+    }
+
+    /*! Removes a queued task.
+    * \param removed Receives the removed task.
+    * \return false if the task is no longer in the scheduler.
+    */
+    bool remove(ticket_type const & ticket, task_type & removed)
+    {
+      if(!contains(ticket))
+      {
+        return false;
+      }
+      removed = m_slots[ticket.slot].task;
+      erase(m_slots[ticket.slot].position);
+      return true;
+    }
+
+    /*! Removes the task which should be executed next.
+    */
+    void pop()
+    {
+      erase(0);
+    }
+
+    /*! Gets the task which should be executed next.
+    *  \return The task object to be executed.
+    */
+    task_type const & top() const
+    {
+      return m_slots[m_heap.front()].task;
+    }
+
+    /*! Gets the current number of tasks in the scheduler.
+    *  \return The number of tasks.
+    *  \remarks Prefer empty() to size() == 0 to check if the scheduler is empty.
+    */
+    int size() const
+    {
+      return static_cast<int>(m_heap.size());
+    }
+
+    /*! Checks if the scheduler is empty.
+    *  \return true if the scheduler contains no tasks, false otherwise.
+    *  \remarks Is more efficient than size() == 0. 
+    */
+    bool empty() const
+    {
+      return m_heap.empty();
+    }
+
+    /*! Removes all tasks from the scheduler.
+    */  
+    void clear()
+    {    
+      while(!m_heap.empty())
+      {
+        release(m_heap.back());
+        m_heap.pop_back();
+      }
+    } 
+
+  protected:
+    //! Checks if the task in slot a should run before the task in slot b.
+    bool before(uint32_t const a, uint32_t const b) const
+    {
+      slot const & sa = m_slots[a];
+      slot const & sb = m_slots[b];
+      return sa.priority > sb.priority || (sa.priority == sb.priority && sa.sequence < sb.sequence);
+    }
+
+    void place(std::size_t const position, uint32_t const index)
+    {
+      m_heap[position] = index;
+      m_slots[index].position = position;
+    }
+
+    void sift_up(std::size_t position)
+    {
+      uint32_t const index = m_heap[position];
+      while(position > 0 && before(index, m_heap[(position - 1) / 2]))
+      {
+        place(position, m_heap[(position - 1) / 2]);
+        position = (position - 1) / 2;
+      }
+      place(position, index);
+    }
+
+    void sift_down(std::size_t position)
+    {
+      uint32_t const index = m_heap[position];
+      std::size_t const count = m_heap.size();
+      for(;;)
+      {
+        std::size_t child = 2 * position + 1;
+        if(child >= count)
+        {
+          break;
+        }
+        if(child + 1 < count && before(m_heap[child + 1], m_heap[child]))
+        {
+          ++child;
+        }
+        if(!before(m_heap[child], index))
+        {
+          break;
+        }
+        place(position, m_heap[child]);
+        position = child;
+      }
+      place(position, index);
+    }
+
+    //! Removes the task at a heap position and frees its slot.
+    void erase(std::size_t const position)
+    {
+      uint32_t const index = m_heap[position];
+      uint32_t const last = m_heap.back();
+      m_heap.pop_back();
+      if(position < m_heap.size())
+      {
+        place(position, last);
+        if(position > 0 && before(last, m_heap[(position - 1) / 2]))
+        {
+          sift_up(position);
+        }
+        else
+        {
+          sift_down(position);
+        }
+      }
+      release(index);
+    }
+
+    void release(uint32_t const index)
+    {
+      slot & s = m_slots[index];
+      s.task = task_type();
+      s.position = not_queued;
+      ++s.generation;
+      m_free.push_back(index);
+    }
+  };
+
+
+
+  /*! \brief Thread-safe task container which implements relaxed prioritized ordering.
+  *
+  * This container is a MultiQueue: it spreads the tasks over several heaps,
+  * each with its own lock. A new task is added to a random heap, and the task
+  * removed next is the better top of two random heaps. Producers and consumers
+  * therefore rarely meet on the same lock, in exchange the removal order only
+  * approximates the priority order: the removed task is among the highest
+  * priority ones with high probability, but not necessarily the highest.
+  * Tasks of equal priority are removed in arbitrary order.
+  *
+  * push and try_pop may be called concurrently. The container is not a
+  * SchedulingPolicy of pool_core: the pool serializes its queue under its own
+  * locks, which would take away the scalability the container provides.
+  * Use it as a standalone queue between producer and consumer threads.
+  *
+  * \param Task A function object which implements the operator(), operator< and priority().
+  *
+  * \see prio_task_func
+  *
+  */ 
+  template <typename Task = prio_task_func>  
+  class multi_queue_scheduler
+    : private noncopyable
+  {
+  public:
+    typedef Task task_type; //!< Indicates the scheduler's task type.
+
+  protected:
+    struct shard
+    {
+      mutex guard;
+      std::priority_queue<task_type> heap;
+      atomic<uint64_t> top_key;   //!< Priority of the top task plus 1, 0 if the heap is empty; read without the lock.
+      char padding[64];           //!< Keeps neighbouring shards off each other's cache line.
+
+      shard()
+        : top_key(0)
+      {
+      }
+
+      //! Refreshes top_key, called with guard locked.
+      void update_top_key()
+      {
+        top_key.store(heap.empty() ? 0 : uint64_t(heap.top().priority()) + 1, memory_order_relaxed);
+      }
+    };
+
+    scoped_array<shard> m_shards;   //!< Internal task containers.
+    std::size_t m_count;            //!< Number of shards.
+    atomic<int> m_size;             //!< Number of tasks.
+
+
+  public:
+    /*! Constructor.
+    * \param queues The number of heaps, 0 selects twice the number of hardware threads.
+    */
+    explicit multi_queue_scheduler(std::size_t queues = 0)
+      : m_count(queues != 0 ? queues : (std::max)(2u, 2 * thread::hardware_concurrency()))
+      , m_size(0)
+    {
+      m_shards.reset(new shard[m_count]);
+    }
+
+    /*! Adds a new task to the scheduler. Thread-safe.
+    * \param task The task object.
+    * \return true, if the task could be scheduled and false otherwise. 
+    */
+    bool push(task_type const & task)
+    {
+      shard & s = m_shards[next_random() % m_count];
+      mutex::scoped_lock lock(s.guard);
+      s.heap.push(task);
+      s.update_top_key();
+      m_size.fetch_add(1, memory_order_relaxed);
+      return true;
+    }
+
+    /*! Removes a task with high priority. Thread-safe.
+    * \param task Receives the removed task.
+    * \return false if the scheduler is empty.
+    */
+    bool try_pop(task_type & task)
+    {
+      while(m_size.load(memory_order_relaxed) > 0)
+      {
+        shard * const s = choose();
+        if(s == 0)
+        {
+          continue;
+        }
+        mutex::scoped_lock lock(s->guard);
+        if(s->heap.empty())
+        {
+          continue;
+        }
+        task = s->heap.top();
+        s->heap.pop();
+        s->update_top_key();
+        m_size.fetch_sub(1, memory_order_relaxed);
+        return true;
+      }
+      return false;
+    }
+
+    /*! Gets the current number of tasks in the scheduler.
+    *  \return The number of tasks.
+    *  \remarks Prefer empty() to size() == 0 to check if the scheduler is empty.
+    */
+    int size() const
+    {
+      return m_size.load(memory_order_relaxed);
+    }
+
+    /*! Checks if the scheduler is empty.
+    *  \return true if the scheduler contains no tasks, false otherwise.
+    *  \remarks Is more efficient than size() == 0. 
+    */
+    bool empty() const
+    {
+      return size() == 0;
+    }
+
+    /*! Removes all tasks from the scheduler.
+    */  
+    void clear()
+    {    
+      for(std::size_t i = 0; i < m_count; ++i)
+      {
+        mutex::scoped_lock lock(m_shards[i].guard);
+        m_size.fetch_sub(static_cast<int>(m_shards[i].heap.size()), memory_order_relaxed);
+        m_shards[i].heap = std::priority_queue<task_type>();
+        m_shards[i].update_top_key();
+      }
+    } 
+
+  protected:
+    /*! Picks the better of two random non-empty shards, or any non-empty shard if both are empty.
+    * \return 0 if all shards were found empty.
+    */
+    shard * choose()
+    {
+      uint64_t const r = next_random();
+      shard & a = m_shards[r % m_count];
+      shard & b = m_shards[(r >> 32) % m_count];
+      uint64_t const key_a = a.top_key.load(memory_order_relaxed);
+      uint64_t const key_b = b.top_key.load(memory_order_relaxed);
+      if(key_a != 0 || key_b != 0)
+      {
+        return key_a >= key_b ? &a : &b;
+      }
+      for(std::size_t i = 0; i < m_count; ++i)
+      {
+        if(m_shards[i].top_key.load(memory_order_relaxed) != 0)
+        {
+          return &m_shards[i];
+        }
+      }
+      return 0;
+    }
+
+    /*! Gets a random number from a generator of the calling thread.
+    */
+    static uint64_t next_random()
+    {
+      static thread_specific_ptr<uint64_t> state;
+      uint64_t * x = state.get();
+      if(x == 0)
+      {
+        x = new uint64_t(hash<thread::id>()(this_thread::get_id()) * 0x9E3779B97F4A7C15ull | 1);
+        state.reset(x);
+      }
+      // xorshift64
+      *x ^= *x << 13;
+      *x ^= *x >> 7;
+      *x ^= *x << 17;
+      return *x;
+    }
+  };
+  
+
+
+  /*! \brief SchedulingPolicy which shares the workers fairly between task classes. 
+  *
+  * The task tag selects the class, e.g. a tenant. Each class has its own FIFO
+  * queue and a weight, and the non-empty classes take turns in round robin
+  * order: in its turn a class dispatches up to weight tasks (deficit round
+  * robin with unit task cost). A class which floods the queue therefore only
+  * delays its own tasks, and under backlog the classes receive dispatches in
+  * proportion to their weights. Classes are created on first use and keep
+  * their weight, so the set of tags should be bounded.
+  *
+  * \param Task A function object which implements the operator() and has a task_tag member tag, like the pool's queue entries.
+  *
+  * \see class_stats
+  *
+  */ 
+  template <typename Task = detail::queued_task<task_func> >  
+  class fair_share_scheduler
+  {
+  public:
+    typedef Task task_type; //!< Indicates the scheduler's task type.
+
+  protected:
+    struct task_class
+    {
+      std::deque<task_type> tasks;
+      unsigned int weight;
+      unsigned int credit;    //!< Tasks the class may still dispatch in its current turn.
+      uint64_t dispatched;
+      bool active;            //!< Indicates that the class is in m_active.
+
+      task_class()
+        : weight(1)
+        , credit(0)
+        , dispatched(0)
+        , active(false)
+      {
+      }
+    };
+
+    std::map<task_tag, task_class> m_classes;   //!< Internal task containers, one per class.
+    std::deque<task_class *> m_active;          //!< Non-empty classes in round robin order, the front one has its turn.
+    int m_size;                                 //!< Number of tasks.
+
+
+  public:
+    fair_share_scheduler()
+      : m_size(0)
+    {
+    }
+
+    /*! Sets the share of a class.
+    * \param tag The class.
+    * \param weight Tasks the class dispatches per turn, at least 1. The default is 1.
+    */
+    void set_weight(task_tag const & tag, unsigned int const weight)
+    {
+      m_classes[tag].weight = (std::max)(weight, 1u);
+    }
+
+    /*! Adds a new task to the scheduler.
+    * \param task The task object.
+    * \return true, if the task could be scheduled and false otherwise. 
+    */
+    bool push(task_type const & task)
+    {
+      task_class & c = m_classes[task.tag];
+      c.tasks.push_back(task);
+      if(!c.active)
+      {
+        c.active = true;
+        c.credit = c.weight;
+        m_active.push_back(&c);
+      }
+      ++m_size;
+      return true;
+    }
+
+    /*! Removes the task which should be executed next.
+    */
+    void pop()
+    {
+      task_class & c = *m_active.front();
+      c.tasks.pop_front();
+      ++c.dispatched;
+      --m_size;
+      if(c.tasks.empty())
+      {
+        c.active = false;
+        m_active.pop_front();
+      }
+      else if(--c.credit == 0)
+      {
+        c.credit = c.weight;
+        m_active.pop_front();
+        m_active.push_back(&c);
+      }
+    }
+
+    /*! Gets the task which should be executed next.
+    *  \return The task object to be executed.
+    */
+    task_type const & top() const
+    {
+      return m_active.front()->tasks.front();
+    }
+
+    /*! Gets the current number of tasks in the scheduler.
+    *  \return The number of tasks.
+    *  \remarks Prefer empty() to size() == 0 to check if the scheduler is empty.
+    */
+    int size() const
+    {
+      return m_size;
+    }
+
+    /*! Checks if the scheduler is empty.
+    *  \return true if the scheduler contains no tasks, false otherwise.
+    *  \remarks Is more efficient than size() == 0. 
+    */
+    bool empty() const
+    {
+      return m_size == 0;
+    }
+
+    /*! Removes all tasks from the scheduler.
+    */  
+    void clear()
+    {    
+      for(typename std::deque<task_class *>::iterator it = m_active.begin(); it != m_active.end(); ++it)
+      {
+        (*it)->tasks.clear();
+        (*it)->active = false;
+      }
+      m_active.clear();
+      m_size = 0;
+    } 
+
+    /*! Appends the queue depth and dispatch count of each class.
+    */
+    void collect(std::vector<class_stats> & out) const
+    {
+      for(typename std::map<task_tag, task_class>::const_iterator it = m_classes.begin(); it != m_classes.end(); ++it)
+      {
+        class_stats c;
+        c.tag = it->first;
+        c.weight = it->second.weight;
+        c.pending = static_cast<int>(it->second.tasks.size());
+        c.dispatched = it->second.dispatched;
+        out.push_back(c);
+      }
+    }
+  };
+
+
+
+  /*! Appends the per-class statistics of a scheduler, only fair_share_scheduler has classes.
+  */
+  template <typename Scheduler>
+  void collect_class_stats(Scheduler const &, std::vector<class_stats> &)
+  {
+  }
+
+  template <typename Task>
+  void collect_class_stats(fair_share_scheduler<Task> const & scheduler, std::vector<class_stats> & out)
+  {
+    scheduler.collect(out);
+  }
+
+  /*! Adds the per-class statistics of another queue, both ordered by tag.
+  * A class already in total keeps its weight.
+  */
+  inline void merge_class_stats(std::vector<class_stats> & total, std::vector<class_stats> const & part)
+  {
+    std::vector<class_stats>::iterator pos = total.begin();
+    for(std::vector<class_stats>::const_iterator it = part.begin(); it != part.end(); ++it)
+    {
+      while(pos != total.end() && pos->tag < it->tag)
+      {
+        ++pos;
+      }
+      if(pos != total.end() && !(it->tag < pos->tag))
+      {
+        pos->pending += it->pending;
+        pos->dispatched += it->dispatched;
+      }
+      else
+      {
+        pos = total.insert(pos, *it);
+      }
+    }
+  }
   
 
 
@@ -0,0 +1,290 @@
+/*! \file
+* \brief Strands: serial execution of tasks on the workers of a pool.
+*
+* Tasks scheduled on a strand run one at a time in the order they were
+* scheduled, on whichever worker is free. A strand is not a thread: while
+* it has tasks, one drain task of the strand is in the pool's queue or
+* running, and it runs the strand's tasks one after the other.
+*
+* Scheduling pushes the task onto a lock-free queue and increments the
+* strand's task count; the producer which raises the count from zero
+* schedules the drain task. No mutex is taken per task. After a batch of
+* tasks the drain task schedules itself again, so a busy strand does not
+* keep a worker from the pool's other tasks.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_STRAND_HPP_INCLUDED
+#define THREADPOOL_STRAND_HPP_INCLUDED
+
+#include <boost/threadpool/task_adaptors.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstddef>
+#include <vector>
+
+
+namespace boost { namespace threadpool
+{
+
+  namespace detail
+  {
+    /*! \brief Shared state of a strand, reference counted by the strand handles and the drain task.
+    *
+    * The queue is Vyukov's intrusive MPSC queue: producers exchange the
+    * head, the drain task is the only consumer.
+    */
+    template <typename Pool>
+    class strand_impl
+      : private noncopyable
+    {
+      struct node
+      {
+        atomic<node *> next;
+        task_func task;
+      };
+
+      atomic<int> m_references;
+      atomic<std::size_t> m_count;      //!< Scheduled tasks which did not finish yet.
+      atomic<node *> m_head;            //!< Last pushed node, producers.
+      node * m_tail;                    //!< Next node to pop, drain task.
+      node m_stub;
+      Pool & m_pool;
+      std::size_t const m_batch;
+
+    public:
+      strand_impl(Pool & pool, std::size_t const batch)
+        : m_references(1)
+        , m_count(0)
+        , m_head(&m_stub)
+        , m_tail(&m_stub)
+        , m_pool(pool)
+        , m_batch(batch)
+      {
+        m_stub.next.store(0, memory_order_relaxed);
+      }
+
+      void add_reference()
+      {
+        m_references.fetch_add(1, memory_order_relaxed);
+      }
+
+      void release()
+      {
+        if(m_references.fetch_sub(1, memory_order_acq_rel) == 1)
+        {
+          delete this;
+        }
+      }
+
+      void schedule(task_func const & task)
+      {
+        node * const n = new node();
+        n->task = task;
+        // count before publishing, so the count never falls behind the queue
+        bool const idle = m_count.fetch_add(1, memory_order_acq_rel) == 0;
+        push(n);
+        if(idle)
+        {
+          add_reference();
+          m_pool.schedule(raw_task_func(&drain, this));
+        }
+      }
+
+      std::size_t pending() const
+      {
+        return m_count.load(memory_order_relaxed);
+      }
+
+    private:
+      void push(node * const n)
+      {
+        n->next.store(0, memory_order_relaxed);
+        node * const previous = m_head.exchange(n, memory_order_acq_rel);
+        previous->next.store(n, memory_order_release);
+      }
+
+      /*! \return The next node, 0 if the queue is empty or a push is not complete yet.
+      */
+      node * pop()
+      {
+        node * tail = m_tail;
+        node * next = tail->next.load(memory_order_acquire);
+        if(tail == &m_stub)
+        {
+          if(next == 0)
+          {
+            return 0;
+          }
+          m_tail = next;
+          tail = next;
+          next = next->next.load(memory_order_acquire);
+        }
+        if(next)
+        {
+          m_tail = next;
+          return tail;
+        }
+        if(tail != m_head.load(memory_order_acquire))
+        {
+          return 0;
+        }
+        push(&m_stub);
+        next = tail->next.load(memory_order_acquire);
+        if(next)
+        {
+          m_tail = next;
+          return tail;
+        }
+        return 0;
+      }
+
+      static void drain(void * const p)
+      {
+        strand_impl * const self = static_cast<strand_impl *>(p);
+        for(std::size_t ran = 0; ; )
+        {
+          node * n;
+          while((n = self->pop()) == 0)
+          {
+            // a producer counted its task but did not link it yet
+            this_thread::yield();
+          }
+          n->task();
+          delete n;
+          if(self->m_count.fetch_sub(1, memory_order_acq_rel) == 1)
+          {
+            self->release();
+            return;
+          }
+          if(++ran == self->m_batch)
+          {
+            // the reference passes to the rescheduled drain task, which queues behind the others
+            self->m_pool.reschedule(raw_task_func(&drain, self));
+            return;
+          }
+        }
+      }
+    };
+  } // namespace detail
+
+
+
+  /*! \brief Runs tasks one at a time in the order they were scheduled, on the workers of a pool.
+  *
+  * Copies of a strand refer to the same strand. The strand's state lives
+  * until the last copy is destroyed and its last task finished, so a strand
+  * may be destroyed while its tasks are pending. Tasks must not throw.
+  *
+  * \param Pool A pool whose tasks are task_func objects, e.g. fifo_pool or lifo_pool_core.
+  */
+  template <typename Pool>
+  class strand
+  {
+    detail::strand_impl<Pool> * m_impl;
+
+  public:
+    /*! Constructor.
+    * \param batch Number of tasks the strand runs before it lets other tasks of the pool run.
+    */
+    explicit strand(Pool & pool, std::size_t const batch = 64)
+      : m_impl(new detail::strand_impl<Pool>(pool, batch))
+    {
+    }
+
+    strand(strand const & other)
+      : m_impl(other.m_impl)
+    {
+      m_impl->add_reference();
+    }
+
+    strand & operator=(strand const & other)
+    {
+      other.m_impl->add_reference();
+      m_impl->release();
+      m_impl = other.m_impl;
+      return *this;
+    }
+
+    ~strand()
+    {
+      m_impl->release();
+    }
+
+    void schedule(task_func const & task)
+    {
+      m_impl->schedule(task);
+    }
+
+    /*! Gets the number of tasks which were scheduled and did not finish yet.
+    */
+    std::size_t pending() const
+    {
+      return m_impl->pending();
+    }
+
+    bool operator==(strand const & other) const
+    {
+      return m_impl == other.m_impl;
+    }
+
+    bool operator!=(strand const & other) const
+    {
+      return m_impl != other.m_impl;
+    }
+  };
+
+
+
+  /*! \brief A fixed set of strands selected by key.
+  *
+  * Tasks with the same key run one at a time in order. Keys which map to
+  * the same strand are serialized with each other as well, the number of
+  * strands trades this against memory.
+  */
+  template <typename Pool>
+  class strand_group
+  {
+    std::vector<strand<Pool> > m_strands;
+
+  public:
+    strand_group(Pool & pool, std::size_t const count, std::size_t const batch = 64)
+    {
+      m_strands.reserve(count);
+      for(std::size_t i = 0; i < count; ++i)
+      {
+        m_strands.push_back(strand<Pool>(pool, batch));
+      }
+    }
+
+    strand<Pool> & operator[](std::size_t const key)
+    {
+      return m_strands[key % m_strands.size()];
+    }
+
+    void schedule(std::size_t const key, task_func const & task)
+    {
+      (*this)[key].schedule(task);
+    }
+
+    std::size_t size() const
+    {
+      return m_strands.size();
+    }
+  };
+
+
+} } // namespace boost::threadpool
+
+#endif // THREADPOOL_STRAND_HPP_INCLUDED
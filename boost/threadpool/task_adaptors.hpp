@@ -22,6 +22,8 @@
 #include <boost/function.hpp>
 #include <boost/thread.hpp>
 
+#include <cstring>
+
 
 namespace boost { namespace threadpool
 {
@@ -38,6 +40,118 @@ namespace boost { namespace threadpool
 
 
 
+  /*! \brief Label of a task for accounting purposes.
+  *
+  * A tag is attached to a task when it is scheduled. The pool charges the
+  * CPU time and hardware counters of the task to its tag. A tag is either
+  * a string with static storage duration or a numeric id.
+  *
+  * \see tag_stats
+  *
+  */ 
+  class task_tag
+  {
+  private:
+    char const * m_name;    //!< Static string or 0.
+    unsigned int m_id;      //!< Numeric id, used if m_name is 0.
+
+  public:
+    /*! Constructs the empty tag. Untagged tasks are not accounted.
+    */
+    task_tag()
+      : m_name(0)
+      , m_id(0)
+    {
+    }
+
+    /*! Constructor.
+    * \param name A string literal or another string which outlives the pool.
+    */
+    task_tag(char const * const name)
+      : m_name(name)
+      , m_id(0)
+    {
+    }
+
+    /*! Constructor.
+    * \param id A numeric id, must not be 0.
+    */
+    explicit task_tag(unsigned int const id)
+      : m_name(0)
+      , m_id(id)
+    {
+    }
+
+    char const * name() const
+    {
+      return m_name;
+    }
+
+    unsigned int id() const
+    {
+      return m_id;
+    }
+
+    /*! Checks if the tag is not the empty tag.
+    */
+    bool empty() const
+    {
+      return m_name == 0 && m_id == 0;
+    }
+
+    bool operator== (task_tag const & rhs) const
+    {
+      return !(*this < rhs) && !(rhs < *this);
+    }
+
+    /*! Strict weak ordering: numeric ids first, then names by content.
+    */
+    bool operator< (task_tag const & rhs) const
+    {
+      if(m_name == 0 || rhs.m_name == 0)
+      {
+        return m_name == 0 && rhs.m_name == 0 ? m_id < rhs.m_id : m_name == 0;
+      }
+      return std::strcmp(m_name, rhs.m_name) < 0;
+    }
+  };
+
+
+
+
+  /*! \brief Task function object made of a plain function pointer and its argument.
+  *
+  * For callers which keep their state elsewhere, like the frame of a
+  * suspended coroutine. The object is two pointers large, so task_func
+  * stores it in its small object buffer instead of allocating.
+  *
+  */ 
+  class raw_task_func
+  {
+  private:
+    void (*m_function)(void *);   //!< The function to call.
+    void * m_argument;            //!< The argument passed to m_function.
+
+  public:
+    typedef void result_type; //!< Indicates the functor's result type.
+
+  public:
+    raw_task_func(void (*function)(void *), void * const argument)
+      : m_function(function)
+      , m_argument(argument)
+    {
+    }
+
+    /*! Calls the function with its argument.
+    */
+    void operator() (void) const
+    {
+      m_function(m_argument);
+    }
+  };
+
+
+
 
   /*! \brief Prioritized task function object. 
   *
@@ -58,6 +172,13 @@ namespace boost { namespace threadpool
     typedef void result_type; //!< Indicates the functor's result type.
 
   public:
+    /*! Constructs a task with priority 0 and no function.
+    */
+    prio_task_func()
+      : m_priority(0)
+    {
+    }
+
     /*! Constructor.
     * \param priority The priority of the task.
     * \param function The task's function object.
@@ -68,6 +189,13 @@ namespace boost { namespace threadpool
     {
     }
 
+    /*! Gets the priority of the task.
+    */
+    unsigned int priority() const
+    {
+      return m_priority;
+    }
+
     /*! Executes the task function.
     */
     void operator() (void) const
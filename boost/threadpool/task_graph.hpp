@@ -0,0 +1,297 @@
+/*! \file
+* \brief Task dependency graph.
+*
+* A task_graph holds tasks and the order constraints between them. run
+* schedules the tasks without predecessors; when a task finishes it
+* decrements an atomic counter of each successor and schedules those whose
+* predecessors all finished. Independent branches therefore proceed without
+* barriers between layers of the graph.
+*
+* The graph is built once and can be run any number of times, one run at a
+* time. Only the counters are reset between runs.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#ifndef THREADPOOL_TASK_GRAPH_HPP_INCLUDED
+#define THREADPOOL_TASK_GRAPH_HPP_INCLUDED
+
+#include <boost/threadpool/task_adaptors.hpp>
+
+#include <boost/assert.hpp>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr/scoped_array.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstddef>
+#include <vector>
+
+
+namespace boost { namespace threadpool
+{
+
+  //! thrown by task_graph::run if the edges form a cycle
+  struct graph_cycle{};
+
+
+  /*! \brief Tasks with dependencies, executed by a pool.
+  *
+  * Nodes and edges must not be added while the graph runs. Tasks must not throw.
+  *
+  * \param Pool A pool whose tasks are task_func objects, e.g. fifo_pool or lifo_pool_core.
+  */
+  template <typename Pool>
+  class task_graph
+    : private noncopyable
+  {
+  public:
+    typedef std::size_t node_id;
+
+  private:
+    struct node
+    {
+      task_graph * graph;
+      task_func task;
+      task_tag tag;
+      std::size_t predecessors;             //!< Number of incoming edges.
+      std::vector<node_id> successors;
+    };
+
+    Pool & m_pool;
+    std::vector<node> m_nodes;
+    std::vector<node_id> m_roots;           //!< Nodes without predecessors, valid unless m_changed.
+    bool m_changed;                         //!< Nodes or edges were added since the last run.
+    scoped_array<atomic<std::size_t> > m_pending;   //!< Unfinished predecessors of each node during a run.
+    std::size_t m_pending_size;
+    atomic<std::size_t> m_remaining;        //!< Nodes of the current run which did not finish yet.
+
+    mutex m_mutex;
+    condition_variable m_done_event;
+    bool m_running;                         //!< Protected by m_mutex.
+
+  public:
+    explicit task_graph(Pool & pool)
+      : m_pool(pool)
+      , m_changed(false)
+      , m_pending_size(0)
+      , m_remaining(0)
+      , m_running(false)
+    {
+    }
+
+    /*! Destructor. Waits for the current run.
+    */
+    ~task_graph()
+    {
+      wait();
+    }
+
+    /*! Adds a task.
+    * \param tag The tag the task is scheduled with.
+    * \return The node's id, for add_edge.
+    */
+    node_id add_node(task_func const & task, task_tag const & tag = task_tag())
+    {
+      BOOST_ASSERT(!running());
+      node n;
+      n.graph = this;
+      n.task = task;
+      n.tag = tag;
+      n.predecessors = 0;
+      m_nodes.push_back(n);
+      m_changed = true;
+      return m_nodes.size() - 1;
+    }
+
+    /*! Lets the task of after start only when the task of before finished.
+    */
+    void add_edge(node_id const before, node_id const after)
+    {
+      BOOST_ASSERT(!running());
+      BOOST_ASSERT(before < m_nodes.size() && after < m_nodes.size());
+      m_nodes[before].successors.push_back(after);
+      m_nodes[after].predecessors++;
+      m_changed = true;
+    }
+
+    std::size_t size() const
+    {
+      return m_nodes.size();
+    }
+
+    /*! Starts a run and returns immediately. Must not be called while the graph runs.
+    * \throws graph_cycle if the edges form a cycle, nothing is scheduled then.
+    * If scheduling a root throws, the exception passes on. The run then consists of the
+    * nodes which depend only on the roots scheduled before, wait for them as usual.
+    */
+    void run()
+    {
+      BOOST_ASSERT(!running());
+      if(m_changed)
+      {
+        prepare();
+      }
+      if(m_nodes.empty())
+      {
+        return;
+      }
+      for(std::size_t i = 0; i < m_nodes.size(); ++i)
+      {
+        m_pending[i].store(m_nodes[i].predecessors, memory_order_relaxed);
+      }
+      m_remaining.store(m_nodes.size(), memory_order_relaxed);
+      {
+        mutex::scoped_lock lock(m_mutex);
+        m_running = true;
+      }
+      std::size_t released = 0;
+      try
+      {
+        for(; released < m_roots.size(); ++released)
+        {
+          release(m_nodes[m_roots[released]]);
+        }
+      }
+      catch(...)
+      {
+        std::size_t const dropped = unreachable_nodes(released);
+        if(m_remaining.fetch_sub(dropped, memory_order_acq_rel) == dropped)
+        {
+          // the released nodes finished already, or none was released
+          mutex::scoped_lock lock(m_mutex);
+          m_running = false;
+          m_done_event.notify_all();
+        }
+        throw;
+      }
+    }
+
+    /*! Blocks until the current run finished. Returns immediately if the graph does not run.
+    */
+    void wait()
+    {
+      mutex::scoped_lock lock(m_mutex);
+      while(m_running)
+      {
+        m_done_event.wait(lock);
+      }
+    }
+
+    bool running()
+    {
+      mutex::scoped_lock lock(m_mutex);
+      return m_running;
+    }
+
+  private:
+    /*! Finds the roots and checks for cycles by removing nodes in topological order.
+    */
+    void prepare()
+    {
+      std::vector<std::size_t> predecessors(m_nodes.size());
+      std::vector<node_id> ready;
+      m_roots.clear();
+      for(std::size_t i = 0; i < m_nodes.size(); ++i)
+      {
+        predecessors[i] = m_nodes[i].predecessors;
+        if(predecessors[i] == 0)
+        {
+          m_roots.push_back(i);
+          ready.push_back(i);
+        }
+      }
+      std::size_t removed = 0;
+      while(!ready.empty())
+      {
+        node const & n = m_nodes[ready.back()];
+        ready.pop_back();
+        ++removed;
+        for(std::vector<node_id>::const_iterator it = n.successors.begin(); it != n.successors.end(); ++it)
+        {
+          if(--predecessors[*it] == 0)
+          {
+            ready.push_back(*it);
+          }
+        }
+      }
+      if(removed != m_nodes.size())
+      {
+        throw graph_cycle();
+      }
+
+      if(m_pending_size < m_nodes.size())
+      {
+        m_pending.reset(new atomic<std::size_t>[m_nodes.size()]);
+        m_pending_size = m_nodes.size();
+      }
+      m_changed = false;
+    }
+
+    /*! Counts the nodes which do not run when only the first roots are released.
+    * A node runs if all of its predecessors run.
+    */
+    std::size_t unreachable_nodes(std::size_t const released_roots) const
+    {
+      std::vector<std::size_t> predecessors(m_nodes.size());
+      for(std::size_t i = 0; i < m_nodes.size(); ++i)
+      {
+        predecessors[i] = m_nodes[i].predecessors;
+      }
+      std::vector<node_id> ready(m_roots.begin(), m_roots.begin() + released_roots);
+      std::size_t reached = 0;
+      while(!ready.empty())
+      {
+        node const & n = m_nodes[ready.back()];
+        ready.pop_back();
+        ++reached;
+        for(std::vector<node_id>::const_iterator it = n.successors.begin(); it != n.successors.end(); ++it)
+        {
+          if(--predecessors[*it] == 0)
+          {
+            ready.push_back(*it);
+          }
+        }
+      }
+      return m_nodes.size() - reached;
+    }
+
+    void release(node & n)
+    {
+      m_pool.schedule(raw_task_func(&execute, &n), n.tag);
+    }
+
+    static void execute(void * const p)
+    {
+      node & n = *static_cast<node *>(p);
+      task_graph & graph = *n.graph;
+      n.task();
+      for(std::vector<node_id>::const_iterator it = n.successors.begin(); it != n.successors.end(); ++it)
+      {
+        if(graph.m_pending[*it].fetch_sub(1, memory_order_acq_rel) == 1)
+        {
+          graph.release(graph.m_nodes[*it]);
+        }
+      }
+      if(graph.m_remaining.fetch_sub(1, memory_order_acq_rel) == 1)
+      {
+        // notify under the lock, a waiter may destroy the graph as soon as it sees the run finished
+        mutex::scoped_lock lock(graph.m_mutex);
+        graph.m_running = false;
+        graph.m_done_event.notify_all();
+      }
+    }
+  };
+
+
+} } // namespace boost::threadpool
+
+#endif // THREADPOOL_TASK_GRAPH_HPP_INCLUDED
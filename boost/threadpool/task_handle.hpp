@@ -0,0 +1,91 @@
+/*! \file
+* \brief Handles of queued tasks.
+*
+* A task_handle refers to a task which was scheduled on a pool whose
+* scheduler supports tickets, like indexed_prio_scheduler. While the task
+* is still queued, the handle can change its priority or remove it.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Use, modification, and distribution are  subject to the
+* Boost Software License, Version 1.0. (See accompanying  file
+* LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+
+#ifndef THREADPOOL_TASK_HANDLE_HPP_INCLUDED
+#define THREADPOOL_TASK_HANDLE_HPP_INCLUDED
+
+#include <boost/smart_ptr.hpp>
+
+
+namespace boost { namespace threadpool
+{
+
+  /*! \brief Handle of a queued task.
+  *
+  * Returned by pool_core::schedule_with_handle. The handle does not keep the
+  * pool alive and becomes inert once the task started, was removed or the
+  * pool was destroyed. Handles are cheap to copy.
+  *
+  * \param Pool The pool_core type the task was scheduled on.
+  *
+  * \see indexed_prio_scheduler
+  */
+  template <typename Pool>
+  class task_handle
+  {
+  public:
+    typedef typename Pool::queue_policy_type::ticket_type ticket_type; //!< Indicates the scheduler's ticket type.
+
+  private:
+    weak_ptr<Pool> m_pool;
+    ticket_type m_ticket;
+
+  public:
+    /*! Constructs a handle which refers to no task.
+    */
+    task_handle()
+    {
+    }
+
+    task_handle(weak_ptr<Pool> const & pool, ticket_type const & ticket)
+      : m_pool(pool)
+      , m_ticket(ticket)
+    {
+    }
+
+    /*! Checks if the task is still queued.
+    */
+    bool pending() const
+    {
+      shared_ptr<Pool> const pool = m_pool.lock();
+      return pool && pool->task_pending(m_ticket);
+    }
+
+    /*! Changes the priority of the task if it is still queued.
+    * \return false if the task already started or was removed.
+    */
+    bool reprioritize(unsigned int const priority) const
+    {
+      shared_ptr<Pool> const pool = m_pool.lock();
+      return pool && pool->reprioritize_task(m_ticket, priority);
+    }
+
+    /*! Removes the task from the queue if it is still queued, the task is not executed.
+    * \return false if the task already started or was removed.
+    */
+    bool remove() const
+    {
+      shared_ptr<Pool> const pool = m_pool.lock();
+      return pool && pool->remove_task(m_ticket);
+    }
+  };
+
+
+} } // namespace boost::threadpool
+
+#endif // THREADPOOL_TASK_HANDLE_HPP_INCLUDED
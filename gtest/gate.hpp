@@ -0,0 +1,61 @@
+#pragma once
+
+#include <boost/threadpool.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+//this file contains the gate the test cases use to keep workers busy
+
+//! a task which occupies its worker until the gate is opened
+class test_gate
+{
+	boost::atomic<bool> m_open;
+
+public:
+	test_gate()
+		: m_open(false)
+	{
+	}
+
+	void open(){
+		m_open = true;
+	};
+
+	void close(){
+		m_open = false;
+	};
+
+	bool is_open() const{
+		return m_open;
+	};
+
+	//! occupies the calling thread until open is called
+	void wait() const{
+		while(!m_open){
+			boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+		}
+	};
+
+	task_func task(){
+		return boost::bind(&test_gate::wait, this);
+	};
+
+	//! schedule the gate's task and wait until a worker runs it, so the queue is empty
+	template <class Pool>
+	void block_worker(Pool & pool){
+		pool.schedule(make_task(static_cast<typename Pool::task_type const *>(0)));
+		while(pool.processing_workers_count() == 0){
+			boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+		}
+	};
+
+private:
+	task_func make_task(task_func const *){
+		return task();
+	};
+
+	prio_task_func make_task(prio_task_func const *){
+		return prio_task_func(0, task());
+	};
+};
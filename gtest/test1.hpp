@@ -3,6 +3,7 @@
 #include <boost/threadpool.hpp>
 
 #include <gtest/gtest.h>
+#include <gtest/gate.hpp>
 
 #include <boost/thread.hpp>
 
@@ -42,6 +43,44 @@ public:
 		sleep(milliseconds(10));
 	};
 
+	int called(){
+		boost::mutex::scoped_lock lock(m);
+		return test_task_called_counter;
+	};
+
+	test_gate gate;
+
+	std::vector<int> order;
+
+	//! records n and schedules the next link until n reaches last
+	void chain_task(fifo_pool * pool, int n, int last){
+		{
+			boost::mutex::scoped_lock lock(m);
+			order.push_back(n);
+		}
+		if(n < last){
+			pool->schedule(boost::bind(&test1::chain_task,this,pool,n + 1,last));
+		}
+	};
+
+	void start_chains(fifo_pool * pool){
+		chain_task(pool, 100, 100);
+		pool->schedule(boost::bind(&test1::chain_task,this,pool,-1,-1));
+		pool->schedule(boost::bind(&test1::chain_task,this,pool,1,6));
+	};
+
+	//! schedules a follow-up which opens the gate and waits for it outside a blocking region
+	void schedule_and_wait(fifo_pool * pool){
+		pool->schedule(boost::bind(&test_gate::open,&gate));
+		gate.wait();
+	};
+
+	void schedule_many(task_func t, int count){
+		while(count--){
+			p1.schedule(t);
+		}
+	};
+
 	
 };
 
@@ -58,6 +97,18 @@ TEST_F(test1 , basicUsage){
 	EXPECT_EQ(2,test_task_called_counter);
 };
 
+TEST_F(test1 , waitForAllTaskDoneWaitsForRunningTasks){
+	gate.block_worker(p2);
+	EXPECT_EQ(0, p2.pending_tasks_count());
+
+	// the queue is empty, but the gate task still runs
+	boost::thread waiter(boost::bind(&fifo_pool::wait_for_all_task_done, &p2));
+	EXPECT_FALSE(waiter.try_join_for(boost::chrono::milliseconds(50)));
+	gate.open();
+	EXPECT_TRUE(waiter.try_join_for(boost::chrono::seconds(10)));
+	EXPECT_EQ(0, p2.processing_workers_count());
+}
+
 TEST_F(test1 , resize1000Times){
 	task_func t(boost::bind(&test1::test_task,this));
 
@@ -136,4 +187,108 @@ TEST_F(test1,taskExecuteSpeed){
 	boost::chrono::milliseconds ms = duration_cast<boost::chrono::milliseconds>(system_clock::now() - begin_time);	
 
 	EXPECT_LT(ms , boost::chrono::milliseconds((loop * 10 / 10) + (loop * 1)));
-}
\ No newline at end of file
+}
+TEST_F(test1,shardedSubmissionRunsAllTasks){
+	p1.set_submission_shards(4);
+	task_func t(boost::bind(&test1::test_task,this));
+
+	// single tasks wake the parked workers, which take no lock a producer holds
+	for(int i = 0; i < 200; ++i){
+		p1.schedule(t);
+		for(int j = 0; j < 1000 && called() != i + 1; ++j){
+			sleep(boost::posix_time::microseconds(100));
+		}
+		ASSERT_EQ(i + 1, called());
+	}
+
+	boost::thread_group producers;
+	for(int i = 0; i < 8; ++i){
+		producers.create_thread(boost::bind(&test1::schedule_many,this,t,5000));
+	}
+	producers.join_all();
+	p1.wait_for_all_task_done();
+
+	EXPECT_EQ(200 + 8 * 5000, test_task_called_counter);
+	EXPECT_EQ(200u + 8 * 5000, p1.stats().queue.scheduled);
+	EXPECT_EQ(0, p1.pending_tasks_count());
+}
+
+TEST_F(test1,shardedSubmissionKeepsReservedClass){
+	fifo_pool pool(2);
+	EXPECT_TRUE(pool.set_submission_shards(4));
+	EXPECT_FALSE(pool.set_submission_shards(8));
+	pool.reserve_workers(task_tag("control"), 1);
+	gate.block_worker(pool);
+	// the tagged task goes to the reserved queue instead of a shard, the reserved worker runs it
+	task_func t(boost::bind(&test1::test_task,this));
+	pool.schedule(t, task_tag("control"));
+	for(int i = 0; i < 1000 && called() != 1; ++i){
+		sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(1, called());
+	for(int i = 0; i < 20; ++i){
+		pool.schedule(t);
+	}
+	gate.open();
+	pool.wait_for_all_task_done();
+	EXPECT_EQ(21, called());
+	EXPECT_EQ(22u, pool.stats().queue.scheduled);
+	pool.terminate();
+	pool.wait_for_all_worker_exit();
+}
+
+TEST_F(test1,shardsAndQueueLimitsExcludeEachOther){
+	fifo_pool pool(1);
+	EXPECT_TRUE(pool.set_queue_limits(10));
+	EXPECT_FALSE(pool.set_submission_shards(4));
+	EXPECT_TRUE(pool.set_queue_limits(0));
+	EXPECT_TRUE(pool.set_submission_shards(4));
+	EXPECT_FALSE(pool.set_queue_limits(10));
+	EXPECT_FALSE(pool.set_queue_limits(0, 1024));
+	pool.terminate();
+	pool.wait_for_all_worker_exit();
+}
+
+TEST_F(test1,runNextFollowsChainWithFairnessLimit){
+	fifo_pool pool(1);
+	pool.set_run_next_limit(2);
+	pool.schedule(boost::bind(&test1::start_chains,this,&pool));
+	pool.wait_for_all_task_done();
+
+	// -1 was displaced from the slot by 1, and waits in the queue until two links ran from the slot
+	int const expected[] = {100, 1, 2, -1, 3, 4, 5, 6};
+	ASSERT_EQ(8u, order.size());
+	EXPECT_TRUE(std::equal(expected, expected + 8, order.begin()));
+	EXPECT_EQ(8u, pool.stats().queue.scheduled);
+	pool.terminate();
+	pool.wait_for_all_worker_exit();
+}
+
+TEST_F(test1,runNextWhileTracing){
+	fifo_pool pool(1);
+	pool.set_run_next_limit(2);
+	pool.enable_tracing(256);
+	pool.schedule(boost::bind(&test1::start_chains,this,&pool));
+	pool.wait_for_all_task_done();
+
+	// the slots stay in use, the order is the one without tracing
+	int const expected[] = {100, 1, 2, -1, 3, 4, 5, 6};
+	ASSERT_EQ(8u, order.size());
+	EXPECT_TRUE(std::equal(expected, expected + 8, order.begin()));
+	pool.terminate();
+	pool.wait_for_all_worker_exit();
+}
+
+TEST_F(test1,runNextTaskIsTakenWhileItsWorkerWaits){
+	p1.set_run_next_limit(8);
+	p1.schedule(boost::bind(&test1::schedule_and_wait,this,&p1));
+	bool opened = false;
+	for(int i = 0; i < 2000 && !opened; ++i){
+		sleep(boost::posix_time::milliseconds(1));
+		opened = gate.is_open();
+	}
+	// a parked worker took the follow-up from the waiting worker's slot
+	EXPECT_TRUE(opened);
+	gate.open();
+	p1.wait_for_all_task_done();
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <boost/threadpool.hpp>
+#include <boost/threadpool/detail/shm_metrics.hpp>
+#include <boost/threadpool/detail/workload_record.hpp>
+
+#include <gtest/gtest.h>
+
+#include <boost/thread.hpp>
+
+#include <boost/chrono.hpp>
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+//this file contains test cases for the pool statistics
+
+class test2 : public ::testing::Test
+{	
+public:		
+	fifo_pool p1;
+
+	virtual void SetUp() {
+		p1.resize(2);
+	}
+
+	virtual void TearDown(){
+		p1.terminate();
+	}
+
+	void test_task_10ms(){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	};
+
+	void follow_up(){
+	};
+
+	void schedule_follow_up(){
+		p1.schedule(boost::bind(&test2::follow_up,this));
+	};
+
+	//! let the queued tasks finish and retire all workers, so the totals are complete
+	void drain(){
+		p1.wait_for_all_task_done();
+		p1.terminate();
+		p1.wait_for_all_worker_exit();
+	}
+};
+
+TEST_F(test2 , busyTimeOfTasks){
+	task_func t(boost::bind(&test2::test_task_10ms,this));
+
+	for(int i = 0 ; i < 4 ; i++){
+		p1.schedule(t);
+	}
+	drain();
+
+	pool_stats s = p1.stats();
+	EXPECT_EQ(0u, s.workers.size());
+	EXPECT_EQ(4u, s.total.tasks_executed);
+	EXPECT_GE(s.total.busy_time, boost::chrono::milliseconds(40));
+};
+
+TEST_F(test2 , idleWorkersAreParked){
+	boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+
+	pool_stats s = p1.stats();
+	ASSERT_EQ(2u, s.workers.size());
+	EXPECT_NE(s.workers[0].id, s.workers[1].id);
+	EXPECT_GE(s.workers[0].parked_time, boost::chrono::milliseconds(30));
+	EXPECT_EQ(0u, s.total.tasks_executed);
+	EXPECT_LT(s.total.utilisation(), 0.5);
+};
+
+TEST_F(test2 , wakeLatencyOfParkedWorker){
+	task_func t(boost::bind(&test2::test_task_10ms,this));
+
+	boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+	p1.schedule(t);
+	drain();
+
+	pool_stats s = p1.stats();
+	EXPECT_EQ(1u, s.total.wakeups);
+	EXPECT_GE(s.total.max_wake_latency, s.total.mean_wake_latency());
+	EXPECT_LT(s.total.max_wake_latency, boost::chrono::seconds(1));
+};
+
+TEST_F(test2 , chromeTraceOfTasks){
+	task_func t(boost::bind(&test2::test_task_10ms,this));
+
+	p1.enable_tracing(1024);
+	for(int i = 0 ; i < 3 ; i++){
+		p1.schedule(t);
+	}
+	drain();
+	p1.disable_tracing();
+
+	std::ostringstream out;
+	p1.write_chrome_trace(out);
+	std::string const json = out.str();
+
+	int tasks = 0;
+	for(std::string::size_type pos = json.find("\"name\":\"task\""); pos != std::string::npos; pos = json.find("\"name\":\"task\"", pos + 1)){
+		tasks++;
+	}
+	EXPECT_EQ(3, tasks);
+	EXPECT_NE(std::string::npos, json.find("\"name\":\"schedule\""));
+	EXPECT_NE(std::string::npos, json.find("\"name\":\"resize\""));
+	EXPECT_NE(std::string::npos, json.find("threadpool-0"));
+	EXPECT_EQ('}', json[json.find_last_not_of("\n")]);
+};
+
+void spin_10ms(){
+	boost::chrono::thread_clock::time_point const end = boost::chrono::thread_clock::now() + boost::chrono::milliseconds(10);
+	while(boost::chrono::thread_clock::now() < end){
+	}
+}
+
+TEST_F(test2 , cpuTimePerTag){
+	task_func spin(&spin_10ms);
+	task_func sleep(boost::bind(&test2::test_task_10ms,this));
+
+	p1.enable_hardware_counters();
+	p1.schedule(spin, "spin");
+	p1.schedule(spin, "spin");
+	p1.schedule(sleep, task_tag(7));
+	p1.schedule(sleep);
+	drain();
+
+	pool_stats s = p1.stats();
+	ASSERT_EQ(2u, s.tags.size());
+	EXPECT_EQ(7u, s.tags[0].tag.id());
+	EXPECT_EQ(1u, s.tags[0].tasks_executed);
+	EXPECT_LT(s.tags[0].cpu_time, boost::chrono::milliseconds(5));
+	EXPECT_GE(s.tags[0].wall_time, boost::chrono::milliseconds(10));
+	EXPECT_STREQ("spin", s.tags[1].tag.name());
+	EXPECT_EQ(2u, s.tags[1].tasks_executed);
+	EXPECT_GE(s.tags[1].cpu_time, boost::chrono::milliseconds(20));
+	if(s.tags[1].has_hardware_counters){
+		EXPECT_GT(s.tags[1].instructions, 0u);
+	}
+};
+
+TEST_F(test2 , lockProfile){
+	task_func task(boost::bind(&test2::test_task_10ms,this));
+	for(int i = 0; i < 4; ++i){
+		p1.schedule(task);
+	}
+	drain();
+
+	pool_stats s = p1.stats();
+#if defined(BOOST_THREADPOOL_LOCK_PROFILING)
+	bool schedule_site = false;
+	for(std::size_t i = 0; i < s.locks.size(); ++i){
+		EXPECT_GE(s.locks[i].acquisitions, s.locks[i].contended);
+		if(std::string(s.locks[i].mutex_name) == "task_queue_mutex" && std::string(s.locks[i].site_name) == "schedule"){
+			schedule_site = true;
+			EXPECT_EQ(4u, s.locks[i].acquisitions);
+		}
+	}
+	EXPECT_TRUE(schedule_site);
+#else
+	EXPECT_TRUE(s.locks.empty());
+#endif
+};
+
+#if defined(THREADPOOL_HAS_SHM_METRICS)
+TEST_F(test2 , sharedMemoryMetrics){
+	ASSERT_TRUE(p1.enable_metrics_export("test2.metrics"));
+	task_func task(boost::bind(&test2::test_task_10ms,this));
+	for(int i = 0; i < 4; ++i){
+		p1.schedule(task);
+	}
+	p1.wait_for_all_task_done();
+
+	bool found = false;
+	for(int n = 0; n < 64 && !found; ++n){
+		char path[64];
+		std::sprintf(path, "/threadpool.%ld.%d", static_cast<long>(getpid()), n);
+		boost::threadpool::detail::shm_metrics_view view(path);
+		if(!view.valid() || std::string(view.header().name) != "test2.metrics"){
+			continue;
+		}
+		found = true;
+		EXPECT_EQ(4u, view.header().scheduled.load());
+		EXPECT_EQ(0u, view.header().pending.load());
+		EXPECT_EQ(2u, view.header().workers.load());
+		uint64_t executed = 0, waits = 0, runs = 0;
+		for(std::size_t i = 0; i < view.header().slot_count; ++i){
+			executed += view.slot(i).executed.load();
+			for(std::size_t b = 0; b < view.header().bucket_count; ++b){
+				waits += view.slot(i).queue_wait[b].load();
+				runs += view.slot(i).run_time[b].load();
+			}
+			EXPECT_EQ(0u, view.slot(i).run_time[0].load());
+		}
+		EXPECT_EQ(4u, executed);
+		EXPECT_EQ(4u, waits);
+		EXPECT_EQ(4u, runs);
+	}
+	EXPECT_TRUE(found);
+	drain();
+};
+#endif
+
+#if defined(THREADPOOL_HAS_SHM_METRICS)
+TEST_F(test2 , shardedAndRunNextTasksAreObserved){
+	p1.set_submission_shards(2);
+	p1.set_run_next_limit(4);
+	p1.enable_tracing(1024);
+	ASSERT_TRUE(p1.enable_metrics_export("test2.sharded"));
+	// the tasks go to the shards, their follow-ups to the slots
+	for(int i = 0; i < 3; ++i){
+		p1.schedule(boost::bind(&test2::schedule_follow_up,this));
+	}
+	p1.wait_for_all_task_done();
+	p1.disable_tracing();
+
+	std::ostringstream out;
+	p1.write_chrome_trace(out);
+	std::string const json = out.str();
+	int schedules = 0;
+	for(std::string::size_type pos = json.find("\"name\":\"schedule\""); pos != std::string::npos; pos = json.find("\"name\":\"schedule\"", pos + 1)){
+		schedules++;
+	}
+	EXPECT_EQ(6, schedules);
+	EXPECT_EQ(6u, p1.stats().queue.scheduled);
+
+	bool found = false;
+	for(int n = 0; n < 64 && !found; ++n){
+		char path[64];
+		std::sprintf(path, "/threadpool.%ld.%d", static_cast<long>(getpid()), n);
+		boost::threadpool::detail::shm_metrics_view view(path);
+		if(!view.valid() || std::string(view.header().name) != "test2.sharded"){
+			continue;
+		}
+		found = true;
+		EXPECT_EQ(6u, view.header().scheduled.load());
+		EXPECT_EQ(0u, view.header().pending.load());
+	}
+	EXPECT_TRUE(found);
+	drain();
+};
+#endif
+
+TEST_F(test2 , workloadRecording){
+	char const * const path = "test2_workload.bin";
+	ASSERT_TRUE(p1.enable_recording(path));
+	task_func task(boost::bind(&test2::test_task_10ms,this));
+	p1.schedule(task, "io");
+	p1.schedule(task, task_tag(3));
+	p1.schedule(task);
+	p1.wait_for_all_task_done();
+	p1.disable_recording();
+
+	boost::threadpool::detail::workload_reader reader(path);
+	ASSERT_TRUE(reader.valid());
+	boost::threadpool::detail::recorded_task r;
+	int tasks = 0, io = 0, id3 = 0;
+	while(reader.next(r)){
+		tasks++;
+		if(r.tag.name() && std::string(r.tag.name()) == "io") io++;
+		if(r.tag.id() == 3) id3++;
+		EXPECT_GE(r.arrival, 0);
+		EXPECT_GE(r.queue_wait, 0);
+		EXPECT_GE(r.run, 10000000);
+	}
+	EXPECT_EQ(3, tasks);
+	EXPECT_EQ(1, io);
+	EXPECT_EQ(1, id3);
+	std::remove(path);
+	drain();
+};
+
+TEST_F(test2 , workloadReaderRejectsLongTagName){
+	char const * const path = "test2_corrupt.bin";
+	// header, tag record 1 with a name length of 2^40
+	unsigned char const bytes[] = { 'T', 'P', 'W', 'R', 1, 0, 0, 0, 0, 1, 1, 0x80, 0x80, 0x80, 0x80, 0x80, 0x20 };
+	std::FILE * const file = std::fopen(path, "wb");
+	ASSERT_TRUE(file != 0);
+	std::fwrite(bytes, 1, sizeof(bytes), file);
+	std::fclose(file);
+
+	boost::threadpool::detail::workload_reader reader(path);
+	ASSERT_TRUE(reader.valid());
+	boost::threadpool::detail::recorded_task r;
+	EXPECT_FALSE(reader.next(r));
+	EXPECT_FALSE(reader.valid());
+	std::remove(path);
+};
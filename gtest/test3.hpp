@@ -0,0 +1,405 @@
+#pragma once
+
+#include <boost/threadpool.hpp>
+
+#include <gtest/gtest.h>
+#include <gtest/gate.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <boost/chrono.hpp>
+
+#include <set>
+#include <sstream>
+#include <string>
+//this file contains test cases for the bounded task queue, admission control, reserved workers, affinity routing and compensating workers
+
+class test3 : public ::testing::Test
+{
+public:
+	fifo_pool p1;
+	test_gate gate;
+	boost::atomic<int> executed;
+
+	virtual void SetUp() {
+		executed = 0;
+		p1.resize(1);
+	}
+
+	virtual void TearDown(){
+		gate.open();
+		p1.terminate();
+		p1.wait_for_all_worker_exit();
+	}
+
+	//! occupies the worker in a blocking region until the gate is opened
+	void blocking_gate_task(){
+		blocking_region region;
+		gate.wait();
+	};
+
+	void counting_task(int id){
+		executed += id;
+	};
+
+	void record_thread(boost::mutex & m, std::set<boost::thread::id> & threads){
+		boost::mutex::scoped_lock lock(m);
+		threads.insert(boost::this_thread::get_id());
+		executed++;
+	};
+};
+
+TEST_F(test3 , tryScheduleRejectsWhenFull){
+	p1.set_queue_limits(2);
+	gate.block_worker(p1);
+
+	EXPECT_TRUE(p1.try_schedule(boost::bind(&test3::counting_task,this,1)));
+	EXPECT_TRUE(p1.try_schedule(boost::bind(&test3::counting_task,this,2)));
+	EXPECT_FALSE(p1.try_schedule(boost::bind(&test3::counting_task,this,4)));
+	EXPECT_EQ(2, p1.pending_tasks_count());
+
+	gate.open();
+	p1.wait_for_all_task_done();
+	EXPECT_EQ(3, executed);
+
+	pool_stats s = p1.stats();
+	EXPECT_EQ(1u, s.queue.rejected);
+	EXPECT_EQ(0u, s.queue.dropped);
+	EXPECT_EQ(3u, s.queue.scheduled);
+	EXPECT_EQ(0, s.queue.pending);
+	EXPECT_EQ(0u, s.queue.pending_bytes);
+};
+
+TEST_F(test3 , dropOldest){
+	p1.set_queue_limits(2);
+	p1.set_overflow_policy(overflow_drop_next);
+	gate.block_worker(p1);
+
+	EXPECT_TRUE(p1.try_schedule(boost::bind(&test3::counting_task,this,1)));
+	EXPECT_TRUE(p1.try_schedule(boost::bind(&test3::counting_task,this,2)));
+	EXPECT_TRUE(p1.try_schedule(boost::bind(&test3::counting_task,this,4)));
+	EXPECT_EQ(2, p1.pending_tasks_count());
+
+	gate.open();
+	p1.wait_for_all_task_done();
+	EXPECT_EQ(6, executed);
+	EXPECT_EQ(1u, p1.stats().queue.dropped);
+};
+
+TEST_F(test3 , byteLimit){
+	p1.set_queue_limits(0, 1000);
+	gate.block_worker(p1);
+
+	EXPECT_TRUE(p1.try_schedule(boost::bind(&test3::counting_task,this,1), task_tag(), 400));
+	EXPECT_TRUE(p1.try_schedule(boost::bind(&test3::counting_task,this,2), task_tag(), 400));
+	EXPECT_FALSE(p1.try_schedule(boost::bind(&test3::counting_task,this,4), task_tag(), 400));
+	EXPECT_GE(p1.stats().queue.pending_bytes, 800u);
+};
+
+TEST_F(test3 , scheduleForTimesOut){
+	p1.set_queue_limits(1);
+	gate.block_worker(p1);
+	p1.schedule(boost::bind(&test3::counting_task,this,1));
+
+	boost::chrono::steady_clock::time_point const begin = boost::chrono::steady_clock::now();
+	EXPECT_FALSE(p1.schedule_for(boost::bind(&test3::counting_task,this,2), boost::chrono::milliseconds(20)));
+	EXPECT_GE(boost::chrono::steady_clock::now() - begin, boost::chrono::milliseconds(20));
+	EXPECT_EQ(1u, p1.stats().queue.rejected);
+};
+
+TEST_F(test3 , scheduleBlocksUntilSpace){
+	p1.set_queue_limits(1);
+	gate.block_worker(p1);
+	p1.schedule(boost::bind(&test3::counting_task,this,1));
+
+	boost::thread producer(boost::bind(&fifo_pool::schedule, &p1, task_func(boost::bind(&test3::counting_task,this,2)), task_tag(), 0));
+	EXPECT_FALSE(producer.try_join_for(boost::chrono::milliseconds(20)));
+
+	gate.open();
+	producer.join();
+	p1.wait_for_all_task_done();
+	EXPECT_EQ(3, executed);
+	EXPECT_EQ(0u, p1.stats().queue.rejected);
+};
+
+TEST_F(test3 , expiredTasksAreDropped){
+	gate.block_worker(p1);
+	EXPECT_TRUE(p1.try_schedule_within(boost::bind(&test3::counting_task,this,1), boost::chrono::milliseconds(5)));
+	p1.schedule(boost::bind(&test3::counting_task,this,2));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+
+	gate.open();
+	p1.wait_for_all_task_done();
+	EXPECT_EQ(2, executed);
+
+	pool_stats s = p1.stats();
+	EXPECT_EQ(1u, s.queue.expired);
+	EXPECT_EQ(0u, s.queue.shed);
+};
+
+TEST_F(test3 , shedWhenPredictedWaitExceedsBudget){
+	for(int i = 0; i < 3; ++i){
+		p1.schedule(boost::bind(&boost::this_thread::sleep<boost::posix_time::milliseconds>, boost::posix_time::milliseconds(10)));
+	}
+	p1.wait_for_all_task_done();
+	EXPECT_GE(p1.stats().queue.mean_service_time, boost::chrono::milliseconds(5));
+
+	gate.block_worker(p1);
+	EXPECT_GE(p1.predicted_queue_wait(), boost::chrono::milliseconds(5));
+	EXPECT_FALSE(p1.try_schedule_within(boost::bind(&test3::counting_task,this,1), boost::chrono::milliseconds(1)));
+	EXPECT_TRUE(p1.try_schedule_within(boost::bind(&test3::counting_task,this,2), boost::chrono::seconds(10)));
+
+	gate.open();
+	p1.wait_for_all_task_done();
+	EXPECT_EQ(2, executed);
+	EXPECT_EQ(1u, p1.stats().queue.shed);
+};
+
+TEST_F(test3 , reservedWorkersRunCriticalTasks){
+	p1.reserve_workers(task_tag("control"), 1);
+	p1.resize(2);
+	p1.schedule(gate.task());
+	p1.schedule(gate.task());
+	boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+	EXPECT_EQ(1, p1.processing_workers_count());
+	EXPECT_EQ(1, p1.pending_tasks_count());
+
+	// the reserved worker runs the control task although a batch task is queued
+	p1.schedule(boost::bind(&test3::counting_task,this,1), task_tag("control"));
+	for(int i = 0; i < 1000 && executed == 0; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(1, executed);
+
+	pool_stats s = p1.stats();
+	ASSERT_EQ(2u, s.workers.size());
+	EXPECT_NE(s.workers[0].reserved, s.workers[1].reserved);
+
+	gate.open();
+	p1.wait_for_all_task_done();
+};
+
+TEST_F(test3 , reservedWorkersShareWhenIdle){
+	p1.reserve_workers(task_tag("control"), 1, false);
+	p1.resize(2);
+	p1.schedule(gate.task());
+	p1.schedule(gate.task());
+	for(int i = 0; i < 1000 && p1.processing_workers_count() < 2; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(2, p1.processing_workers_count());
+	gate.open();
+	p1.wait_for_all_task_done();
+};
+
+TEST_F(test3 , affineTasksStayOnTheirWorker){
+	p1.resize(4);
+	// the worker of a key depends on the number of workers, wait until all started
+	for(int i = 0; i < 1000 && p1.stats().workers.size() != 4; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	boost::mutex m;
+	std::set<boost::thread::id> threads;
+	for(int i = 0; i < 20; ++i){
+		p1.schedule_affine(boost::bind(&test3::record_thread,this,boost::ref(m),boost::ref(threads)), 7);
+		// wait until all workers are parked again, so the next task finds its worker free
+		for(int j = 0; j < 1000 && (executed != i + 1 || p1.processing_workers_count() != 0); ++j){
+			boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+		}
+	}
+	EXPECT_EQ(20, executed);
+	EXPECT_EQ(1u, threads.size());
+	pool_stats s = p1.stats();
+	EXPECT_EQ(20u, s.queue.affine);
+	EXPECT_EQ(0u, s.queue.stolen);
+};
+
+TEST_F(test3 , affineTaskWakesOnlyItsWorker){
+	p1.resize(4);
+	for(int i = 0; i < 1000 && p1.stats().workers.size() != 4; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	p1.enable_tracing(1024);
+	for(int i = 0; i < 10; ++i){
+		p1.schedule_affine(boost::bind(&test3::counting_task,this,1), 7);
+		for(int j = 0; j < 1000 && (executed != i + 1 || p1.processing_workers_count() != 0); ++j){
+			boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+		}
+	}
+	p1.disable_tracing();
+	EXPECT_EQ(10, executed);
+
+	// a parked period ends when its worker wakes, the other three workers stay parked
+	std::ostringstream out;
+	p1.write_chrome_trace(out);
+	std::string const json = out.str();
+	int wakes = 0;
+	for(std::string::size_type pos = json.find("\"name\":\"parked\""); pos != std::string::npos; pos = json.find("\"name\":\"parked\"", pos + 1)){
+		wakes++;
+	}
+	EXPECT_LE(wakes, 9);
+};
+
+TEST_F(test3 , affineTasksAreStolenFromBusyWorker){
+	p1.resize(2);
+	p1.schedule_affine(gate.task(), 3);
+	for(int i = 0; i < 1000 && p1.processing_workers_count() == 0; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	for(int i = 0; i < 3; ++i){
+		p1.schedule_affine(boost::bind(&test3::counting_task,this,1), 3);
+	}
+	// the worker of key 3 is blocked by the gate, the other one runs its tasks
+	for(int i = 0; i < 1000 && executed != 3; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(3, executed);
+	EXPECT_EQ(3u, p1.stats().queue.stolen);
+	gate.open();
+	p1.wait_for_all_task_done();
+};
+
+TEST_F(test3 , blockingRegionAddsWorker){
+	p1.set_compensation(1);
+	p1.schedule(boost::bind(&test3::blocking_gate_task,this));
+	for(int i = 0; i < 1000 && p1.stats().compensations == 0; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	// the added worker runs the task while the only other one blocks
+	p1.schedule(boost::bind(&test3::counting_task,this,1));
+	for(int i = 0; i < 1000 && executed == 0; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(1, executed);
+	pool_stats s = p1.stats();
+	EXPECT_EQ(1, s.compensating);
+	EXPECT_EQ(2u, s.workers.size());
+
+	// the added worker is retired when the region ends
+	gate.open();
+	for(int i = 0; i < 1000 && p1.total_workers_count() != 1; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(1, p1.total_workers_count());
+	EXPECT_EQ(0, p1.stats().compensating);
+};
+
+TEST_F(test3 , spareWorkerIsReused){
+	p1.set_compensation(1);
+	boost::mutex m;
+	std::set<boost::thread::id> threads;
+	for(int round = 1; round <= 3; ++round){
+		gate.close();
+		p1.schedule(boost::bind(&test3::blocking_gate_task,this));
+		p1.schedule(boost::bind(&test3::record_thread,this,boost::ref(m),boost::ref(threads)));
+		for(int i = 0; i < 1000 && executed != round; ++i){
+			boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+		}
+		EXPECT_EQ(round, executed);
+
+		// the retired worker stays as a spare one
+		gate.open();
+		for(int i = 0; i < 1000 && p1.stats().spare != 1; ++i){
+			boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+		}
+		pool_stats const s = p1.stats();
+		EXPECT_EQ(1, s.spare);
+		EXPECT_EQ(0, s.compensating);
+		EXPECT_EQ(1u, s.workers.size());
+		EXPECT_EQ(1, p1.total_workers_count());
+	}
+	EXPECT_EQ(3u, p1.stats().compensations);
+	// the gate task and the recording task ran on the same two threads each round
+	boost::mutex::scoped_lock lock(m);
+	EXPECT_GE(2u, threads.size());
+};
+
+TEST_F(test3 , parkedWorkerTakesBlockedShare){
+	p1.resize(2);
+	p1.set_compensation(1);
+	for(int i = 0; i < 1000; ++i){
+		pool_stats const s = p1.stats();
+		if(s.workers.size() == 2 && s.workers[0].parked_time.count() > 0 && s.workers[1].parked_time.count() > 0){
+			break;
+		}
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	p1.schedule(boost::bind(&test3::blocking_gate_task,this));
+	for(int i = 0; i < 1000 && p1.stats().compensations == 0; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	// the parked worker runs the next task, no thread is started for the blocked one
+	EXPECT_EQ(2, p1.total_workers_count());
+	p1.schedule(boost::bind(&test3::counting_task,this,1));
+	p1.schedule(gate.task());
+	// both workers wait in the gate now, so the owed worker is started
+	for(int i = 0; i < 1000 && p1.total_workers_count() != 3; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(3, p1.total_workers_count());
+	EXPECT_EQ(1, executed);
+};
+
+TEST_F(test3 , stuckWorkerIsCompensated){
+	p1.set_compensation(1, boost::chrono::milliseconds(20));
+	gate.block_worker(p1);
+	boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+	// scheduling finds the worker stuck in the gate task
+	p1.schedule(boost::bind(&test3::counting_task,this,1));
+	for(int i = 0; i < 1000 && executed == 0; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(1, executed);
+	EXPECT_EQ(1u, p1.stats().compensations);
+	gate.open();
+	for(int i = 0; i < 1000 && p1.total_workers_count() != 1; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(1, p1.total_workers_count());
+};
+
+TEST_F(test3 , stuckWorkerIsCompensatedSharded){
+	p1.set_submission_shards(4);
+	p1.set_compensation(1, boost::chrono::milliseconds(20));
+	gate.block_worker(p1);
+	boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+	// a producer which adds to a shard finds the stuck worker too
+	p1.schedule(boost::bind(&test3::counting_task,this,1));
+	for(int i = 0; i < 1000 && executed == 0; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(1, executed);
+	EXPECT_EQ(1u, p1.stats().compensations);
+	gate.open();
+	for(int i = 0; i < 1000 && p1.total_workers_count() != 1; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(1, p1.total_workers_count());
+};
+
+TEST_F(test3 , parkedWorkerTakesBlockedShareSharded){
+	p1.set_submission_shards(4);
+	p1.resize(2);
+	p1.set_compensation(1);
+	for(int i = 0; i < 1000; ++i){
+		pool_stats const s = p1.stats();
+		if(s.workers.size() == 2 && s.workers[0].parked_time.count() > 0 && s.workers[1].parked_time.count() > 0){
+			break;
+		}
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	p1.schedule(boost::bind(&test3::blocking_gate_task,this));
+	for(int i = 0; i < 1000 && p1.stats().compensations == 0; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(2, p1.total_workers_count());
+	p1.schedule(boost::bind(&test3::counting_task,this,1));
+	p1.schedule(gate.task());
+	// the owed worker is started from the sharded path as well
+	for(int i = 0; i < 1000 && p1.total_workers_count() != 3; ++i){
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	EXPECT_EQ(3, p1.total_workers_count());
+	EXPECT_EQ(1, executed);
+};
@@ -0,0 +1,329 @@
+#pragma once
+
+#include <boost/threadpool.hpp>
+#include <boost/threadpool/detail/pool_core.hpp>
+
+#include <gtest/gtest.h>
+#include <gtest/gate.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+//this file contains test cases for the scheduling policies
+
+class test4 : public ::testing::Test
+{
+public:
+	std::vector<int> order;
+	boost::mutex order_mutex;
+	test_gate gate;
+
+	void record(int id){
+		boost::mutex::scoped_lock lock(order_mutex);
+		order.push_back(id);
+	};
+
+	prio_task_func make_task(unsigned int priority, int id){
+		return prio_task_func(priority, boost::bind(&test4::record, this, id));
+	}
+
+	//! run and remove all tasks of a scheduler
+	template <class Scheduler>
+	void drain(Scheduler & s){
+		while(!s.empty()){
+			s.top()();
+			s.pop();
+		}
+	}
+};
+
+TEST_F(test4 , bucketSchedulerOrder){
+	bucket_prio_scheduler<> s;
+	s.push(make_task(3, 1));
+	s.push(make_task(1, 2));
+	s.push(make_task(3, 3));
+	s.push(make_task(1000, 4));
+	s.push(make_task(2, 5));
+	EXPECT_EQ(5, s.size());
+
+	drain(s);
+	int const expected[] = { 4, 1, 3, 5, 2 };
+	EXPECT_EQ(std::vector<int>(expected, expected + 5), order);
+};
+
+TEST_F(test4 , bucketSchedulerClear){
+	bucket_prio_scheduler<> s;
+	for(unsigned int i = 0; i < 300; i += 7){
+		s.push(make_task(i, i));
+	}
+	s.clear();
+	EXPECT_TRUE(s.empty());
+	s.push(make_task(0, 1));
+	drain(s);
+	EXPECT_EQ(1u, order.size());
+};
+
+TEST_F(test4 , bucketSchedulerAging){
+	bucket_prio_scheduler<> s;
+	s.set_aging(2);
+	s.push(make_task(0, -1));
+
+	// a steady stream of priority 10 tasks delays the low priority task by about 2 * 10 removals
+	int removed = 0;
+	for(; removed < 100; ++removed){
+		s.push(make_task(10, removed));
+		s.top()();
+		s.pop();
+		if(order.back() == -1){
+			break;
+		}
+	}
+	EXPECT_GE(removed, 15);
+	EXPECT_LE(removed, 25);
+};
+
+TEST_F(test4 , bucketPrioPool){
+	bucket_prio_pool_core_ptr pool = make_pool<bucket_prio_pool_core>();
+	pool->configure_scheduler(boost::bind(&bucket_prio_pool_core::queue_policy_type::set_aging, _1, 100));
+	pool->resize(1);
+	gate.block_worker(*pool);
+
+	pool->schedule(make_task(1, 1));
+	pool->schedule(make_task(5, 2));
+	pool->schedule(make_task(1, 3));
+	pool->schedule(make_task(5, 4));
+	gate.open();
+	pool->wait_for_all_task_done();
+	pool->terminate();
+	pool->wait_for_all_worker_exit();
+
+	int const expected[] = { 2, 4, 1, 3 };
+	EXPECT_EQ(std::vector<int>(expected, expected + 4), order);
+};
+
+TEST_F(test4 , multiQueueWithOneHeapIsExact){
+	multi_queue_scheduler<> s(1);
+	s.push(make_task(2, 2));
+	s.push(make_task(7, 7));
+	s.push(make_task(4, 4));
+	EXPECT_EQ(3, s.size());
+
+	prio_task_func task;
+	while(s.try_pop(task)){
+		task();
+	}
+	int const expected[] = { 7, 4, 2 };
+	EXPECT_EQ(std::vector<int>(expected, expected + 3), order);
+};
+
+TEST_F(test4 , multiQueueIsRoughlyOrdered){
+	multi_queue_scheduler<> s(4);
+	for(int i = 0; i < 400; ++i){
+		s.push(make_task(i, i));
+	}
+	// the first tenth removed should mostly come from the top half of the priorities
+	prio_task_func task;
+	int high = 0;
+	for(int i = 0; i < 40; ++i){
+		ASSERT_TRUE(s.try_pop(task));
+		task();
+		high += order.back() >= 200 ? 1 : 0;
+	}
+	EXPECT_GE(high, 35);
+	s.clear();
+	EXPECT_TRUE(s.empty());
+	EXPECT_FALSE(s.try_pop(task));
+};
+
+TEST_F(test4 , multiQueueConcurrentPushAndPop){
+	multi_queue_scheduler<> s(8);
+	boost::atomic<int> popped(0);
+	struct worker{
+		static void produce(multi_queue_scheduler<> * s, test4 * t, int first){
+			for(int i = first; i < first + 1000; ++i){
+				s->push(t->make_task(i % 64, i));
+			}
+		}
+		static void consume(multi_queue_scheduler<> * s, boost::atomic<int> * popped){
+			prio_task_func task;
+			while(*popped < 4000){
+				if(s->try_pop(task)){
+					task();
+					++*popped;
+				}
+			}
+		}
+	};
+	boost::thread_group threads;
+	for(int i = 0; i < 4; ++i){
+		threads.create_thread(boost::bind(&worker::produce, &s, this, i * 1000));
+		threads.create_thread(boost::bind(&worker::consume, &s, &popped));
+	}
+	threads.join_all();
+
+	EXPECT_TRUE(s.empty());
+	std::sort(order.begin(), order.end());
+	ASSERT_EQ(4000u, order.size());
+	for(int i = 0; i < 4000; ++i){
+		ASSERT_EQ(i, order[i]);
+	}
+};
+
+TEST_F(test4 , indexedSchedulerReprioritizeAndRemove){
+	indexed_prio_scheduler<> s;
+	indexed_prio_scheduler<>::ticket_type const a = s.push_ticket(make_task(1, 1));
+	indexed_prio_scheduler<>::ticket_type const b = s.push_ticket(make_task(5, 2));
+	indexed_prio_scheduler<>::ticket_type const c = s.push_ticket(make_task(3, 3));
+	s.push(make_task(3, 4));
+
+	EXPECT_TRUE(s.reprioritize(a, 9));
+	EXPECT_TRUE(s.reprioritize(b, 0));
+	prio_task_func removed;
+	EXPECT_TRUE(s.remove(c, removed));
+	EXPECT_FALSE(s.contains(c));
+	EXPECT_FALSE(s.remove(c, removed));
+	EXPECT_EQ(3, s.size());
+
+	drain(s);
+	int const expected[] = { 1, 4, 2 };
+	EXPECT_EQ(std::vector<int>(expected, expected + 3), order);
+
+	// tickets of removed tasks stay invalid when their storage is reused
+	s.push(make_task(1, 5));
+	EXPECT_FALSE(s.contains(a));
+	EXPECT_FALSE(s.reprioritize(a, 2));
+};
+
+TEST_F(test4 , indexedSchedulerKeepsHeapOrder){
+	indexed_prio_scheduler<> s;
+	std::vector<indexed_prio_scheduler<>::ticket_type> tickets;
+	std::vector<unsigned int> priority;
+	for(int i = 0; i < 200; ++i){
+		priority.push_back((i * 37) % 101);
+		tickets.push_back(s.push_ticket(make_task(priority.back(), i)));
+	}
+	prio_task_func removed;
+	for(int i = 0; i < 198; i += 3){
+		priority[i] = (i * 53) % 97;
+		EXPECT_TRUE(s.reprioritize(tickets[i], priority[i]));
+		EXPECT_TRUE(s.remove(tickets[i + 1], removed));
+	}
+
+	drain(s);
+	EXPECT_EQ(134u, order.size());
+	for(std::size_t i = 1; i < order.size(); ++i){
+		EXPECT_GE(priority[order[i - 1]], priority[order[i]]);
+	}
+};
+
+TEST_F(test4 , taskHandles){
+	indexed_prio_pool_core_ptr pool = make_pool<indexed_prio_pool_core>();
+	pool->resize(1);
+	gate.block_worker(*pool);
+
+	task_handle<indexed_prio_pool_core> const low = pool->schedule_with_handle(make_task(1, 1));
+	task_handle<indexed_prio_pool_core> const removed = pool->schedule_with_handle(make_task(2, 2));
+	pool->schedule(make_task(3, 3));
+	EXPECT_TRUE(low.pending());
+	EXPECT_TRUE(low.reprioritize(10));
+	EXPECT_TRUE(removed.remove());
+	EXPECT_FALSE(removed.pending());
+	EXPECT_EQ(2, pool->pending_tasks_count());
+
+	gate.open();
+	pool->wait_for_all_task_done();
+	EXPECT_FALSE(low.pending());
+	EXPECT_FALSE(low.reprioritize(0));
+	EXPECT_FALSE(low.remove());
+	pool->terminate();
+	pool->wait_for_all_worker_exit();
+
+	int const expected[] = { 1, 3 };
+	EXPECT_EQ(std::vector<int>(expected, expected + 2), order);
+	EXPECT_EQ(0u, pool->stats().queue.pending_bytes);
+};
+
+TEST_F(test4 , fairShareRoundRobin){
+	typedef boost::threadpool::detail::queued_task<task_func> entry;
+	fair_share_scheduler<> s;
+	s.set_weight(task_tag("a"), 3);
+	for(int i = 0; i < 8; ++i){
+		s.push(entry(boost::bind(&test4::record, this, 100 + i), task_tag("a"), 0));
+	}
+	for(int i = 0; i < 3; ++i){
+		s.push(entry(boost::bind(&test4::record, this, 200 + i), task_tag("b"), 0));
+	}
+	s.push(entry(boost::bind(&test4::record, this, 300), task_tag(), 0));
+
+	drain(s);
+	int const expected[] = { 100, 101, 102, 200, 300, 103, 104, 105, 201, 106, 107, 202 };
+	EXPECT_EQ(std::vector<int>(expected, expected + 12), order);
+
+	std::vector<class_stats> classes;
+	collect_class_stats(s, classes);
+	ASSERT_EQ(3u, classes.size());
+	EXPECT_TRUE(classes[0].tag.empty());
+	EXPECT_EQ(std::string("a"), classes[1].tag.name());
+	EXPECT_EQ(3u, classes[1].weight);
+	EXPECT_EQ(8u, classes[1].dispatched);
+	EXPECT_EQ(0, classes[1].pending);
+};
+
+TEST_F(test4 , fairSharePool){
+	fair_share_pool_core_ptr pool = make_pool<fair_share_pool_core>();
+	pool->resize(1);
+	gate.block_worker(*pool);
+
+	// a noisy tenant queued first does not delay the other one behind all of its tasks
+	for(int i = 0; i < 10; ++i){
+		pool->schedule(boost::bind(&test4::record, this, 1), task_tag("noisy"));
+	}
+	pool->schedule(boost::bind(&test4::record, this, 2), task_tag("quiet"));
+
+	pool_stats s = pool->stats();
+	ASSERT_EQ(3u, s.classes.size());
+	EXPECT_EQ(10, s.classes[1].pending);
+	EXPECT_EQ(1, s.classes[2].pending);
+
+	gate.open();
+	pool->wait_for_all_task_done();
+	pool->terminate();
+	pool->wait_for_all_worker_exit();
+
+	ASSERT_EQ(11u, order.size());
+	EXPECT_EQ(2, order[1]);
+	s = pool->stats();
+	EXPECT_EQ(10u, s.classes[1].dispatched);
+	EXPECT_EQ(0, s.classes[1].pending);
+};
+
+TEST_F(test4 , fairSharePoolCountsShardedAndAffineTasks){
+	fair_share_pool_core_ptr pool = make_pool<fair_share_pool_core>();
+	pool->resize(1);
+	EXPECT_TRUE(pool->set_submission_shards(2));
+	gate.block_worker(*pool);
+
+	for(int i = 0; i < 3; ++i){
+		pool->schedule(boost::bind(&test4::record, this, 1), task_tag("a"));
+	}
+	pool->schedule_affine(boost::bind(&test4::record, this, 2), 0, task_tag("a"));
+	pool->schedule_affine(boost::bind(&test4::record, this, 3), 0, task_tag("b"));
+
+	// the classes sum the shared, submission and affinity queues
+	pool_stats s = pool->stats();
+	ASSERT_EQ(3u, s.classes.size());
+	EXPECT_EQ(1u, s.classes[0].dispatched);
+	EXPECT_EQ(4, s.classes[1].pending);
+	EXPECT_EQ(1, s.classes[2].pending);
+
+	gate.open();
+	pool->wait_for_all_task_done();
+	pool->terminate();
+	pool->wait_for_all_worker_exit();
+	s = pool->stats();
+	EXPECT_EQ(3u, s.classes[1].dispatched);
+	EXPECT_EQ(0, s.classes[1].pending);
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <boost/threadpool.hpp>
+
+#include <gtest/gtest.h>
+
+#include <boost/thread.hpp>
+
+#include <stdexcept>
+//this file contains test cases for the C++20 coroutine support
+
+#if defined(__cpp_impl_coroutine)
+
+#include <boost/threadpool/coroutine.hpp>
+
+class test5 : public ::testing::Test
+{
+public:
+	fifo_pool p1;
+
+	virtual void SetUp() {
+		p1.resize(2);
+	}
+
+	virtual void TearDown(){
+		p1.terminate();
+		p1.wait_for_all_worker_exit();
+	}
+
+	task<boost::thread::id> worker_thread_id(){
+		co_await p1.schedule();
+		co_return boost::this_thread::get_id();
+	}
+
+	task<int> add_on_worker(int a, int b){
+		co_await p1.schedule();
+		co_return a + b;
+	}
+
+	task<int> sum_of_hops(int hops){
+		int sum = 0;
+		for(int i = 0; i < hops; ++i){
+			sum += co_await add_on_worker(i, 1);
+		}
+		co_return sum;
+	}
+
+	task<> fail_on_worker(){
+		co_await p1.schedule();
+		throw std::runtime_error("task failed");
+	}
+};
+
+TEST_F(test5 , resumesOnWorker){
+	EXPECT_NE(boost::this_thread::get_id(), sync_wait(worker_thread_id()));
+};
+
+TEST_F(test5 , nestedTasks){
+	EXPECT_EQ(100 * 99 / 2 + 100, sync_wait(sum_of_hops(100)));
+	p1.wait_for_all_task_done();
+	EXPECT_GE(p1.stats().total.tasks_executed, 100u);
+};
+
+TEST_F(test5 , exceptionsReachTheAwaiter){
+	EXPECT_THROW(sync_wait(fail_on_worker()), std::runtime_error);
+};
+
+#endif
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <boost/threadpool.hpp>
+#include <boost/threadpool/fiber.hpp>
+
+#include <gtest/gtest.h>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+//this file contains test cases for fibers on pool workers
+
+class test6 : public ::testing::Test
+{
+public:
+	fifo_pool p1;
+	fiber_stack_pool stacks;
+	fiber_event started;
+	boost::atomic<int> executed;
+
+	test6()
+		: stacks(16 * 1024)
+	{
+	}
+
+	virtual void SetUp() {
+		executed = 0;
+		p1.resize(2);
+	}
+
+	virtual void TearDown(){
+		p1.terminate();
+		p1.wait_for_all_worker_exit();
+	}
+
+	void waiting_task(fiber_event * e){
+		e->wait();
+		++executed;
+	};
+
+	void yielding_task(int yields){
+		for(int i = 0; i < yields; ++i){
+			EXPECT_TRUE(this_fiber::running());
+			this_fiber::yield();
+		}
+		++executed;
+	};
+
+	void note_unfinished(bool * unfinished){
+		*unfinished = executed == 0;
+	};
+};
+
+TEST_F(test6 , manyFibersWaitWithoutBlockingWorkers){
+	fiber_event go;
+	int const fibers = 5000;
+	for(int i = 0; i < fibers; ++i){
+		schedule_fiber(p1, boost::bind(&test6::waiting_task,this,&go), stacks);
+	}
+	p1.wait_for_all_task_done();
+	// all fibers are parked on the event, none of them holds a worker
+	EXPECT_EQ(0, executed);
+	EXPECT_EQ(0, p1.pending_tasks_count());
+	EXPECT_EQ(0, p1.processing_workers_count());
+
+	go.set();
+	p1.wait_for_all_task_done();
+	EXPECT_EQ(fibers, executed);
+};
+
+TEST_F(test6 , yieldLetsOtherTasksRun){
+	p1.resize(1);
+	for(int i = 0; i < 10; ++i){
+		schedule_fiber(p1, boost::bind(&test6::yielding_task,this,5), stacks);
+	}
+	p1.wait_for_all_task_done();
+	EXPECT_EQ(10, executed);
+	EXPECT_FALSE(this_fiber::running());
+};
+
+TEST_F(test6 , yieldQueuesBehindOtherTasksWithRunNext){
+	p1.resize(1);
+	p1.set_run_next_limit(8);
+	fiber_event go;
+	p1.schedule(boost::bind(&fiber_event::wait,&go));
+	schedule_fiber(p1, boost::bind(&test6::yielding_task,this,3), stacks);
+	bool unfinished = false;
+	p1.schedule(boost::bind(&test6::note_unfinished,this,&unfinished));
+	go.set();
+	p1.wait_for_all_task_done();
+	// the yielding fiber went behind the queued task, not into the worker's run-next slot
+	EXPECT_TRUE(unfinished);
+	EXPECT_EQ(1, executed);
+};
+
+TEST_F(test6 , eventSetBeforeWaitDoesNotSuspend){
+	fiber_event go;
+	go.set();
+	schedule_fiber(p1, boost::bind(&test6::waiting_task,this,&go), stacks);
+	p1.wait_for_all_task_done();
+	EXPECT_EQ(1, executed);
+
+	// threads which are not fibers block in wait
+	go.wait();
+	EXPECT_TRUE(go.is_set());
+	go.reset();
+	EXPECT_FALSE(go.is_set());
+};
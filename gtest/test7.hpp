@@ -0,0 +1,89 @@
+#pragma once
+
+#include <boost/threadpool.hpp>
+
+#include <gtest/gtest.h>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <stdexcept>
+//this file contains test cases for the sender/receiver adapter
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+
+#include <boost/threadpool/execution.hpp>
+
+class test7 : public ::testing::Test
+{
+public:
+	fifo_pool p1;
+
+	virtual void SetUp() {
+		p1.resize(2);
+	}
+
+	virtual void TearDown(){
+		p1.terminate();
+		p1.wait_for_all_worker_exit();
+	}
+};
+
+TEST_F(test7 , thenRunsOnWorker){
+	namespace ex = boost::threadpool::execution;
+	boost::thread::id const caller = boost::this_thread::get_id();
+	auto s = ex::schedule(ex::get_scheduler(p1))
+		| ex::then([]{ return boost::this_thread::get_id(); })
+		| ex::then([caller](boost::thread::id id){ return id != caller ? 42 : 0; });
+	auto result = ex::sync_wait(s);
+	ASSERT_TRUE(result.has_value());
+	EXPECT_EQ(42, std::get<0>(*result));
+};
+
+TEST_F(test7 , bulkFansOutInOneBatch){
+	namespace ex = boost::threadpool::execution;
+	int const n = 100;
+	std::vector<int> squares(n, 0);
+	auto s = ex::schedule(ex::get_scheduler(p1))
+		| ex::then([]{ return 3; })
+		| ex::bulk(n, [&squares](int i, int offset){ squares[i] = i * i + offset; })
+		| ex::then([](int offset){ return offset * 2; });
+	uint64_t const scheduled = p1.stats().queue.scheduled;
+	auto result = ex::sync_wait(s);
+	ASSERT_TRUE(result.has_value());
+	EXPECT_EQ(6, std::get<0>(*result));
+	for(int i = 0; i < n; ++i){
+		EXPECT_EQ(i * i + 3, squares[i]);
+	}
+	// one task for schedule and n for the fan-out
+	EXPECT_EQ(scheduled + 1 + n, p1.stats().queue.scheduled);
+};
+
+TEST_F(test7 , whenAllJoinsValues){
+	namespace ex = boost::threadpool::execution;
+	auto sch = ex::get_scheduler(p1);
+	auto s = ex::when_all(
+		ex::schedule(sch) | ex::then([]{ return 1; }),
+		ex::schedule(sch),
+		ex::schedule(sch) | ex::then([]{ return std::string("two"); }));
+	auto result = ex::sync_wait(s);
+	ASSERT_TRUE(result.has_value());
+	EXPECT_EQ(1, std::get<0>(*result));
+	EXPECT_EQ("two", std::get<1>(*result));
+};
+
+TEST_F(test7 , errorsReachSyncWait){
+	namespace ex = boost::threadpool::execution;
+	auto sch = ex::get_scheduler(p1);
+	boost::atomic<int> after(0);
+	auto s = ex::schedule(sch)
+		| ex::bulk(10, [](int i){ if(i == 5) throw std::runtime_error("bulk"); })
+		| ex::then([&after]{ ++after; });
+	EXPECT_THROW(ex::sync_wait(s), std::runtime_error);
+	EXPECT_EQ(0, after);
+
+	auto failing = ex::when_all(ex::schedule(sch), ex::schedule(sch) | ex::then([]{ throw std::logic_error("then"); }));
+	EXPECT_THROW(ex::sync_wait(failing), std::logic_error);
+};
+
+#endif
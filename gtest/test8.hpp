@@ -0,0 +1,302 @@
+#pragma once
+
+#include <boost/threadpool.hpp>
+
+#include <gtest/gtest.h>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <vector>
+//this file contains test cases for the task graph, the pipeline and strands
+
+class test8 : public ::testing::Test
+{
+public:
+	fifo_pool p1;
+	boost::mutex order_mutex;
+	std::vector<int> order;
+
+	virtual void SetUp() {
+		p1.resize(3);
+	}
+
+	virtual void TearDown(){
+		p1.terminate();
+		p1.wait_for_all_worker_exit();
+	}
+
+	void record(int id){
+		boost::mutex::scoped_lock lock(order_mutex);
+		order.push_back(id);
+	};
+
+	//! runs the graph from a worker and waits for it there
+	void run_and_wait(task_graph<fifo_pool> * g){
+		g->run();
+		g->wait();
+		record(3);
+	};
+
+	void wait_for(boost::atomic<bool> * open){
+		while(!*open){
+			boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+		}
+	};
+
+	int position(int id){
+		boost::mutex::scoped_lock lock(order_mutex);
+		for(std::size_t i = 0; i < order.size(); ++i){
+			if(order[i] == id){
+				return static_cast<int>(i);
+			}
+		}
+		return -1;
+	}
+};
+
+TEST_F(test8 , graphRespectsEdges){
+	task_graph<fifo_pool> g(p1);
+	// diamond: 0 -> 1, 0 -> 2, 1 -> 3, 2 -> 3, and 4 independent
+	for(int i = 0; i < 5; ++i){
+		g.add_node(boost::bind(&test8::record,this,i));
+	}
+	g.add_edge(0, 1);
+	g.add_edge(0, 2);
+	g.add_edge(1, 3);
+	g.add_edge(2, 3);
+	g.run();
+	g.wait();
+
+	ASSERT_EQ(5u, order.size());
+	EXPECT_LT(position(0), position(1));
+	EXPECT_LT(position(0), position(2));
+	EXPECT_LT(position(1), position(3));
+	EXPECT_LT(position(2), position(3));
+	EXPECT_FALSE(g.running());
+};
+
+TEST_F(test8 , graphRunsRepeatedly){
+	task_graph<fifo_pool> g(p1);
+	int const width = 30;
+	int const depth = 10;
+	// layers of width nodes, each node depends on two nodes of the previous layer
+	for(int d = 0; d < depth; ++d){
+		for(int w = 0; w < width; ++w){
+			task_graph<fifo_pool>::node_id const id = g.add_node(boost::bind(&test8::record,this,d * width + w));
+			if(d > 0){
+				g.add_edge(id - width, id);
+				g.add_edge((d - 1) * width + (w + 1) % width, id);
+			}
+		}
+	}
+	for(int run = 0; run < 20; ++run){
+		order.clear();
+		g.run();
+		g.wait();
+		ASSERT_EQ(static_cast<std::size_t>(width * depth), order.size());
+		for(int id = width; id < width * depth; ++id){
+			EXPECT_LT(position(id - width), position(id));
+		}
+	}
+	EXPECT_EQ(0, p1.pending_tasks_count());
+};
+
+TEST_F(test8 , graphDetectsCycles){
+	task_graph<fifo_pool> g(p1);
+	g.add_node(boost::bind(&test8::record,this,0));
+	g.add_node(boost::bind(&test8::record,this,1));
+	g.add_node(boost::bind(&test8::record,this,2));
+	g.add_edge(0, 1);
+	g.add_edge(1, 2);
+	g.add_edge(2, 1);
+	EXPECT_THROW(g.run(), graph_cycle);
+	EXPECT_FALSE(g.running());
+	EXPECT_TRUE(order.empty());
+};
+
+struct pipeline_item
+{
+	int value;
+	int sequence;
+};
+
+class pipeline_source
+{
+	int m_next;
+	int m_count;
+public:
+	explicit pipeline_source(int count) : m_next(0), m_count(count) {}
+
+	bool operator()(pipeline_item & item){
+		if(m_next == m_count){
+			return false;
+		}
+		item.sequence = m_next;
+		item.value = m_next++;
+		return true;
+	}
+};
+
+void square_item(pipeline_item & item){
+	item.value *= item.value;
+	boost::this_thread::yield();
+}
+
+TEST_F(test8 , pipelineKeepsOrderOfSerialStages){
+	pipeline<fifo_pool, pipeline_item> p(p1, 4);
+	boost::atomic<int> in_flight(0);
+	boost::atomic<int> max_in_flight(0);
+	std::vector<int> output;
+	int const count = 500;
+
+	p.set_input(pipeline_source(count));
+	p.add_stage(stage_parallel, [&](pipeline_item & item){
+		int const now = ++in_flight;
+		int seen = max_in_flight;
+		while(now > seen && !max_in_flight.compare_exchange_weak(seen, now)){
+		}
+		square_item(item);
+	});
+	p.add_stage(stage_serial_out_of_order, [&](pipeline_item & item){
+		record(item.sequence);
+	});
+	p.add_stage(stage_serial_in_order, [&](pipeline_item & item){
+		output.push_back(item.value);
+		--in_flight;
+	});
+	p.run();
+
+	ASSERT_EQ(static_cast<std::size_t>(count), output.size());
+	for(int i = 0; i < count; ++i){
+		EXPECT_EQ(i * i, output[i]);
+	}
+	EXPECT_EQ(static_cast<std::size_t>(count), order.size());
+	EXPECT_LE(max_in_flight, 4);
+	EXPECT_EQ(0, p1.pending_tasks_count());
+
+	// runs again with a fresh input
+	output.clear();
+	p.set_input(pipeline_source(10));
+	p.run();
+	EXPECT_EQ(10u, output.size());
+};
+
+class strand_checker
+{
+	boost::atomic<int> m_running;
+	std::vector<int> m_seen;
+public:
+	boost::atomic<bool> overlapped;
+
+	strand_checker() : m_running(0), overlapped(false) {}
+
+	void run(int value){
+		if(m_running.fetch_add(1) != 0){
+			overlapped = true;
+		}
+		m_seen.push_back(value);
+		boost::this_thread::yield();
+		m_running.fetch_sub(1);
+	}
+
+	std::vector<int> const & seen() const { return m_seen; }
+};
+
+TEST_F(test8 , strandRunsTasksSeriallyInOrder){
+	int const keys = 8;
+	int const tasks = 200;
+	strand_group<fifo_pool> strands(p1, keys, 16);
+	std::vector<strand_checker> checkers(keys);
+	for(int i = 0; i < tasks; ++i){
+		for(int k = 0; k < keys; ++k){
+			strands.schedule(k, boost::bind(&strand_checker::run, &checkers[k], i));
+		}
+	}
+	p1.wait_for_all_task_done();
+
+	for(int k = 0; k < keys; ++k){
+		EXPECT_FALSE(checkers[k].overlapped);
+		ASSERT_EQ(static_cast<std::size_t>(tasks), checkers[k].seen().size());
+		for(int i = 0; i < tasks; ++i){
+			EXPECT_EQ(i, checkers[k].seen()[i]);
+		}
+		EXPECT_EQ(0u, strands[k].pending());
+	}
+};
+
+TEST_F(test8 , strandOutlivesItsHandle){
+	strand_checker checker;
+	{
+		strand<fifo_pool> s(p1);
+		strand<fifo_pool> copy = s;
+		EXPECT_TRUE(copy == s);
+		for(int i = 0; i < 100; ++i){
+			copy.schedule(boost::bind(&strand_checker::run, &checker, i));
+		}
+	}
+	p1.wait_for_all_task_done();
+	EXPECT_EQ(100u, checker.seen().size());
+	EXPECT_FALSE(checker.overlapped);
+};
+
+TEST_F(test8 , strandBatchQueuesBehindOtherTasksWithRunNext){
+	fifo_pool pool(1);
+	pool.set_run_next_limit(8);
+	boost::atomic<bool> open(false);
+	pool.schedule(boost::bind(&test8::wait_for,this,&open));
+	strand<fifo_pool> s(pool, 2);
+	for(int i = 1; i <= 4; ++i){
+		s.schedule(boost::bind(&test8::record,this,i));
+	}
+	pool.schedule(boost::bind(&test8::record,this,100));
+	open = true;
+	pool.wait_for_all_task_done();
+	pool.terminate();
+	pool.wait_for_all_worker_exit();
+
+	// after its batch the strand queues behind the other task, not into the worker's run-next slot
+	int const expected[] = { 1, 2, 100, 3, 4 };
+	EXPECT_EQ(std::vector<int>(expected, expected + 5), order);
+};
+
+TEST_F(test8 , graphWaitOnWorkerWithRunNext){
+	p1.set_run_next_limit(4);
+	task_graph<fifo_pool> g(p1);
+	g.add_node(boost::bind(&test8::record,this,1));
+	g.add_node(boost::bind(&test8::record,this,2));
+	g.add_edge(0, 1);
+	// the root goes into the waiting worker's slot, a parked worker takes it from there
+	p1.schedule(boost::bind(&test8::run_and_wait,this,&g));
+	p1.wait_for_all_task_done();
+
+	int const expected[] = { 1, 2, 3 };
+	EXPECT_EQ(std::vector<int>(expected, expected + 3), order);
+};
+
+TEST_F(test8 , graphRunSurvivesScheduleFailure){
+	fifo_pool pool(0);
+	pool.set_queue_limits(1);
+	task_graph<fifo_pool> g(pool);
+	for(int i = 0; i < 4; ++i){
+		g.add_node(boost::bind(&test8::record,this,i));
+	}
+	g.add_edge(0, 3);
+	g.add_edge(1, 3);
+	// root 0 fills the queue, root 1 finds no worker to make room
+	EXPECT_THROW(g.run(), no_worker);
+	EXPECT_TRUE(g.running());
+
+	// the run ends with 0, 3 depends on the unscheduled 1
+	pool.resize(1);
+	g.wait();
+	EXPECT_FALSE(g.running());
+	EXPECT_EQ(std::vector<int>(1, 0), order);
+
+	// with no root scheduled the run ends right away
+	pool.terminate();
+	pool.wait_for_all_worker_exit();
+	pool.schedule(boost::bind(&test8::record,this,100));
+	EXPECT_THROW(g.run(), no_worker);
+	EXPECT_FALSE(g.running());
+};
@@ -0,0 +1,309 @@
+/*! \file
+ * \brief Open-loop load generator.
+ *
+ * Submits tasks to a pool at a fixed arrival rate, independent of how fast
+ * the pool completes them, and measures the response time of each task
+ * from the moment it was supposed to arrive. A generator which falls behind
+ * therefore does not hide the queueing delay (coordinated omission): the
+ * late submission is charged to the pool like in production, where clients
+ * do not wait for the pool before sending the next request.
+ *
+ * The offered load is swept from a fraction of the pool's capacity
+ * (workers / mean service time) until the pool saturates. Each step prints
+ * one CSV line, the steps together form the latency-vs-throughput curve.
+ *
+ * Usage: load_generator [--scheduler=fifo|lifo|prio] [--workers=n]
+ *          [--service=constant|exponential|bimodal] [--mean-us=t]
+ *          [--bimodal-ratio=p] [--bimodal-factor=f] [--arrival=uniform|poisson]
+ *          [--duration=s] [--loads=0.1,0.2,...]
+ *
+ * Bimodal service times are long (f times the short ones) with
+ * probability p, the mean stays mean-us.
+ *
+ * Copyright (c) 2005-2006 Philipp Henkel
+ *
+ * Distributed under the Boost Software License, Version 1.0. (See
+ * accompanying file LICENSE_1_0.txt or copy at
+ * http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * http://threadpool.sourceforge.net
+ *
+ */
+
+#include <boost/threadpool.hpp>
+#include <boost/threadpool/detail/pool_core.hpp>
+#include <boost/chrono.hpp>
+#include <boost/random/bernoulli_distribution.hpp>
+#include <boost/random/exponential_distribution.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+using namespace boost::threadpool;
+
+typedef boost::chrono::steady_clock clock_type;
+typedef detail::pool_core<task_func, fifo_scheduler> fifo_pool_core;
+
+
+//
+// Configuration
+struct options
+{
+  string scheduler;
+  int workers;
+  string service;
+  double mean_us;
+  double bimodal_ratio;
+  double bimodal_factor;
+  string arrival;
+  double duration;
+  vector<double> loads;
+
+  options()
+    : scheduler("fifo"), workers(4), service("exponential"), mean_us(100)
+    , bimodal_ratio(0.1), bimodal_factor(10), arrival("uniform"), duration(2)
+  {
+    for(int i = 1; i <= 12; ++i)
+    {
+      loads.push_back(i / 10.0);
+    }
+  }
+};
+
+bool parse(options & o, int argc, char *argv[])
+{
+  for(int i = 1; i < argc; ++i)
+  {
+    string const arg = argv[i];
+    string::size_type const eq = arg.find('=');
+    if(arg.compare(0, 2, "--") != 0 || eq == string::npos)
+    {
+      return false;
+    }
+    string const key = arg.substr(2, eq - 2);
+    string const value = arg.substr(eq + 1);
+    if(key == "scheduler")            o.scheduler = value;
+    else if(key == "workers")         o.workers = atoi(value.c_str());
+    else if(key == "service")         o.service = value;
+    else if(key == "mean-us")         o.mean_us = atof(value.c_str());
+    else if(key == "bimodal-ratio")   o.bimodal_ratio = atof(value.c_str());
+    else if(key == "bimodal-factor")  o.bimodal_factor = atof(value.c_str());
+    else if(key == "arrival")         o.arrival = value;
+    else if(key == "duration")        o.duration = atof(value.c_str());
+    else if(key == "loads")
+    {
+      o.loads.clear();
+      for(char const * p = value.c_str(); *p; )
+      {
+        char * end;
+        double const load = strtod(p, &end);
+        if(end == p || (*end != ',' && *end != '\0')) return false;
+        o.loads.push_back(load);
+        p = *end == ',' ? end + 1 : end;
+      }
+    }
+    else return false;
+  }
+  return (o.scheduler == "fifo" || o.scheduler == "lifo" || o.scheduler == "prio")
+    && (o.service == "constant" || o.service == "exponential" || o.service == "bimodal")
+    && (o.arrival == "uniform" || o.arrival == "poisson")
+    && o.workers > 0 && o.mean_us > 0 && o.duration > 0 && !o.loads.empty();
+}
+
+
+//
+// Service time distributions
+class service_time
+{
+  options const & m_options;
+  boost::random::mt19937 m_random;
+  boost::random::exponential_distribution<double> m_exponential;
+  boost::random::bernoulli_distribution<double> m_long;
+  double m_short_us;
+
+public:
+  explicit service_time(options const & o)
+    : m_options(o)
+    , m_exponential(1.0 / o.mean_us)
+    , m_long(o.bimodal_ratio)
+    , m_short_us(o.mean_us / (1.0 - o.bimodal_ratio + o.bimodal_ratio * o.bimodal_factor))
+  {
+  }
+
+  int64_t next_ns()
+  {
+    double us = m_options.mean_us;
+    if(m_options.service == "exponential")
+    {
+      us = m_exponential(m_random);
+    }
+    else if(m_options.service == "bimodal")
+    {
+      us = m_long(m_random) ? m_short_us * m_options.bimodal_factor : m_short_us;
+    }
+    return static_cast<int64_t>(us * 1000.0);
+  }
+};
+
+
+//
+// Tasks
+int64_t now_ns()
+{
+  return boost::chrono::duration_cast<boost::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count();
+}
+
+// Timestamps of a request, all in steady clock nanoseconds
+struct request
+{
+  int64_t intended;   // arrival time given by the schedule
+  int64_t submitted;  // time schedule was called
+  int64_t service;    // duration of the task
+  int64_t completed;  // time the task finished
+};
+
+void serve(request * r)
+{
+  int64_t const end = now_ns() + r->service;
+  while(now_ns() < end)
+  {
+  }
+  r->completed = now_ns();
+}
+
+task_func make_task(task_func const *, request * r)
+{
+  return task_func(boost::bind(&serve, r));
+}
+
+prio_task_func make_task(prio_task_func const *, request * r)
+{
+  return prio_task_func(0, task_func(boost::bind(&serve, r)));
+}
+
+
+//
+// One step of the sweep
+struct result
+{
+  double offered;
+  double achieved;
+  int64_t p50, p90, p99, p999, max;
+  int64_t p99_uncorrected;
+};
+
+int64_t percentile(vector<int64_t> const & sorted, double fraction)
+{
+  return sorted[static_cast<size_t>(fraction * double(sorted.size() - 1))];
+}
+
+template <class PoolCore>
+result run_step(PoolCore & pool, options const & o, double rate)
+{
+  service_time service(o);
+  boost::random::mt19937 random(12345);
+  boost::random::exponential_distribution<double> interarrival(rate);
+
+  size_t const count = static_cast<size_t>(rate * o.duration) + 1;
+  vector<request> requests(count);
+
+  // arrival schedule
+  int64_t const start = now_ns() + 1000000;
+  double offset_s = 0;
+  for(size_t i = 0; i < count; ++i)
+  {
+    requests[i].intended = start + static_cast<int64_t>(offset_s * 1e9);
+    requests[i].service = service.next_ns();
+    offset_s += o.arrival == "poisson" ? interarrival(random) : 1.0 / rate;
+  }
+
+  for(size_t i = 0; i < count; ++i)
+  {
+    request & r = requests[i];
+    int64_t wait = r.intended - now_ns();
+    if(wait > 200000)
+    {
+      boost::this_thread::sleep_for(boost::chrono::nanoseconds(wait - 100000));
+    }
+    while(now_ns() < r.intended)
+    {
+    }
+    r.submitted = now_ns();
+    pool.schedule(make_task(static_cast<typename PoolCore::task_type const *>(0), &r));
+  }
+  pool.wait_for_all_task_done();
+
+  vector<int64_t> corrected(count), uncorrected(count);
+  int64_t last = 0;
+  for(size_t i = 0; i < count; ++i)
+  {
+    corrected[i] = requests[i].completed - requests[i].intended;
+    uncorrected[i] = requests[i].completed - requests[i].submitted;
+    last = max(last, requests[i].completed);
+  }
+  sort(corrected.begin(), corrected.end());
+  sort(uncorrected.begin(), uncorrected.end());
+
+  result res;
+  res.offered = rate;
+  res.achieved = double(count) / (double(last - start) * 1e-9);
+  res.p50 = percentile(corrected, 0.5);
+  res.p90 = percentile(corrected, 0.9);
+  res.p99 = percentile(corrected, 0.99);
+  res.p999 = percentile(corrected, 0.999);
+  res.max = corrected.back();
+  res.p99_uncorrected = percentile(uncorrected, 0.99);
+  return res;
+}
+
+template <class PoolCore>
+void sweep(options const & o)
+{
+  boost::shared_ptr<PoolCore> pool = make_pool<PoolCore>();
+  pool->resize(o.workers);
+
+  double const capacity = o.workers * 1e6 / o.mean_us;
+  printf("scheduler,workers,service,arrival,load,offered_per_s,achieved_per_s,p50_us,p90_us,p99_us,p999_us,max_us,p99_uncorrected_us\n");
+  for(size_t i = 0; i < o.loads.size(); ++i)
+  {
+    result const r = run_step(*pool, o, o.loads[i] * capacity);
+    printf("%s,%d,%s,%s,%.2f,%.0f,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+      o.scheduler.c_str(), o.workers, o.service.c_str(), o.arrival.c_str(), o.loads[i],
+      r.offered, r.achieved, r.p50 / 1e3, r.p90 / 1e3, r.p99 / 1e3, r.p999 / 1e3, r.max / 1e3, r.p99_uncorrected / 1e3);
+    fflush(stdout);
+
+    // saturated: the pool no longer keeps up with the offered load
+    if(r.achieved < 0.95 * r.offered)
+    {
+      break;
+    }
+  }
+
+  pool->terminate();
+  pool->wait_for_all_worker_exit();
+}
+
+
+int main(int argc, char *argv[])
+{
+  options o;
+  if(!parse(o, argc, argv))
+  {
+    fprintf(stderr, "usage: %s [--scheduler=fifo|lifo|prio] [--workers=n] [--service=constant|exponential|bimodal]\n"
+      "  [--mean-us=t] [--bimodal-ratio=p] [--bimodal-factor=f] [--arrival=uniform|poisson] [--duration=s] [--loads=0.1,0.2,...]\n", argv[0]);
+    return 1;
+  }
+
+  if(o.scheduler == "fifo")       sweep<fifo_pool_core>(o);
+  else if(o.scheduler == "lifo")  sweep<lifo_pool_core>(o);
+  else                            sweep<prio_pool_core>(o);
+  return 0;
+}
@@ -0,0 +1,261 @@
+/*! \file
+ * \brief Microbenchmarks of the pool's scheduling overhead.
+ *
+ * The tasks are empty or nearly empty, so the results show the cost of the
+ * pool itself: throughput of empty tasks per scheduling policy, scaling
+ * with the number of producers and workers, latency from schedule until
+ * the task starts, and the cost of resizing.
+ *
+ * Built on Google Benchmark. Use --benchmark_format=json or
+ * --benchmark_out=<file> --benchmark_out_format=json for machine-readable
+ * results and tools/compare.py of Google Benchmark to compare two runs.
+ *
+ * Copyright (c) 2005-2006 Philipp Henkel
+ *
+ * Distributed under the Boost Software License, Version 1.0. (See
+ * accompanying file LICENSE_1_0.txt or copy at
+ * http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * http://threadpool.sourceforge.net
+ *
+ */
+
+#include <boost/threadpool.hpp>
+#include <boost/threadpool/detail/pool_core.hpp>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+
+#include <benchmark/benchmark.h>
+
+
+using namespace boost::threadpool;
+
+typedef detail::pool_core<task_func, fifo_scheduler> fifo_pool_core;
+
+// Tasks scheduled per benchmark iteration
+int const batch_size = 10000;
+
+
+//
+// Helpers
+void empty_task()
+{
+}
+
+// Creates an empty task of the pool's task type
+task_func make_task(task_func const *)
+{
+  return task_func(&empty_task);
+}
+
+prio_task_func make_task(prio_task_func const *)
+{
+  return prio_task_func(0, task_func(&empty_task));
+}
+
+template <class PoolCore>
+typename PoolCore::task_type make_task()
+{
+  return make_task(static_cast<typename PoolCore::task_type const *>(0));
+}
+
+template <class PoolCore>
+void shutdown(PoolCore & pool)
+{
+  pool.terminate();
+  pool.wait_for_all_worker_exit();
+}
+
+void set_per_task_counters(benchmark::State & state, int tasks_per_iteration)
+{
+  state.SetItemsProcessed(state.iterations() * tasks_per_iteration);
+  state.counters["time_per_task"] = benchmark::Counter(
+    double(tasks_per_iteration), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+
+//
+// Empty task throughput of one producer, per scheduling policy.
+// Arg: number of workers.
+template <class PoolCore>
+void BM_EmptyTaskThroughput(benchmark::State & state)
+{
+  boost::shared_ptr<PoolCore> pool = make_pool<PoolCore>();
+  pool->resize(static_cast<int>(state.range(0)));
+  typename PoolCore::task_type const task = make_task<PoolCore>();
+
+  for(auto _ : state)
+  {
+    for(int i = 0; i < batch_size; ++i)
+    {
+      pool->schedule(task);
+    }
+    pool->wait_for_all_task_done();
+  }
+
+  set_per_task_counters(state, batch_size);
+  shutdown(*pool);
+}
+BENCHMARK_TEMPLATE(BM_EmptyTaskThroughput, fifo_pool_core)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_EmptyTaskThroughput, lifo_pool_core)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_EmptyTaskThroughput, prio_pool_core)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_EmptyTaskThroughput, bucket_prio_pool_core)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+
+//
+// Empty task throughput with several producers.
+// Args: number of producers, number of workers.
+void produce(fifo_pool_core * pool, int tasks)
+{
+  task_func const task(&empty_task);
+  for(int i = 0; i < tasks; ++i)
+  {
+    pool->schedule(task);
+  }
+}
+
+void BM_Producers(benchmark::State & state)
+{
+  int const producers = static_cast<int>(state.range(0));
+  boost::shared_ptr<fifo_pool_core> pool = make_pool<fifo_pool_core>();
+  pool->resize(static_cast<int>(state.range(1)));
+
+  for(auto _ : state)
+  {
+    boost::thread_group threads;
+    for(int p = 0; p < producers; ++p)
+    {
+      threads.create_thread(boost::bind(&produce, pool.get(), batch_size / producers));
+    }
+    threads.join_all();
+    pool->wait_for_all_task_done();
+  }
+
+  set_per_task_counters(state, batch_size / producers * producers);
+  shutdown(*pool);
+}
+BENCHMARK(BM_Producers)->ArgsProduct({{1, 2, 4, 8}, {1, 2, 4, 8}})->ArgNames({"producers", "workers"})->UseRealTime();
+
+
+//
+// Time from schedule until the task starts on an idle worker.
+// Arg: number of workers.
+void record_start(boost::atomic<int64_t> * started)
+{
+  started->store(boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+    boost::chrono::steady_clock::now().time_since_epoch()).count(), boost::memory_order_release);
+}
+
+void BM_ScheduleToStart(benchmark::State & state)
+{
+  boost::shared_ptr<fifo_pool_core> pool = make_pool<fifo_pool_core>();
+  pool->resize(static_cast<int>(state.range(0)));
+  boost::atomic<int64_t> started(0);
+
+  for(auto _ : state)
+  {
+    started.store(0, boost::memory_order_relaxed);
+    boost::chrono::steady_clock::time_point const scheduled = boost::chrono::steady_clock::now();
+    pool->schedule(boost::bind(&record_start, &started));
+
+    int64_t start;
+    while((start = started.load(boost::memory_order_acquire)) == 0)
+    {
+    }
+    int64_t const latency = start - boost::chrono::duration_cast<boost::chrono::nanoseconds>(scheduled.time_since_epoch()).count();
+    state.SetIterationTime(double(latency) * 1e-9);
+
+    pool->wait_for_all_task_done();
+  }
+
+  shutdown(*pool);
+}
+BENCHMARK(BM_ScheduleToStart)->Arg(1)->Arg(4)->UseManualTime();
+
+
+//
+// Priority queue alone, every thread pushes and pops: one locked heap
+// compared with the MultiQueue.
+boost::mutex locked_heap_mutex;
+prio_scheduler<> locked_heap;
+
+void BM_LockedHeap(benchmark::State & state)
+{
+  prio_task_func const task = make_task<prio_pool_core>();
+  for(auto _ : state)
+  {
+    for(int i = 0; i < 100; ++i)
+    {
+      boost::mutex::scoped_lock lock(locked_heap_mutex);
+      locked_heap.push(task);
+    }
+    for(int i = 0; i < 100; ++i)
+    {
+      boost::mutex::scoped_lock lock(locked_heap_mutex);
+      benchmark::DoNotOptimize(locked_heap.top());
+      locked_heap.pop();
+    }
+  }
+  set_per_task_counters(state, 100);
+}
+BENCHMARK(BM_LockedHeap)->ThreadRange(1, 8)->UseRealTime();
+
+multi_queue_scheduler<> multi_queue;
+
+void BM_MultiQueue(benchmark::State & state)
+{
+  prio_task_func const task = make_task<prio_pool_core>();
+  prio_task_func popped;
+  for(auto _ : state)
+  {
+    for(int i = 0; i < 100; ++i)
+    {
+      multi_queue.push(task);
+    }
+    for(int i = 0; i < 100; ++i)
+    {
+      multi_queue.try_pop(popped);
+    }
+  }
+  set_per_task_counters(state, 100);
+}
+BENCHMARK(BM_MultiQueue)->ThreadRange(1, 8)->UseRealTime();
+
+
+//
+// Growing an empty pool to n workers and shrinking it back to none.
+// Each iteration waits until the threads ended, so they do not pile up.
+// Arg: number of workers.
+void BM_Resize(benchmark::State & state)
+{
+  boost::shared_ptr<fifo_pool_core> pool = make_pool<fifo_pool_core>();
+  int const workers = static_cast<int>(state.range(0));
+
+  for(auto _ : state)
+  {
+    if(!pool->resize(workers) || pool->total_workers_count() != workers)
+    {
+      state.SkipWithError("resize did not start the workers");
+      break;
+    }
+    if(!pool->resize(0) || pool->total_workers_count() != 0)
+    {
+      state.SkipWithError("resize did not stop the workers");
+      break;
+    }
+    // a worker thread holds the pool until it ends
+    while(pool.use_count() > 1)
+    {
+      boost::this_thread::yield();
+    }
+  }
+
+  state.counters["time_per_worker"] = benchmark::Counter(
+    double(workers), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+  shutdown(*pool);
+}
+BENCHMARK(BM_Resize)->RangeMultiplier(4)->Range(1, 16)->UseRealTime();
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,36 @@
+/*! \file
+* \brief Portable runner of the gtest suites.
+*
+* Runs the suites of vc10/threadpool/threadpool.cpp on every platform, see
+* Jamfile.v2 for the builds.
+*
+* Copyright (c) 2005-2007 Philipp Henkel
+*
+* Distributed under the Boost Software License, Version 1.0. (See
+* accompanying file LICENSE_1_0.txt or copy at
+* http://www.boost.org/LICENSE_1_0.txt)
+*
+* http://threadpool.sourceforge.net
+*
+*/
+
+#include <boost/threadpool.hpp>
+
+using namespace boost::threadpool;
+
+#include <gtest/gtest.h>
+
+#include <gtest/test1.hpp>
+#include <gtest/test2.hpp>
+#include <gtest/test3.hpp>
+#include <gtest/test4.hpp>
+#include <gtest/test5.hpp>
+#include <gtest/test6.hpp>
+#include <gtest/test7.hpp>
+#include <gtest/test8.hpp>
+
+int main(int argc, char* argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,267 @@
+/*! \file
+ * \brief threadpool-top: live view of the pools which export their metrics.
+ *
+ * Attaches read-only to the shared memory objects created by
+ * enable_metrics_export and prints queue depth, throughput, utilisation
+ * and queue wait and run time percentiles of every pool, refreshed
+ * periodically. The pools are not affected by the observation.
+ *
+ * Usage: threadpool-top [-p pid] [-d seconds] [-n iterations] [-b] [-c]
+ *   -p  only show the pools of this process
+ *   -d  refresh interval, default 1 second
+ *   -n  exit after this many refreshes
+ *   -b  batch mode, do not clear the screen between refreshes
+ *   -c  remove the objects of processes which exited without removing them
+ *
+ * Copyright (c) 2005-2007 Philipp Henkel
+ *
+ * Distributed under the Boost Software License, Version 1.0. (See
+ * accompanying file LICENSE_1_0.txt or copy at
+ * http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * http://threadpool.sourceforge.net
+ *
+ */
+
+#include <boost/threadpool/detail/shm_metrics.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace boost::threadpool::detail;
+
+
+// Counters of a pool at one refresh
+struct sample
+{
+   double time;
+   uint64_t scheduled;
+   uint64_t executed;
+   uint64_t busy_ns;
+   vector<uint64_t> queue_wait;
+   vector<uint64_t> run_time;
+
+   sample()
+      : time(0), scheduled(0), executed(0), busy_ns(0)
+      , queue_wait(shm_metrics_buckets), run_time(shm_metrics_buckets)
+   {
+   }
+};
+
+
+double now_seconds()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+}
+
+
+bool process_alive(long pid)
+{
+   return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+}
+
+
+// Names of the shared memory objects of all pools, e.g. /threadpool.1234.0
+vector<string> find_pools(long pid)
+{
+   vector<string> paths;
+   DIR * dir = opendir("/dev/shm");
+   if(!dir)
+   {
+      return paths;
+   }
+   char prefix[64];
+   if(pid > 0)
+   {
+      sprintf(prefix, "threadpool.%ld.", pid);
+   }
+   else
+   {
+      sprintf(prefix, "threadpool.");
+   }
+   while(dirent * entry = readdir(dir))
+   {
+      if(strncmp(entry->d_name, prefix, strlen(prefix)) == 0)
+      {
+         paths.push_back(string("/") + entry->d_name);
+      }
+   }
+   closedir(dir);
+   return paths;
+}
+
+
+sample read_sample(shm_metrics_view const & view)
+{
+   sample s;
+   s.time = now_seconds();
+   s.scheduled = view.header().scheduled.load(boost::memory_order_relaxed);
+   for(size_t i = 0; i < view.header().slot_count; ++i)
+   {
+      shm_metrics_slot const & slot = view.slot(i);
+      s.executed += slot.executed.load(boost::memory_order_relaxed);
+      s.busy_ns += slot.busy_ns.load(boost::memory_order_relaxed);
+      for(size_t b = 0; b < shm_metrics_buckets; ++b)
+      {
+         s.queue_wait[b] += slot.queue_wait[b].load(boost::memory_order_relaxed);
+         s.run_time[b] += slot.run_time[b].load(boost::memory_order_relaxed);
+      }
+   }
+   return s;
+}
+
+
+// Upper bound of the bucket which contains the given fraction of the histogram's samples
+string percentile(vector<uint64_t> const & histogram, double fraction)
+{
+   uint64_t total = 0;
+   for(size_t b = 0; b < histogram.size(); ++b)
+   {
+      total += histogram[b];
+   }
+   if(total == 0)
+   {
+      return "-";
+   }
+
+   uint64_t const rank = static_cast<uint64_t>(fraction * double(total - 1)) + 1;
+   uint64_t seen = 0;
+   size_t bucket = 0;
+   for(; bucket + 1 < histogram.size(); ++bucket)
+   {
+      seen += histogram[bucket];
+      if(seen >= rank)
+      {
+         break;
+      }
+   }
+
+   double const ns = double(uint64_t(2) << bucket);
+   char text[32];
+   if(ns < 1e3)       sprintf(text, "%.0fns", ns);
+   else if(ns < 1e6)  sprintf(text, "%.0fus", ns / 1e3);
+   else if(ns < 1e9)  sprintf(text, "%.0fms", ns / 1e6);
+   else               sprintf(text, "%.1fs", ns / 1e9);
+   return text;
+}
+
+
+int main(int argc, char *argv[])
+{
+   long pid = 0;
+   double delay = 1.0;
+   long iterations = -1;
+   bool batch = !isatty(STDOUT_FILENO);
+   bool cleanup = false;
+
+   int opt;
+   while((opt = getopt(argc, argv, "p:d:n:bc")) != -1)
+   {
+      switch(opt)
+      {
+      case 'p': pid = atol(optarg); break;
+      case 'd': delay = atof(optarg); break;
+      case 'n': iterations = atol(optarg); break;
+      case 'b': batch = true; break;
+      case 'c': cleanup = true; break;
+      default:
+         fprintf(stderr, "usage: %s [-p pid] [-d seconds] [-n iterations] [-b] [-c]\n", argv[0]);
+         return 1;
+      }
+   }
+
+   map<string, sample> previous;
+   for(long iteration = 0; iterations < 0 || iteration < iterations; ++iteration)
+   {
+      if(iteration > 0)
+      {
+         usleep(static_cast<useconds_t>(delay * 1e6));
+      }
+
+      if(!batch)
+      {
+         printf("\033[H\033[2J");
+      }
+      printf("%-8s %-20s %11s %7s %10s %10s %5s %8s %8s %8s %8s\n",
+         "PID", "POOL", "WRK/ACT/TGT", "QUEUE", "SCHED/s", "DONE/s", "BUSY", "WAIT50", "WAIT99", "RUN50", "RUN99");
+
+      map<string, sample> current;
+      vector<string> const paths = find_pools(pid);
+      for(vector<string>::const_iterator it = paths.begin(); it != paths.end(); ++it)
+      {
+         shm_metrics_view view(it->c_str());
+         if(!view.valid() || view.header().closed.load(boost::memory_order_relaxed))
+         {
+            continue;
+         }
+         if(!process_alive(static_cast<long>(view.header().pid)))
+         {
+            if(cleanup)
+            {
+               shm_unlink(it->c_str());
+            }
+            continue;
+         }
+         shm_metrics_header const & h = view.header();
+         sample const s = read_sample(view);
+         current[*it] = s;
+
+         // rates and percentiles over the last interval, since the start on the first refresh
+         sample delta = s;
+         double seconds = 0;
+         map<string, sample>::const_iterator const prev = previous.find(*it);
+         if(prev != previous.end())
+         {
+            seconds = s.time - prev->second.time;
+            delta.scheduled -= prev->second.scheduled;
+            delta.executed -= prev->second.executed;
+            delta.busy_ns -= prev->second.busy_ns;
+            for(size_t b = 0; b < shm_metrics_buckets; ++b)
+            {
+               delta.queue_wait[b] -= prev->second.queue_wait[b];
+               delta.run_time[b] -= prev->second.run_time[b];
+            }
+         }
+
+         uint64_t const workers = h.workers.load(boost::memory_order_relaxed);
+         char counts[32];
+         sprintf(counts, "%lu/%lu/%lu", static_cast<unsigned long>(workers),
+            static_cast<unsigned long>(h.processing.load(boost::memory_order_relaxed)),
+            static_cast<unsigned long>(h.target_workers.load(boost::memory_order_relaxed)));
+         char sched_rate[16] = "-", done_rate[16] = "-", busy[16] = "-";
+         if(seconds > 0)
+         {
+            sprintf(sched_rate, "%.0f", double(delta.scheduled) / seconds);
+            sprintf(done_rate, "%.0f", double(delta.executed) / seconds);
+            if(workers > 0)
+            {
+               sprintf(busy, "%.0f%%", 100.0 * double(delta.busy_ns) / (seconds * 1e9 * double(workers)));
+            }
+         }
+
+         printf("%-8ld %-20.20s %11s %7lu %10s %10s %5s %8s %8s %8s %8s\n",
+            static_cast<long>(h.pid), h.name, counts,
+            static_cast<unsigned long>(h.pending.load(boost::memory_order_relaxed)),
+            sched_rate, done_rate, busy,
+            percentile(delta.queue_wait, 0.5).c_str(), percentile(delta.queue_wait, 0.99).c_str(),
+            percentile(delta.run_time, 0.5).c_str(), percentile(delta.run_time, 0.99).c_str());
+      }
+      previous.swap(current);
+      fflush(stdout);
+   }
+
+   return 0;
+}
@@ -0,0 +1,291 @@
+/*! \file
+ * \brief workload_replay: feeds a recorded workload into a pool configuration.
+ *
+ * Reads a file written in recording mode (enable_recording) and schedules
+ * a synthetic task for each recorded one at its recorded arrival time.
+ * The synthetic task spins for the recorded run duration. The queue wait
+ * and response time percentiles per tag are printed next to the recorded
+ * queue wait, so scheduler and sizing changes can be compared against real
+ * traffic.
+ *
+ * Usage: workload_replay <file> [--scheduler=fifo|lifo|prio] [--workers=n]
+ *          [--speed=f] [--priority=tag:value,...]
+ *   --speed     arrival time scale, 2 replays twice as fast
+ *   --priority  priorities of named tags for the prio scheduler, numeric
+ *               tags use their id, untagged tasks 0
+ *
+ * Copyright (c) 2005-2006 Philipp Henkel
+ *
+ * Distributed under the Boost Software License, Version 1.0. (See
+ * accompanying file LICENSE_1_0.txt or copy at
+ * http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * http://threadpool.sourceforge.net
+ *
+ */
+
+#include <boost/threadpool.hpp>
+#include <boost/threadpool/detail/pool_core.hpp>
+#include <boost/threadpool/detail/workload_record.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+using namespace boost::threadpool;
+using boost::threadpool::detail::recorded_task;
+
+typedef detail::pool_core<task_func, fifo_scheduler> fifo_pool_core;
+
+
+//
+// Configuration
+struct options
+{
+  string path;
+  string scheduler;
+  int workers;
+  double speed;
+  map<string, int> priorities;
+
+  options()
+    : scheduler("fifo"), workers(4), speed(1.0)
+  {
+  }
+};
+
+bool parse(options & o, int argc, char *argv[])
+{
+  for(int i = 1; i < argc; ++i)
+  {
+    string const arg = argv[i];
+    string::size_type const eq = arg.find('=');
+    if(arg.compare(0, 2, "--") != 0)
+    {
+      if(!o.path.empty())
+      {
+        return false;
+      }
+      o.path = arg;
+      continue;
+    }
+    if(eq == string::npos)
+    {
+      return false;
+    }
+    string const key = arg.substr(2, eq - 2);
+    string const value = arg.substr(eq + 1);
+    if(key == "scheduler")      o.scheduler = value;
+    else if(key == "workers")   o.workers = atoi(value.c_str());
+    else if(key == "speed")     o.speed = atof(value.c_str());
+    else if(key == "priority")
+    {
+      string::size_type begin = 0;
+      while(begin < value.size())
+      {
+        string::size_type end = value.find(',', begin);
+        if(end == string::npos)
+        {
+          end = value.size();
+        }
+        string const item = value.substr(begin, end - begin);
+        string::size_type const colon = item.find(':');
+        if(colon == string::npos)
+        {
+          return false;
+        }
+        o.priorities[item.substr(0, colon)] = atoi(item.c_str() + colon + 1);
+        begin = end + 1;
+      }
+    }
+    else return false;
+  }
+  return !o.path.empty() && o.workers > 0 && o.speed > 0
+    && (o.scheduler == "fifo" || o.scheduler == "lifo" || o.scheduler == "prio");
+}
+
+string tag_name(task_tag const & tag)
+{
+  if(tag.empty())
+  {
+    return "(untagged)";
+  }
+  if(tag.name())
+  {
+    return tag.name();
+  }
+  char text[32];
+  sprintf(text, "#%u", tag.id());
+  return text;
+}
+
+
+//
+// Replayed tasks
+int64_t now_ns()
+{
+  return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+    boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct replayed_task
+{
+  recorded_task recorded;
+  int priority;
+  int64_t due;        // replay arrival time
+  int64_t started;
+  int64_t completed;
+};
+
+void run(replayed_task * t)
+{
+  t->started = now_ns();
+  int64_t const end = t->started + t->recorded.run;
+  while(now_ns() < end)
+  {
+  }
+  t->completed = now_ns();
+}
+
+task_func make_task(task_func const *, replayed_task * t)
+{
+  return task_func(boost::bind(&run, t));
+}
+
+prio_task_func make_task(prio_task_func const *, replayed_task * t)
+{
+  return prio_task_func(t->priority, task_func(boost::bind(&run, t)));
+}
+
+bool by_arrival(replayed_task const & lhs, replayed_task const & rhs)
+{
+  return lhs.recorded.arrival < rhs.recorded.arrival;
+}
+
+
+//
+// Statistics
+double percentile_us(vector<int64_t> & values, double fraction)
+{
+  sort(values.begin(), values.end());
+  return values[static_cast<size_t>(fraction * double(values.size() - 1))] / 1e3;
+}
+
+struct tag_samples
+{
+  vector<int64_t> recorded_wait;
+  vector<int64_t> wait;
+  vector<int64_t> response;
+};
+
+void print_row(string const & name, tag_samples & s)
+{
+  printf("%s,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", name.c_str(), static_cast<unsigned long>(s.wait.size()),
+    percentile_us(s.recorded_wait, 0.5), percentile_us(s.recorded_wait, 0.99),
+    percentile_us(s.wait, 0.5), percentile_us(s.wait, 0.99),
+    percentile_us(s.response, 0.5), percentile_us(s.response, 0.99));
+}
+
+
+template <class PoolCore>
+void replay(options const & o, vector<replayed_task> & tasks)
+{
+  boost::shared_ptr<PoolCore> pool = make_pool<PoolCore>();
+  pool->resize(o.workers);
+
+  int64_t const first = tasks.front().recorded.arrival;
+  int64_t const start = now_ns() + 1000000;
+  for(vector<replayed_task>::iterator it = tasks.begin(); it != tasks.end(); ++it)
+  {
+    it->due = start + static_cast<int64_t>(double(it->recorded.arrival - first) / o.speed);
+    int64_t const wait = it->due - now_ns();
+    if(wait > 200000)
+    {
+      boost::this_thread::sleep_for(boost::chrono::nanoseconds(wait - 100000));
+    }
+    while(now_ns() < it->due)
+    {
+    }
+    pool->schedule(make_task(static_cast<typename PoolCore::task_type const *>(0), &*it));
+  }
+  pool->wait_for_all_task_done();
+  pool->terminate();
+  pool->wait_for_all_worker_exit();
+}
+
+
+int main(int argc, char *argv[])
+{
+  options o;
+  if(!parse(o, argc, argv))
+  {
+    fprintf(stderr, "usage: %s <file> [--scheduler=fifo|lifo|prio] [--workers=n] [--speed=f] [--priority=tag:value,...]\n", argv[0]);
+    return 1;
+  }
+
+  detail::workload_reader reader(o.path.c_str());
+  if(!reader.valid())
+  {
+    fprintf(stderr, "%s is not a workload file\n", o.path.c_str());
+    return 1;
+  }
+
+  vector<replayed_task> tasks;
+  replayed_task t;
+  while(reader.next(t.recorded))
+  {
+    t.priority = 0;
+    if(t.recorded.tag.name())
+    {
+      map<string, int>::const_iterator const p = o.priorities.find(t.recorded.tag.name());
+      t.priority = p != o.priorities.end() ? p->second : 0;
+    }
+    else
+    {
+      t.priority = static_cast<int>(t.recorded.tag.id());
+    }
+    tasks.push_back(t);
+  }
+  if(tasks.empty())
+  {
+    fprintf(stderr, "%s contains no tasks\n", o.path.c_str());
+    return 1;
+  }
+  stable_sort(tasks.begin(), tasks.end(), by_arrival);
+
+  if(o.scheduler == "fifo")       replay<fifo_pool_core>(o, tasks);
+  else if(o.scheduler == "lifo")  replay<lifo_pool_core>(o, tasks);
+  else                            replay<prio_pool_core>(o, tasks);
+
+  map<string, tag_samples> by_tag;
+  tag_samples all;
+  for(vector<replayed_task>::const_iterator it = tasks.begin(); it != tasks.end(); ++it)
+  {
+    tag_samples & s = by_tag[tag_name(it->recorded.tag)];
+    int64_t const wait = it->started - it->due;
+    int64_t const response = it->completed - it->due;
+    s.recorded_wait.push_back(it->recorded.queue_wait);
+    s.wait.push_back(wait);
+    s.response.push_back(response);
+    all.recorded_wait.push_back(it->recorded.queue_wait);
+    all.wait.push_back(wait);
+    all.response.push_back(response);
+  }
+
+  printf("# %s: %lu tasks, scheduler=%s workers=%d speed=%.2f\n", o.path.c_str(),
+    static_cast<unsigned long>(tasks.size()), o.scheduler.c_str(), o.workers, o.speed);
+  printf("tag,tasks,recorded_wait_p50_us,recorded_wait_p99_us,wait_p50_us,wait_p99_us,response_p50_us,response_p99_us\n");
+  for(map<string, tag_samples>::iterator it = by_tag.begin(); it != by_tag.end(); ++it)
+  {
+    print_row(it->first, it->second);
+  }
+  print_row("(all)", all);
+  return 0;
+}
@@ -12,6 +12,11 @@ using namespace boost::threadpool;
 #include <gtest/test1.hpp>
 #include <gtest/test2.hpp>
 #include <gtest/test3.hpp>
+#include <gtest/test4.hpp>
+#include <gtest/test5.hpp>
+#include <gtest/test6.hpp>
+#include <gtest/test7.hpp>
+#include <gtest/test8.hpp>
 
 void simple_task(){
 	static int i = 0;